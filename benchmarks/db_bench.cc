@@ -4,17 +4,23 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <vector>
 
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/persistent_cache.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -33,16 +39,30 @@
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
+//      multireadrandom -- read N times in random order, in batches of
+//                       --multiget_batch_size keys issued via DB::MultiGet
 //      readmissing   -- read N missing keys in random order
 //      readhot       -- read N times in random order from 1% section of DB
+//      scanreadhot   -- readhot, with a full scan of the DB advancing by ten
+//                       entries before each read
 //      seekrandom    -- N random seeks
 //      seekordered   -- N ordered seeks
+//      seekprefix    -- N random seeks to a --prefix_size key prefix, each
+//                       followed by a scan of the keys with that prefix
 //      open          -- cost of opening a DB
+//      recover       -- cost of opening a DB that replays N values from
+//                       its log
 //      crc32c        -- repeated crc32c of 4K of data
+//      cachelookup   -- N lookups of 1000 hot entries in the --cache_type
+//                       block cache, from --threads threads
+//      filterlookup  -- N lookups of absent keys in a filter built over N
+//                       keys with the --bloom_bits/--blocked_bloom/
+//                       --fuse_filter policy
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
 //      sstables    -- Print sstable info
+//      bgstats     -- Print background thread and queue stats
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
     "fillseq,"
@@ -90,10 +110,26 @@ static bool FLAGS_comparisons = false;
 // (initialized to default value by "main")
 static int FLAGS_write_buffer_size = 0;
 
+// Number of write buffers that may be held in memory at once
+// (initialized to default value by "main")
+static int FLAGS_max_write_buffer_number = 0;
+
+// If true, log appends overlap with memtable inserts of the previous group
+static bool FLAGS_enable_pipelined_write = false;
+
+// If true, every writer of a group inserts its own batch into the memtable
+static bool FLAGS_allow_concurrent_memtable_write = false;
+
 // Number of bytes written to each file.
 // (initialized to default value by "main")
 static int FLAGS_max_file_size = 0;
 
+// Approximate size of index partitions (0 means an unpartitioned index)
+static int FLAGS_index_partition_size = 0;
+
+// If true, data blocks carry a hash index for point lookups
+static bool FLAGS_data_block_hash_index = false;
+
 // Approximate size of user data packed per block (before compression.
 // (initialized to default value by "main")
 static int FLAGS_block_size = 0;
@@ -102,16 +138,62 @@ static int FLAGS_block_size = 0;
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// Number of bytes to use as a cache of compressed data read from the
+// table files.  Negative means no such cache.
+static int FLAGS_compressed_cache_size = -1;
+
+// Eviction policy of the cache: "lru", "2q" or "clock".
+static const char* FLAGS_cache_type = "lru";
+
+// Log2 of the number of cache shards (negative means use default settings)
+static int FLAGS_cache_shard_bits = -1;
+
+// If true, open all tables in DB::Open()
+static bool FLAGS_preload_tables_on_open = false;
+
+// If true, charge index and filter blocks to the block cache
+static bool FLAGS_cache_index_and_filter_blocks = false;
+
+// If true, pin the index and filter blocks of level 0 tables in the cache
+static bool FLAGS_pin_l0_filter_and_index_blocks_in_cache = false;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
+// Maximum number of concurrent background compactions
+// (initialized to default value by "main")
+static int FLAGS_max_background_compactions = 0;
+
 // Bloom filter bits per key.
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// If true, build cache-line-blocked bloom filters
+static bool FLAGS_blocked_bloom = false;
+
+// If true, use binary fuse filters (regardless of --bloom_bits)
+static bool FLAGS_fuse_filter = false;
+
+// Filter layout: 0 = per-2KB block-based, 1 = full, 2 = partitioned
+static int FLAGS_filter_block_type = 0;
+
+// Number of keys looked up per DB::MultiGet call by multireadrandom.
+static int FLAGS_multiget_batch_size = 100;
+
+// ReadOptions::readahead_size for readseq.  0 reads ahead automatically.
+static int FLAGS_readahead_size = 0;
+
+// Options::compaction_readahead_size.  0 reads compaction inputs block by
+// block.
+static int FLAGS_compaction_readahead_size = 0;
+
 // Common key prefix length.
 static int FLAGS_key_prefix = 0;
 
+// If positive, key prefixes of this length are added to full filters
+// (see --filter_block_type) and used by seekprefix.
+static int FLAGS_prefix_size = 0;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -120,12 +202,30 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, replay the logs in a pipeline of threads when opening the db.
+static bool FLAGS_parallel_log_recovery = false;
+
 // If true, use compression.
 static bool FLAGS_compression = true;
 
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
+// If non-null, keep a persistent cache of table blocks in this directory.
+// It is emptied unless --use_existing_db is set.
+static const char* FLAGS_persistent_cache_path = nullptr;
+
+// Number of bytes to use for the persistent cache.
+static int FLAGS_persistent_cache_size = 1 << 30;
+
+// If positive, limit the table files written by flushes and compactions
+// to this many bytes per second.
+static int FLAGS_rate_limiter_bytes_per_sec = 0;
+
+// If true, tune the rate limit to the pending compaction bytes, up to
+// --rate_limiter_bytes_per_sec.
+static bool FLAGS_rate_limiter_auto_tuned = false;
+
 // ZSTD compression level to try out
 static int FLAGS_zstd_compression_level = 1;
 
@@ -428,7 +528,11 @@ void Uncompress(
 class Benchmark {
  private:
   Cache* cache_;
+  Cache* compressed_cache_;
+  PersistentCache* persistent_cache_;
+  RateLimiter* rate_limiter_;
   const FilterPolicy* filter_policy_;
+  const SliceTransform* prefix_extractor_;
   DB* db_;
   int num_;
   int value_size_;
@@ -519,10 +623,31 @@ class Benchmark {
 
  public:
   Benchmark()
-      : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
-        filter_policy_(FLAGS_bloom_bits >= 0
-                           ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                           : nullptr),
+      : cache_(FLAGS_cache_size < 0 ? nullptr
+               : strcmp(FLAGS_cache_type, "2q") == 0
+                   ? New2QCache(FLAGS_cache_size, FLAGS_cache_shard_bits)
+               : strcmp(FLAGS_cache_type, "clock") == 0
+                   ? NewClockCache(FLAGS_cache_size, FLAGS_block_size,
+                                   FLAGS_cache_shard_bits)
+                   : NewLRUCache(FLAGS_cache_size, FLAGS_cache_shard_bits,
+                                 0.5)),
+        compressed_cache_(FLAGS_compressed_cache_size < 0
+                              ? nullptr
+                              : NewLRUCache(FLAGS_compressed_cache_size)),
+        persistent_cache_(nullptr),
+        rate_limiter_(FLAGS_rate_limiter_bytes_per_sec > 0
+                          ? NewGenericRateLimiter(
+                                FLAGS_rate_limiter_bytes_per_sec, 100 * 1000,
+                                FLAGS_rate_limiter_auto_tuned)
+                          : nullptr),
+        filter_policy_(FLAGS_fuse_filter ? NewBinaryFuseFilterPolicy()
+                       : FLAGS_bloom_bits < 0 ? nullptr
+                       : FLAGS_blocked_bloom
+                           ? NewBlockedBloomFilterPolicy(FLAGS_bloom_bits)
+                           : NewBloomFilterPolicy(FLAGS_bloom_bits)),
+        prefix_extractor_(FLAGS_prefix_size > 0
+                              ? NewFixedPrefixTransform(FLAGS_prefix_size)
+                              : nullptr),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -541,12 +666,35 @@ class Benchmark {
     if (!FLAGS_use_existing_db) {
       DestroyDB(FLAGS_db, Options());
     }
+    if (FLAGS_persistent_cache_path != nullptr) {
+      if (!FLAGS_use_existing_db) {
+        // The cached blocks belong to the destroyed database.
+        files.clear();
+        g_env->GetChildren(FLAGS_persistent_cache_path, &files);
+        for (size_t i = 0; i < files.size(); i++) {
+          g_env->RemoveFile(std::string(FLAGS_persistent_cache_path) + "/" +
+                            files[i]);
+        }
+      }
+      Status s = NewPersistentCache(g_env, FLAGS_persistent_cache_path,
+                                    FLAGS_persistent_cache_size,
+                                    &persistent_cache_);
+      if (!s.ok()) {
+        std::fprintf(stderr, "open persistent cache error: %s\n",
+                     s.ToString().c_str());
+        std::exit(1);
+      }
+    }
   }
 
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete compressed_cache_;
+    delete persistent_cache_;
+    delete rate_limiter_;
     delete filter_policy_;
+    delete prefix_extractor_;
   }
 
   void Run() {
@@ -580,6 +728,10 @@ class Benchmark {
         method = &Benchmark::OpenBench;
         num_ /= 10000;
         if (num_ < 1) num_ = 1;
+      } else if (name == Slice("recover")) {
+        fresh_db = true;
+        num_threads = 1;
+        method = &Benchmark::RecoverBench;
       } else if (name == Slice("fillseq")) {
         fresh_db = true;
         method = &Benchmark::WriteSeq;
@@ -609,14 +761,25 @@ class Benchmark {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("multireadrandom")) {
+        entries_per_batch_ = FLAGS_multiget_batch_size;
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
         method = &Benchmark::SeekRandom;
       } else if (name == Slice("seekordered")) {
         method = &Benchmark::SeekOrdered;
+      } else if (name == Slice("seekprefix")) {
+        if (FLAGS_prefix_size <= 0) {
+          std::fprintf(stderr, "seekprefix needs --prefix_size\n");
+        } else {
+          method = &Benchmark::SeekPrefix;
+        }
       } else if (name == Slice("readhot")) {
         method = &Benchmark::ReadHot;
+      } else if (name == Slice("scanreadhot")) {
+        method = &Benchmark::ScanReadHot;
       } else if (name == Slice("readrandomsmall")) {
         reads_ /= 1000;
         method = &Benchmark::ReadRandom;
@@ -631,6 +794,10 @@ class Benchmark {
         method = &Benchmark::Compact;
       } else if (name == Slice("crc32c")) {
         method = &Benchmark::Crc32c;
+      } else if (name == Slice("cachelookup")) {
+        method = &Benchmark::CacheLookup;
+      } else if (name == Slice("filterlookup")) {
+        method = &Benchmark::FilterLookup;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
@@ -645,6 +812,8 @@ class Benchmark {
         PrintStats("leveldb.stats");
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
+      } else if (name == Slice("bgstats")) {
+        PrintStats("leveldb.background-stats");
       } else {
         if (!name.empty()) {  // No error message for empty name
           std::fprintf(stderr, "unknown benchmark '%s'\n",
@@ -772,6 +941,72 @@ class Benchmark {
     thread->stats.AddMessage(label);
   }
 
+  static void DeleteNothing(const Slice& key, void* value) {}
+
+  void CacheLookup(ThreadState* thread) {
+    if (cache_ == nullptr) {
+      thread->stats.AddMessage("(no block cache: use --cache_size)");
+      return;
+    }
+    // The hot set is shared by all threads; its four byte keys do not
+    // collide with the keys of the blocks the db caches.
+    const int kHotKeys = 1000;
+    char buffer[sizeof(uint32_t)];
+    for (int k = 0; k < kHotKeys; k++) {
+      EncodeFixed32(buffer, k);
+      cache_->Release(cache_->Insert(Slice(buffer, sizeof(buffer)), nullptr,
+                                     FLAGS_block_size, &DeleteNothing));
+    }
+    thread->stats.Start();
+
+    int found = 0;
+    for (int i = 0; i < reads_; i++) {
+      EncodeFixed32(buffer, thread->rand.Uniform(kHotKeys));
+      Cache::Handle* handle = cache_->Lookup(Slice(buffer, sizeof(buffer)));
+      if (handle != nullptr) {
+        cache_->Release(handle);
+        found++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads_);
+    thread->stats.AddMessage(msg);
+  }
+
+  void FilterLookup(ThreadState* thread) {
+    if (filter_policy_ == nullptr) {
+      thread->stats.AddMessage("(no filter policy: use --bloom_bits)");
+      return;
+    }
+    char buffer[sizeof(uint32_t)];
+    std::vector<std::string> keys;
+    keys.reserve(num_);
+    for (int i = 0; i < num_; i++) {
+      EncodeFixed32(buffer, i);
+      keys.emplace_back(buffer, sizeof(buffer));
+    }
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::string filter;
+    filter_policy_->CreateFilter(key_slices.data(), num_, &filter);
+    thread->stats.Start();
+
+    // Absent keys are the common case for a filter, and with a filter much
+    // larger than the CPU caches the cache lines touched per probe dominate.
+    int64_t matches = 0;
+    for (int i = 0; i < reads_; i++) {
+      EncodeFixed32(buffer, num_ + thread->rand.Uniform(1 << 30));
+      if (filter_policy_->KeyMayMatch(Slice(buffer, sizeof(buffer)), filter)) {
+        matches++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%.2f%% false positives, %zu bytes)",
+                  reads_ > 0 ? matches * 100.0 / reads_ : 0.0, filter.size());
+    thread->stats.AddMessage(msg);
+  }
+
   void SnappyCompress(ThreadState* thread) {
     Compress(thread, "snappy", &port::Snappy_Compress);
   }
@@ -799,21 +1034,43 @@ class Benchmark {
         &port::Zstd_Uncompress);
   }
 
-  void Open() {
+  void Open() { Open(FLAGS_write_buffer_size); }
+
+  void Open(size_t write_buffer_size) {
     assert(db_ == nullptr);
     Options options;
     options.env = g_env;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
-    options.write_buffer_size = FLAGS_write_buffer_size;
+    options.block_cache_compressed = compressed_cache_;
+    options.persistent_cache = persistent_cache_;
+    options.rate_limiter = rate_limiter_;
+    options.cache_index_and_filter_blocks =
+        FLAGS_cache_index_and_filter_blocks;
+    options.pin_l0_filter_and_index_blocks_in_cache =
+        FLAGS_pin_l0_filter_and_index_blocks_in_cache;
+    options.write_buffer_size = write_buffer_size;
+    options.max_write_buffer_number = FLAGS_max_write_buffer_number;
+    options.enable_pipelined_write = FLAGS_enable_pipelined_write;
+    options.allow_concurrent_memtable_write =
+        FLAGS_allow_concurrent_memtable_write;
     options.max_file_size = FLAGS_max_file_size;
+    options.index_partition_size = FLAGS_index_partition_size;
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
     options.block_size = FLAGS_block_size;
     if (FLAGS_comparisons) {
       options.comparator = &count_comparator_;
     }
     options.max_open_files = FLAGS_open_files;
+    options.preload_tables_on_open = FLAGS_preload_tables_on_open;
+    options.compaction_readahead_size = FLAGS_compaction_readahead_size;
+    options.max_background_compactions = FLAGS_max_background_compactions;
     options.filter_policy = filter_policy_;
+    options.prefix_extractor = prefix_extractor_;
+    options.filter_block_type =
+        static_cast<FilterBlockType>(FLAGS_filter_block_type);
     options.reuse_logs = FLAGS_reuse_logs;
+    options.parallel_log_recovery = FLAGS_parallel_log_recovery;
     options.compression =
         FLAGS_compression ? kSnappyCompression : kNoCompression;
     Status s = DB::Open(options, FLAGS_db, &db_);
@@ -831,6 +1088,26 @@ class Benchmark {
     }
   }
 
+  void RecoverBench(ThreadState* thread) {
+    // Write the values with a write buffer that holds them all, so that
+    // they are only in the log, and time the reopening of the db.
+    delete db_;
+    db_ = nullptr;
+    Open(2 * static_cast<size_t>(num_) * (value_size_ + 100));
+    DoWrite(thread, false);
+    thread->stats.Start();
+
+    delete db_;
+    db_ = nullptr;
+    Open();
+    thread->stats.FinishedSingleOp();
+    thread->stats.AddBytes(static_cast<int64_t>(num_) *
+                           (value_size_ + 16 + FLAGS_key_prefix));
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d values)", num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void WriteSeq(ThreadState* thread) { DoWrite(thread, true); }
 
   void WriteRandom(ThreadState* thread) { DoWrite(thread, false); }
@@ -866,7 +1143,9 @@ class Benchmark {
   }
 
   void ReadSequential(ThreadState* thread) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
+    ReadOptions options;
+    options.readahead_size = FLAGS_readahead_size;
+    Iterator* iter = db_->NewIterator(options);
     int i = 0;
     int64_t bytes = 0;
     for (iter->SeekToFirst(); i < reads_ && iter->Valid(); iter->Next()) {
@@ -909,6 +1188,34 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    std::vector<KeyBuffer> key_buffers(entries_per_batch_);
+    std::vector<Slice> keys(entries_per_batch_);
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    int found = 0;
+    for (int i = 0; i < reads_; i += entries_per_batch_) {
+      const int batch = std::min(entries_per_batch_, reads_ - i);
+      keys.resize(batch);
+      for (int j = 0; j < batch; j++) {
+        key_buffers[j].Set(thread->rand.Uniform(FLAGS_num));
+        keys[j] = key_buffers[j].slice();
+      }
+      db_->MultiGet(options, keys, &values, &statuses);
+      for (int j = 0; j < batch; j++) {
+        if (statuses[j].ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found, batch %d)", found,
+                  reads_, entries_per_batch_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -935,6 +1242,37 @@ class Benchmark {
     }
   }
 
+  // Shows how well the cache keeps the blocks of the hot keys while a scan
+  // streams the whole DB through it.
+  void ScanReadHot(ThreadState* thread) {
+    ReadOptions options;
+    std::string value;
+    const int range = (FLAGS_num + 99) / 100;
+    Iterator* scan = db_->NewIterator(options);
+    scan->SeekToFirst();
+    KeyBuffer key;
+    int found = 0;
+    for (int i = 0; i < reads_; i++) {
+      for (int j = 0; j < 10; j++) {
+        if (!scan->Valid()) {
+          scan->SeekToFirst();
+        } else {
+          scan->Next();
+        }
+      }
+      const int k = thread->rand.Uniform(range);
+      key.Set(k);
+      if (db_->Get(options, key.slice(), &value).ok()) {
+        found++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    delete scan;
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads_);
+    thread->stats.AddMessage(msg);
+  }
+
   void SeekRandom(ThreadState* thread) {
     ReadOptions options;
     int found = 0;
@@ -972,6 +1310,28 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void SeekPrefix(ThreadState* thread) {
+    ReadOptions options;
+    options.prefix_same_as_start = true;
+    Iterator* iter = db_->NewIterator(options);
+    int found = 0;
+    KeyBuffer key;
+    for (int i = 0; i < reads_; i++) {
+      const int k = thread->rand.Uniform(FLAGS_num);
+      key.Set(k);
+      Slice prefix(key.slice().data(), FLAGS_prefix_size);
+      for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix);
+           iter->Next()) {
+        found++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    delete iter;
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d keys found)", found);
+    thread->stats.AddMessage(msg);
+  }
+
   void DoDelete(ThreadState* thread, bool seq) {
     RandomGenerator gen;
     WriteBatch batch;
@@ -1065,9 +1425,12 @@ class Benchmark {
 
 int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
+  FLAGS_max_write_buffer_number = leveldb::Options().max_write_buffer_number;
   FLAGS_max_file_size = leveldb::Options().max_file_size;
   FLAGS_block_size = leveldb::Options().block_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
+  FLAGS_max_background_compactions =
+      leveldb::Options().max_background_compactions;
   std::string default_db_path;
 
   for (int i = 1; i < argc; i++) {
@@ -1090,6 +1453,18 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--parallel_log_recovery=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_parallel_log_recovery = n;
+    } else if (sscanf(argv[i], "--enable_pipelined_write=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_enable_pipelined_write = n;
+    } else if (sscanf(argv[i], "--allow_concurrent_memtable_write=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_allow_concurrent_memtable_write = n;
     } else if (sscanf(argv[i], "--compression=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_compression = n;
@@ -1103,20 +1478,89 @@ int main(int argc, char** argv) {
       FLAGS_value_size = n;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
       FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--max_write_buffer_number=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_max_write_buffer_number = n;
     } else if (sscanf(argv[i], "--max_file_size=%d%c", &n, &junk) == 1) {
       FLAGS_max_file_size = n;
+    } else if (sscanf(argv[i], "--index_partition_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_index_partition_size = n;
+    } else if (sscanf(argv[i], "--data_block_hash_index=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_data_block_hash_index = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
       FLAGS_block_size = n;
+    } else if (sscanf(argv[i], "--multiget_batch_size=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_multiget_batch_size = n;
+    } else if (sscanf(argv[i], "--readahead_size=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_readahead_size = n;
+    } else if (sscanf(argv[i], "--compaction_readahead_size=%d%c", &n,
+                      &junk) == 1 &&
+               n >= 0) {
+      FLAGS_compaction_readahead_size = n;
     } else if (sscanf(argv[i], "--key_prefix=%d%c", &n, &junk) == 1) {
       FLAGS_key_prefix = n;
+    } else if (sscanf(argv[i], "--prefix_size=%d%c", &n, &junk) == 1) {
+      FLAGS_prefix_size = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--compressed_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_compressed_cache_size = n;
+    } else if (sscanf(argv[i], "--cache_shard_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_cache_shard_bits = n;
+    } else if (sscanf(argv[i], "--preload_tables_on_open=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_preload_tables_on_open = n;
+    } else if (sscanf(argv[i], "--cache_index_and_filter_blocks=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_cache_index_and_filter_blocks = n;
+    } else if (sscanf(argv[i],
+                      "--pin_l0_filter_and_index_blocks_in_cache=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pin_l0_filter_and_index_blocks_in_cache = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--blocked_bloom=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_blocked_bloom = n;
+    } else if (sscanf(argv[i], "--fuse_filter=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_fuse_filter = n;
+    } else if (sscanf(argv[i], "--filter_block_type=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n <= 2) {
+      FLAGS_filter_block_type = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--max_background_compactions=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_max_background_compactions = n;
+    } else if (strncmp(argv[i], "--cache_type=", 13) == 0 &&
+               (strcmp(argv[i] + 13, "lru") == 0 ||
+                strcmp(argv[i] + 13, "2q") == 0 ||
+                strcmp(argv[i] + 13, "clock") == 0)) {
+      FLAGS_cache_type = argv[i] + 13;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
+    } else if (strncmp(argv[i], "--persistent_cache_path=", 24) == 0) {
+      FLAGS_persistent_cache_path = argv[i] + 24;
+    } else if (sscanf(argv[i], "--persistent_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_persistent_cache_size = n;
+    } else if (sscanf(argv[i], "--rate_limiter_bytes_per_sec=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_rate_limiter_bytes_per_sec = n;
+    } else if (sscanf(argv[i], "--rate_limiter_auto_tuned=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_rate_limiter_auto_tuned = n;
     } else {
       std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
       std::exit(1);
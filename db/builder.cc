@@ -11,9 +11,42 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/rate_limiter.h"
 
 namespace leveldb {
 
+namespace {
+
+class RateLimitedWritableFile : public WritableFile {
+ public:
+  RateLimitedWritableFile(WritableFile* file, RateLimiter* limiter,
+                          Env::Priority pri)
+      : file_(file), limiter_(limiter), pri_(pri) {}
+  ~RateLimitedWritableFile() override { delete file_; }
+
+  Status Append(const Slice& data) override {
+    limiter_->Request(data.size(), pri_);
+    return file_->Append(data);
+  }
+  Status Close() override { return file_->Close(); }
+  Status Flush() override { return file_->Flush(); }
+  Status Sync() override { return file_->Sync(); }
+
+ private:
+  WritableFile* const file_;
+  RateLimiter* const limiter_;
+  const Env::Priority pri_;
+};
+
+}  // namespace
+
+void RateLimitTableFile(const Options& options, Env::Priority pri,
+                        WritableFile** file) {
+  if (options.rate_limiter != nullptr) {
+    *file = new RateLimitedWritableFile(*file, options.rate_limiter, pri);
+  }
+}
+
 // 通过 MemTable(iter) 落地为 sst 文件，并输出 meta 信息（如 file_size、最小key、最大key）
 // 文件按 meta->number 命名
 // 若 iter 为空，则 meta->file_size 置0，且不生成 sst 文件
@@ -31,6 +64,7 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     if (!s.ok()) {
       return s;
     }
+    RateLimitTableFile(options, Env::HIGH, &file);
 
     // 创建一个TableBuilder
     TableBuilder* builder = new TableBuilder(options, file);
@@ -66,9 +100,10 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     file = nullptr;
 
     if (s.ok()) {
-      // Verify that the table is usable
+      // Verify that the table is usable.  New tables usually go to level
+      // 0 (see Version::PickLevelForMemTableOutput()).
       Iterator* it = table_cache->NewIterator(ReadOptions(), meta->number,
-                                              meta->file_size);
+                                              meta->file_size, 0);
       s = it->status();
       delete it;
     }
@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_BUILDER_H_
 #define STORAGE_LEVELDB_DB_BUILDER_H_
 
+#include "leveldb/env.h"
 #include "leveldb/status.h"
 
 namespace leveldb {
@@ -12,7 +13,6 @@ namespace leveldb {
 struct Options;
 struct FileMetaData;
 
-class Env;
 class Iterator;
 class TableCache;
 class VersionEdit;
@@ -23,6 +23,13 @@ class VersionEdit;
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
                   TableCache* table_cache, Iterator* iter, FileMetaData* meta);
 
+// If options.rate_limiter is set, replace *file, a new table file, with a
+// file that requests the bytes of every append from the limiter at
+// priority "pri" before passing it on to the original file.  The new file
+// owns the original one.
+void RateLimitTableFile(const Options& options, Env::Priority pri,
+                        WritableFile** file);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_BUILDER_H_
@@ -8,6 +8,7 @@
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
 #include <set>
 #include <string>
 #include <vector>
@@ -24,6 +25,7 @@
 #include "db/write_batch_internal.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/rate_limiter.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
@@ -39,15 +41,39 @@ namespace leveldb {
 
 const int kNumNonTableCacheFiles = 10;
 
+// Number of threads that open tables in DBImpl::PreloadTables()
+static const int kNumTablePreloadThreads = 16;
+
+// While a flush of imm_ is scheduled, compactions check whether they have
+// to run it themselves once per this many keys.
+static const uint32_t kFlushCheckPeriod = 1024;
+
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr),
+        sync(false),
+        done(false),
+        last_sequence(0),
+        insert_into(nullptr),
+        leader(nullptr),
+        pending_inserts(0),
+        cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+  SequenceNumber last_sequence;  // Last sequence of the group this one leads
+  std::vector<Writer*> group;    // The group this one leads
+
+  // Concurrent memtable inserts: a follower inserts its own batch into
+  // *insert_into when it is set, then reports to *leader, which waits for
+  // pending_inserts to drop to zero.
+  MemTable* insert_into;
+  Writer* leader;
+  int pending_inserts;
+
   port::CondVar cv;
 };
 
@@ -94,14 +120,23 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalKeySliceTransform* iprefix,
                         const Options& src) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
+  result.prefix_extractor =
+      (src.prefix_extractor != nullptr) ? iprefix : nullptr;
+  if (src.comparator != BytewiseComparator()) {
+    // The hash index finds user keys by their bytes.
+    result.data_block_hash_index = false;
+  }
   ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
+  ClipToRange(&result.max_write_buffer_number, 2, 64);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.max_background_compactions, 1, 64);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -127,8 +162,10 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
       internal_filter_policy_(raw_options.filter_policy),
+      internal_prefix_extractor_(raw_options.prefix_extractor),
       options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+                               &internal_filter_policy_,
+                               &internal_prefix_extractor_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
@@ -137,25 +174,40 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       shutting_down_(false),
       background_work_finished_signal_(&mutex_),
       mem_(nullptr),
-      imm_(nullptr),
       has_imm_(false),
       logfile_(nullptr),
       logfile_number_(0),
       log_(nullptr),
       seed_(0),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      background_flush_scheduled_(false),
+      background_compactions_scheduled_(0),
+      compactions_in_progress_(0),
+      imm_compaction_running_(false),
+      manifest_write_in_progress_(false),
+      manifest_write_finished_signal_(&mutex_),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)),
+      reported_pending_compaction_bytes_(0) {
+  if (env_->GetBackgroundThreads(Env::LOW) <
+      options_.max_background_compactions) {
+    env_->SetBackgroundThreads(options_.max_background_compactions, Env::LOW);
+  }
+}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0 ||
+         background_flush_scheduled_.load(std::memory_order_relaxed)) {
     background_work_finished_signal_.Wait();
   }
+  if (options_.rate_limiter != nullptr) {
+    options_.rate_limiter->AddPendingCompactionBytes(
+        -reported_pending_compaction_bytes_);
+  }
   mutex_.Unlock();
 
   if (db_lock_ != nullptr) {
@@ -164,7 +216,9 @@ DBImpl::~DBImpl() {
 
   delete versions_;
   if (mem_ != nullptr) mem_->Unref();
-  if (imm_ != nullptr) imm_->Unref();
+  for (size_t i = 0; i < imm_.size(); i++) {
+    imm_[i].mem->Unref();
+  }
   delete tmp_batch_;
   delete log_;
   delete logfile_;
@@ -362,17 +416,24 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
 
   // Recover in the order in which the logs were generated
   std::sort(logs.begin(), logs.end());
-  for (size_t i = 0; i < logs.size(); i++) {
-    s = RecoverLogFile(logs[i], (i == logs.size() - 1), save_manifest, edit,
-                       &max_sequence);
+  if (options_.parallel_log_recovery && !logs.empty()) {
+    s = RecoverLogFilesInParallel(logs, save_manifest, edit, &max_sequence);
     if (!s.ok()) {
       return s;
     }
+  } else {
+    for (size_t i = 0; i < logs.size(); i++) {
+      s = RecoverLogFile(logs[i], (i == logs.size() - 1), save_manifest,
+                         edit, &max_sequence);
+      if (!s.ok()) {
+        return s;
+      }
 
-    // The previous incarnation may not have written any MANIFEST
-    // records after allocating this log number.  So we manually
-    // update the file number allocation counter in VersionSet.
-    versions_->MarkFileNumberUsed(logs[i]);
+      // The previous incarnation may not have written any MANIFEST
+      // records after allocating this log number.  So we manually
+      // update the file number allocation counter in VersionSet.
+      versions_->MarkFileNumberUsed(logs[i]);
+    }
   }
 
   if (versions_->LastSequence() < max_sequence) {
@@ -382,22 +443,27 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   return Status::OK();
 }
 
+namespace {
+
+// Reports the corruptions found while reading a log during recovery.
+struct LogReporter : public log::Reader::Reporter {
+  Env* env;
+  Logger* info_log;
+  const char* fname;
+  Status* status;  // null if options_.paranoid_checks==false
+  void Corruption(size_t bytes, const Status& s) override {
+    Log(info_log, "%s%s: dropping %d bytes; %s",
+        (this->status == nullptr ? "(ignoring error) " : ""), fname,
+        static_cast<int>(bytes), s.ToString().c_str());
+    if (this->status != nullptr && this->status->ok()) *this->status = s;
+  }
+};
+
+}  // namespace
+
 Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
                               bool* save_manifest, VersionEdit* edit,
                               SequenceNumber* max_sequence) {
-  struct LogReporter : public log::Reader::Reporter {
-    Env* env;
-    Logger* info_log;
-    const char* fname;
-    Status* status;  // null if options_.paranoid_checks==false
-    void Corruption(size_t bytes, const Status& s) override {
-      Log(info_log, "%s%s: dropping %d bytes; %s",
-          (this->status == nullptr ? "(ignoring error) " : ""), fname,
-          static_cast<int>(bytes), s.ToString().c_str());
-      if (this->status != nullptr && this->status->ok()) *this->status = s;
-    }
-  };
-
   mutex_.AssertHeld();
 
   // Open the log file
@@ -452,27 +518,50 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
       *max_sequence = last_seq;
     }
 
-    if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
-      compactions++;
-      *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
-      mem->Unref();
-      mem = nullptr;
-      if (!status.ok()) {
-        // Reflect errors immediately so that conditions like full
-        // file-systems cause the DB::Open() to fail.
-        break;
-      }
+    status = MaybeFlushRecoveredMemTable(&mem, &compactions, save_manifest,
+                                         edit);
+    if (!status.ok()) {
+      break;
     }
   }
 
   delete file;
 
+  return FinishRecoveredLog(log_number, last_log, compactions, mem, status,
+                            save_manifest, edit);
+}
+
+Status DBImpl::MaybeFlushRecoveredMemTable(MemTable** mem, int* compactions,
+                                           bool* save_manifest,
+                                           VersionEdit* edit) {
+  mutex_.AssertHeld();
+  if ((*mem)->ApproximateMemoryUsage() <= options_.write_buffer_size) {
+    return Status::OK();
+  }
+  (*compactions)++;
+  *save_manifest = true;
+  uint64_t file_number;
+  Status status = WriteLevel0Table({*mem}, edit, nullptr, &file_number);
+  pending_outputs_.erase(file_number);
+  (*mem)->Unref();
+  *mem = nullptr;
+  // Errors are reflected immediately so that conditions like full
+  // file-systems cause the DB::Open() to fail.
+  return status;
+}
+
+Status DBImpl::FinishRecoveredLog(uint64_t log_number, bool last_log,
+                                  int compactions, MemTable* mem,
+                                  Status status, bool* save_manifest,
+                                  VersionEdit* edit) {
+  mutex_.AssertHeld();
+
   // See if we should keep reusing the last log file.
   if (status.ok() && options_.reuse_logs && last_log && compactions == 0) {
     assert(logfile_ == nullptr);
     assert(log_ == nullptr);
     assert(mem_ == nullptr);
+    std::string fname = LogFileName(dbname_, log_number);
     uint64_t lfile_size;
     if (env_->GetFileSize(fname, &lfile_size).ok() &&
         env_->NewAppendableFile(fname, &logfile_).ok()) {
@@ -494,7 +583,9 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     // mem did not get reused; compact it.
     if (status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      uint64_t file_number;
+      status = WriteLevel0Table({mem}, edit, nullptr, &file_number);
+      pending_outputs_.erase(file_number);
     }
     mem->Unref();
   }
@@ -502,18 +593,338 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   return status;
 }
 
-Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+namespace {
+
+// Bytes of log records that DBImpl::RecoverLogFilesInParallel() reads
+// ahead of the memtable insertions, and passes from stage to stage at once.
+static const size_t kMaxRecoveryBufferBytes = 16 << 20;
+static const size_t kRecoveryChunkBytes = 1 << 20;
+
+// Consecutive records of a log on their way through the stages of
+// DBImpl::RecoverLogFilesInParallel().
+struct RecoveredChunk {
+  // An update of a batch, pointing into "data".
+  struct Entry {
+    ValueType type;
+    Slice key;
+    Slice value;
+  };
+
+  // A batch read from the log.
+  struct Record {
+    Record(size_t offset, size_t size)
+        : offset(offset), size(size), first_entry(0), end_entry(0) {}
+
+    size_t offset;  // Contents in data[offset, offset + size - 1]
+    size_t size;
+    // Filled in by the decoder.
+    size_t first_entry;  // Updates in entries[first_entry, end_entry - 1]
+    size_t end_entry;
+    Status status;  // Error in the batch
+  };
+
+  explicit RecoveredChunk(size_t log_index)
+      : log_index(log_index), end_of_log(false), log_opened(true) {}
+
+  const size_t log_index;  // Index of the log that the records come from
+  // If true, the chunk holds the last records of the log, and "status" is
+  // the outcome of reading it.
+  bool end_of_log;
+  bool log_opened;  // False if the log could not be opened
+  Status status;
+  std::string data;  // Contents of the batches, one after another
+  std::vector<Record> records;
+  std::vector<Entry> entries;  // Filled in by the decoder
+};
+
+// Collects the updates of a batch into RecoveredChunk::entries.
+class RecoveredEntryCollector : public WriteBatch::Handler {
+ public:
+  explicit RecoveredEntryCollector(std::vector<RecoveredChunk::Entry>* entries)
+      : entries_(entries) {}
+
+  void Put(const Slice& key, const Slice& value) override {
+    entries_->push_back({kTypeValue, key, value});
+  }
+  void Delete(const Slice& key) override {
+    entries_->push_back({kTypeDeletion, key, Slice()});
+  }
+
+ private:
+  std::vector<RecoveredChunk::Entry>* const entries_;
+};
+
+// Queues of chunks between the stages of
+// DBImpl::RecoverLogFilesInParallel(), shared by its threads.
+struct LogRecoveryState {
+  LogRecoveryState(Env* env, const std::string& dbname, const Options& options,
+                   const std::vector<uint64_t>& logs)
+      : env(env),
+        dbname(dbname),
+        options(options),
+        logs(logs),
+        cv(&mu),
+        buffered_bytes(0),
+        reading_done(false),
+        decoding_done(false),
+        stop(false),
+        running(0) {}
+
+  Env* const env;
+  const std::string& dbname;
+  const Options& options;
+  const std::vector<uint64_t>& logs;
+
+  port::Mutex mu;
+  port::CondVar cv;
+  std::deque<RecoveredChunk*> read GUARDED_BY(mu);     // Not decoded yet
+  std::deque<RecoveredChunk*> decoded GUARDED_BY(mu);  // Not inserted yet
+  size_t buffered_bytes GUARDED_BY(mu);  // Size of the queued chunks
+  bool reading_done GUARDED_BY(mu);
+  bool decoding_done GUARDED_BY(mu);
+  bool stop GUARDED_BY(mu);   // Set when the recovery gives up
+  int running GUARDED_BY(mu);  // Number of threads that have not finished
+};
+
+// Queues "chunk" for the decoder, once there is room for it.  Returns
+// false, and deletes the chunk, if the recovery has given up.
+static bool QueueReadChunk(LogRecoveryState* state, RecoveredChunk* chunk) {
+  MutexLock l(&state->mu);
+  while (!state->stop && state->buffered_bytes >= kMaxRecoveryBufferBytes) {
+    state->cv.Wait();
+  }
+  if (state->stop) {
+    delete chunk;
+    return false;
+  }
+  state->read.push_back(chunk);
+  state->buffered_bytes += chunk->data.size();
+  state->cv.SignalAll();
+  return true;
+}
+
+// First stage: reads the records of the logs in turn, checking their
+// checksums, and queues them for the decoder in chunks.
+static void ReadLogsThread(void* arg) {
+  LogRecoveryState* state = reinterpret_cast<LogRecoveryState*>(arg);
+  const Options& options = state->options;
+  for (size_t i = 0; i < state->logs.size(); i++) {
+    RecoveredChunk* chunk = new RecoveredChunk(i);
+
+    std::string fname = LogFileName(state->dbname, state->logs[i]);
+    SequentialFile* file;
+    Status status = state->env->NewSequentialFile(fname, &file);
+    if (!status.ok()) {
+      chunk->end_of_log = true;
+      chunk->log_opened = false;
+      chunk->status = status;
+      if (!QueueReadChunk(state, chunk)) {
+        break;
+      }
+      continue;
+    }
+
+    LogReporter reporter;
+    reporter.env = state->env;
+    reporter.info_log = options.info_log;
+    reporter.fname = fname.c_str();
+    reporter.status = (options.paranoid_checks ? &status : nullptr);
+    log::Reader reader(file, &reporter, true /*checksum*/,
+                       0 /*initial_offset*/);
+    Log(options.info_log, "Recovering log #%llu",
+        (unsigned long long)state->logs[i]);
+
+    std::string scratch;
+    Slice record;
+    while (chunk != nullptr && reader.ReadRecord(&record, &scratch) &&
+           status.ok()) {
+      if (record.size() < 12) {
+        reporter.Corruption(record.size(),
+                            Status::Corruption("log record too small"));
+        continue;
+      }
+      chunk->records.emplace_back(chunk->data.size(), record.size());
+      chunk->data.append(record.data(), record.size());
+      if (chunk->data.size() >= kRecoveryChunkBytes) {
+        chunk = QueueReadChunk(state, chunk) ? new RecoveredChunk(i) : nullptr;
+      }
+    }
+    delete file;
+
+    if (chunk == nullptr) {
+      break;  // The recovery gave up
+    }
+    chunk->end_of_log = true;
+    chunk->status = status;
+    if (!QueueReadChunk(state, chunk)) {
+      break;
+    }
+  }
+
+  MutexLock l(&state->mu);
+  state->reading_done = true;
+  state->running--;
+  state->cv.SignalAll();
+}
+
+// Second stage: decodes the batches read by ReadLogsThread() into their
+// updates, and queues them for the opening thread in the same order.
+static void DecodeBatchesThread(void* arg) {
+  LogRecoveryState* state = reinterpret_cast<LogRecoveryState*>(arg);
+  MutexLock l(&state->mu);
+  while (true) {
+    while (!state->stop && state->read.empty() && !state->reading_done) {
+      state->cv.Wait();
+    }
+    if (state->stop || state->read.empty()) {
+      break;
+    }
+    RecoveredChunk* chunk = state->read.front();
+    state->read.pop_front();
+    state->mu.Unlock();
+
+    RecoveredEntryCollector collector(&chunk->entries);
+    for (RecoveredChunk::Record& record : chunk->records) {
+      record.first_entry = chunk->entries.size();
+      record.status = WriteBatchInternal::Iterate(
+          Slice(chunk->data.data() + record.offset, record.size), &collector);
+      record.end_entry = chunk->entries.size();
+    }
+
+    state->mu.Lock();
+    state->decoded.push_back(chunk);
+    state->cv.SignalAll();
+  }
+  state->decoding_done = true;
+  state->running--;
+  state->cv.SignalAll();
+}
+
+}  // namespace
+
+Status DBImpl::RecoverLogFilesInParallel(const std::vector<uint64_t>& logs,
+                                         bool* save_manifest,
+                                         VersionEdit* edit,
+                                         SequenceNumber* max_sequence) {
+  mutex_.AssertHeld();
+  LogRecoveryState state(env_, dbname_, options_, logs);
+  state.mu.Lock();
+  state.running = 2;
+  state.mu.Unlock();
+  env_->StartThread(&ReadLogsThread, &state);
+  env_->StartThread(&DecodeBatchesThread, &state);
+
+  // Third stage: insert the decoded batches into memtables, and write
+  // those out, as RecoverLogFile() does.
+  Status status;
+  int compactions = 0;
+  MemTable* mem = nullptr;
+  while (status.ok()) {
+    state.mu.Lock();
+    while (state.decoded.empty() && !state.decoding_done) {
+      state.cv.Wait();
+    }
+    if (state.decoded.empty()) {
+      state.mu.Unlock();
+      break;
+    }
+    RecoveredChunk* chunk = state.decoded.front();
+    state.decoded.pop_front();
+    state.buffered_bytes -= chunk->data.size();
+    state.cv.SignalAll();
+    state.mu.Unlock();
+
+    const size_t i = chunk->log_index;
+    for (const RecoveredChunk::Record& record : chunk->records) {
+      if (mem == nullptr) {
+        mem = new MemTable(internal_comparator_);
+        mem->Ref();
+      }
+      const char* contents = chunk->data.data() + record.offset;
+      const SequenceNumber first_seq = DecodeFixed64(contents);
+      SequenceNumber sequence = first_seq;
+      for (size_t j = record.first_entry; j < record.end_entry; j++) {
+        const RecoveredChunk::Entry& entry = chunk->entries[j];
+        mem->Add(sequence++, entry.type, entry.key, entry.value);
+      }
+      status = record.status;
+      MaybeIgnoreError(&status);
+      if (status.ok()) {
+        const SequenceNumber last_seq =
+            first_seq + DecodeFixed32(contents + 8) - 1;
+        if (last_seq > *max_sequence) {
+          *max_sequence = last_seq;
+        }
+        status = MaybeFlushRecoveredMemTable(&mem, &compactions,
+                                             save_manifest, edit);
+      }
+      if (!status.ok()) {
+        status = FinishRecoveredLog(logs[i], false, compactions, mem, status,
+                                    save_manifest, edit);
+        mem = nullptr;
+        break;
+      }
+    }
+
+    if (status.ok() && chunk->end_of_log) {
+      if (!chunk->log_opened) {
+        status = chunk->status;
+        MaybeIgnoreError(&status);
+      } else {
+        status = FinishRecoveredLog(logs[i], i == logs.size() - 1, compactions,
+                                    mem, chunk->status, save_manifest, edit);
+      }
+      compactions = 0;
+      mem = nullptr;
+      if (status.ok()) {
+        // See Recover().
+        versions_->MarkFileNumberUsed(logs[i]);
+      }
+    }
+    delete chunk;
+  }
+  assert(mem == nullptr);
+
+  // Stop the other stages, and drop what they have queued.
+  state.mu.Lock();
+  state.stop = true;
+  state.cv.SignalAll();
+  while (state.running > 0) {
+    state.cv.Wait();
+  }
+  for (RecoveredChunk* chunk : state.read) {
+    delete chunk;
+  }
+  for (RecoveredChunk* chunk : state.decoded) {
+    delete chunk;
+  }
+  state.mu.Unlock();
+  return status;
+}
+
+Status DBImpl::WriteLevel0Table(const std::vector<MemTable*>& mems,
+                                VersionEdit* edit, Version* base,
+                                uint64_t* file_number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
+  *file_number = meta.number;
 
   pending_outputs_.insert(meta.number);
-  Iterator* iter = mem->NewIterator();
-  Log(options_.info_log, "Level-0 table #%llu: started",
-      (unsigned long long)meta.number);
+  Iterator* iter;
+  if (mems.size() == 1) {
+    iter = mems[0]->NewIterator();
+  } else {
+    std::vector<Iterator*> list;
+    for (size_t i = 0; i < mems.size(); i++) {
+      list.push_back(mems[i]->NewIterator());
+    }
+    iter = NewMergingIterator(&internal_comparator_, &list[0], list.size());
+  }
+  Log(options_.info_log, "Level-0 table #%llu: started from %d memtables",
+      (unsigned long long)meta.number, static_cast<int>(mems.size()));
 
   Status s;
   {
@@ -526,7 +937,6 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
 
   // 注意：若 file_size 为0，则该文件已被删除，不应加到manifest
   int level = 0;
@@ -534,7 +944,15 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
     const Slice min_user_key = meta.smallest.user_key();
     const Slice max_user_key = meta.largest.user_key();
     if (base != nullptr) {
-      level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+      // Compactions on other background threads may have installed newer
+      // versions while the table was being built.
+      level = versions_->current()->PickLevelForMemTableOutput(min_user_key,
+                                                               max_user_key);
+    }
+    if (level > 0 && options_.pin_l0_filter_and_index_blocks_in_cache) {
+      // BuildTable() opened the table as a level 0 one, with its index and
+      // filter blocks pinned in the block cache.
+      table_cache_->Evict(meta.number);
     }
     edit->AddFile(level, meta.number, meta.file_size, meta.smallest, meta.largest);
   }
@@ -548,37 +966,83 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
-  assert(imm_ != nullptr);
-
-  // Save the contents of the memtable as a new Table
+  assert(!imm_.empty());
+  assert(!imm_compaction_running_);
+  imm_compaction_running_ = true;
+
+  // Merge every memtable queued so far into a single new Table.  Writers
+  // may queue more while the lock is released; those are left for the
+  // next flush.
+  const size_t num_flushed = imm_.size();
+  std::vector<MemTable*> mems;
+  for (size_t i = 0; i < num_flushed; i++) {
+    mems.push_back(imm_[i].mem);
+  }
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  uint64_t file_number;
+  Status s = WriteLevel0Table(mems, &edit, base, &file_number);
   base->Unref();
+  // Keep compactions and other flushes out of the range of the new table
+  // until it is installed, as LogAndApply() releases mutex_.
+  versions_->AddOutputRanges(edit);
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
     s = Status::IOError("Deleting DB during memtable compaction");
   }
 
-  // Replace immutable memtable with the generated Table
+  // Replace the flushed memtables with the generated Table
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
-    edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    // Logs older than the oldest memtable still in memory are no longer needed
+    edit.SetLogNumber(num_flushed < imm_.size() ? imm_[num_flushed].log_number
+                                                : logfile_number_);
+    s = LogAndApply(&edit);
   }
+  versions_->RemoveOutputRanges(edit);
+  pending_outputs_.erase(file_number);
+  imm_compaction_running_ = false;
 
   if (s.ok()) {
     // Commit to the new state
-    imm_->Unref();
-    imm_ = nullptr;
-    has_imm_.store(false, std::memory_order_release);
+    for (size_t i = 0; i < num_flushed; i++) {
+      imm_.front().mem->Unref();
+      imm_.pop_front();
+    }
+    has_imm_.store(!imm_.empty(), std::memory_order_release);
     RemoveObsoleteFiles();
   } else {
     RecordBackgroundError(s);
   }
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  while (manifest_write_in_progress_) {
+    manifest_write_finished_signal_.Wait();
+  }
+  manifest_write_in_progress_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  manifest_write_in_progress_ = false;
+  manifest_write_finished_signal_.Signal();
+  if (s.ok()) {
+    UpdatePendingCompactionBytes();
+  }
+  return s;
+}
+
+void DBImpl::UpdatePendingCompactionBytes() {
+  mutex_.AssertHeld();
+  if (options_.rate_limiter == nullptr) {
+    return;
+  }
+  const int64_t bytes = versions_->EstimatedPendingCompactionBytes();
+  options_.rate_limiter->AddPendingCompactionBytes(
+      bytes - reported_pending_compaction_bytes_);
+  reported_pending_compaction_bytes_ = bytes;
+}
+
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   int max_level_with_files = 1;
   {
@@ -641,10 +1105,10 @@ Status DBImpl::TEST_CompactMemTable() {
   if (s.ok()) {
     // Wait until the compaction completes
     MutexLock l(&mutex_);
-    while (imm_ != nullptr && bg_error_.ok()) {
+    while (!imm_.empty() && bg_error_.ok()) {
       background_work_finished_signal_.Wait();
     }
-    if (imm_ != nullptr) {
+    if (!imm_.empty()) {
       s = bg_error_;
     }
   }
@@ -661,49 +1125,96 @@ void DBImpl::RecordBackgroundError(const Status& s) {
 
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.load(std::memory_order_acquire)) {
+  if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
-    // No work to be done
   } else {
-    background_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);  // 在后台线程中跑BGWork/BackgroundCall
+    // Memtable flushes get their own high priority thread so that writers
+    // waiting on imm_ are not stuck behind a long level compaction.
+    if (!imm_.empty() &&
+        !background_flush_scheduled_.load(std::memory_order_relaxed)) {
+      background_flush_scheduled_.store(true, std::memory_order_relaxed);
+      env_->Schedule(&DBImpl::BGFlushWork, this, Env::HIGH);
+    }
+
+    if (background_compactions_scheduled_ >=
+        options_.max_background_compactions) {
+      // Already scheduled as many as allowed
+    } else if (manual_compaction_ == nullptr &&
+               !versions_->NeedsCompaction()) {
+      // No work to be done
+    } else {
+      background_compactions_scheduled_++;
+      env_->Schedule(&DBImpl::BGWork, this, Env::LOW);  // 在后台线程中跑BGWork/BackgroundCall
+    }
   }
 }
 
+void DBImpl::BGFlushWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_.load(std::memory_order_relaxed));
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (!imm_.empty() && !imm_compaction_running_) {
+    CompactMemTable();
+  }
+
+  background_flush_scheduled_.store(false, std::memory_order_relaxed);
+
+  // The new level-0 file may call for a compaction, and writers may have
+  // queued more memtables while this one was being flushed.
+  MaybeScheduleCompaction();
+  background_work_finished_signal_.SignalAll();
+}
+
 void DBImpl::BGWork(void* db) {
   reinterpret_cast<DBImpl*>(db)->BackgroundCall();
 }
 
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
+  bool did_work = false;
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    did_work = BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // 先前的压缩可能在一个级别中生成了太多文件，因此如果需要，重新安排另一次压缩
-  MaybeScheduleCompaction();
+  // A call that found nothing to do was blocked by work still running on
+  // other threads, which will reschedule when it finishes.
+  if (did_work || background_compactions_scheduled_ == 0) {
+    MaybeScheduleCompaction();
+  }
   background_work_finished_signal_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != nullptr) {
-    CompactMemTable();
-    return;
+  while (manual_compaction_ != nullptr && compactions_in_progress_ == 0 &&
+         imm_compaction_running_) {
+    // A flush in progress keeps compactions out of the range of its
+    // table, so versions_->CompactRange() could return nullptr as if the
+    // manual compaction were done.
+    background_work_finished_signal_.Wait();
+  }
+  if (manual_compaction_ != nullptr && compactions_in_progress_ > 0) {
+    // Manual compactions run alone; the ones still in progress will
+    // reschedule when they finish.
+    return false;
   }
 
   Compaction* c;
@@ -723,6 +1234,18 @@ void DBImpl::BackgroundCompaction() {
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
   } else {
     c = versions_->PickCompaction();
+    if (c == nullptr) {
+      return false;
+    }
+  }
+
+  if (c != nullptr) {
+    compactions_in_progress_++;
+    if (!is_manual) {
+      // Let another background thread look for a compaction that does not
+      // overlap this one.
+      MaybeScheduleCompaction();
+    }
   }
 
   Status status;
@@ -734,9 +1257,14 @@ void DBImpl::BackgroundCompaction() {
     // 只需在逻辑层面处理：VersionEdit在level中删除目标文件，level+1中增加目标文件
     c->edit()->RemoveFile(c->level(), f->number);
     c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest, f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    status = LogAndApply(c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
+    } else if (c->level() == 0 &&
+               options_.pin_l0_filter_and_index_blocks_in_cache) {
+      // The table was opened as a level 0 one, with its index and filter
+      // blocks pinned in the block cache.
+      table_cache_->Evict(f->number);
     }
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
@@ -753,7 +1281,10 @@ void DBImpl::BackgroundCompaction() {
     c->ReleaseInputs();
     RemoveObsoleteFiles();
   }
-  delete c;
+  if (c != nullptr) {
+    delete c;
+    compactions_in_progress_--;
+  }
 
   if (status.ok()) {
     // Done
@@ -776,6 +1307,7 @@ void DBImpl::BackgroundCompaction() {
     }
     manual_compaction_ = nullptr;
   }
+  return true;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -813,8 +1345,11 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
 
   // Make the output file
   std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname, &compact->outfile);
+  Status s = options_.use_direct_io_for_compaction
+                 ? env_->NewDirectWritableFile(fname, &compact->outfile)
+                 : env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
+    RateLimitTableFile(options_, Env::LOW, &compact->outfile);
     compact->builder = new TableBuilder(options_, compact->outfile);
   }
   return s;
@@ -856,7 +1391,8 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   if (s.ok() && current_entries > 0) {
     // Verify that the table is usable
     Iterator* iter =
-        table_cache_->NewIterator(ReadOptions(), output_number, current_bytes);
+        table_cache_->NewIterator(ReadOptions(), output_number, current_bytes,
+                                  compact->compaction->level() + 1);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -884,12 +1420,13 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
     compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
                                          out.smallest, out.largest);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return LogAndApply(compact->compaction->edit());
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
   int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
+  uint32_t keys_since_flush_check = 0;
 
   Log(options_.info_log, "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0), compact->compaction->level(),
@@ -917,11 +1454,18 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
-    // Prioritize immutable compaction work
-    if (has_imm_.load(std::memory_order_relaxed)) {
+    // Prioritize immutable compaction work.  imm_ is normally flushed by
+    // BackgroundFlushCall(), but an Env may run every priority on a single
+    // thread, in which case that call is queued behind this compaction.
+    // Once a flush is scheduled, only look every kFlushCheckPeriod keys
+    // whether it is left to this thread, so as not to contend for mutex_
+    // with the writers while the flush runs.
+    if (has_imm_.load(std::memory_order_relaxed) &&
+        (!background_flush_scheduled_.load(std::memory_order_relaxed) ||
+         ++keys_since_flush_check % kFlushCheckPeriod == 0)) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != nullptr) {
+      if (!imm_.empty() && !imm_compaction_running_) {
         CompactMemTable();
         // Wake up MakeRoomForWrite() if necessary.
         background_work_finished_signal_.SignalAll();
@@ -1054,24 +1598,48 @@ struct IterState {
   port::Mutex* const mu;
   Version* const version GUARDED_BY(mu);
   MemTable* const mem GUARDED_BY(mu);
-  MemTable* const imm GUARDED_BY(mu);
+  std::vector<MemTable*> imms GUARDED_BY(mu);
 
-  IterState(port::Mutex* mutex, MemTable* mem, MemTable* imm, Version* version)
-      : mu(mutex), version(version), mem(mem), imm(imm) {}
+  IterState(port::Mutex* mutex, MemTable* mem, Version* version)
+      : mu(mutex), version(version), mem(mem) {}
 };
 
 static void CleanupIteratorState(void* arg1, void* arg2) {
   IterState* state = reinterpret_cast<IterState*>(arg1);
   state->mu->Lock();
   state->mem->Unref();
-  if (state->imm != nullptr) state->imm->Unref();
+  for (size_t i = 0; i < state->imms.size(); i++) {
+    state->imms[i]->Unref();
+  }
   state->version->Unref();
   state->mu->Unlock();
   delete state;
 }
 
+// Look up "key" in "mems", which are ordered newest first.
+static bool GetFromMemTables(const std::vector<MemTable*>& mems,
+                             const LookupKey& key, std::string* value,
+                             Status* s) {
+  for (size_t i = 0; i < mems.size(); i++) {
+    if (mems[i]->Get(key, value, s)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 }  // anonymous namespace
 
+void DBImpl::RefImmutableMemTables(std::vector<MemTable*>* imms) {
+  mutex_.AssertHeld();
+  imms->clear();
+  for (size_t i = imm_.size(); i > 0; i--) {
+    MemTable* imm = imm_[i - 1].mem;
+    imm->Ref();
+    imms->push_back(imm);
+  }
+}
+
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
                                       uint32_t* seed) {
@@ -1080,18 +1648,18 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
 
   // Collect together all needed child iterators
   std::vector<Iterator*> list;
+  IterState* cleanup = new IterState(&mutex_, mem_, versions_->current());
   list.push_back(mem_->NewIterator());
   mem_->Ref();
-  if (imm_ != nullptr) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+  RefImmutableMemTables(&cleanup->imms);
+  for (size_t i = 0; i < cleanup->imms.size(); i++) {
+    list.push_back(cleanup->imms[i]->NewIterator());
   }
   versions_->current()->AddIterators(options, &list);
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
   versions_->current()->Ref();
 
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
 
   *seed = ++seed_;
@@ -1126,10 +1694,10 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
   }
 
   MemTable* mem = mem_;
-  MemTable* imm = imm_;
+  std::vector<MemTable*> imms;
   Version* current = versions_->current();
   mem->Ref();
-  if (imm != nullptr) imm->Ref();
+  RefImmutableMemTables(&imms);
   current->Ref();
 
   bool have_stat_update = false;
@@ -1142,7 +1710,7 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
     LookupKey lkey(key, snapshot);
     if (mem->Get(lkey, value, &s)) {  // 先查 memtable
       // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {  // 再查 immutable memtable (若存在)
+    } else if (GetFromMemTables(imms, lkey, value, &s)) {  // 再查 immutable memtable (从新到旧)
       // Done
     } else {
       s = current->Get(options, lkey, value, &stats);  // 最后查文件
@@ -1155,11 +1723,100 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
     MaybeScheduleCompaction();
   }
   mem->Unref();
-  if (imm != nullptr) imm->Unref();
+  for (size_t i = 0; i < imms.size(); i++) {
+    imms[i]->Unref();
+  }
   current->Unref();
   return s;
 }
 
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  const size_t n = keys.size();
+  values->resize(n);
+  statuses->assign(n, Status::OK());
+  if (n == 0) {
+    return;
+  }
+
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = mem_;
+  std::vector<MemTable*> imms;
+  Version* current = versions_->current();
+  mem->Ref();
+  RefImmutableMemTables(&imms);
+  current->Ref();
+
+  bool have_stat_update = false;
+  std::vector<Version::GetStats> stats;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+
+    std::vector<LookupKey*> lkeys(n);
+    std::vector<const LookupKey*> file_keys;
+    std::vector<std::string*> file_values;
+    std::vector<size_t> file_index;
+    for (size_t i = 0; i < n; i++) {
+      lkeys[i] = new LookupKey(keys[i], snapshot);
+      std::string* value = &(*values)[i];
+      Status* s = &(*statuses)[i];
+      if (mem->Get(*lkeys[i], value, s)) {
+        // Done
+      } else if (GetFromMemTables(imms, *lkeys[i], value, s)) {
+        // Done
+      } else {
+        file_keys.push_back(lkeys[i]);
+        file_values.push_back(value);
+        file_index.push_back(i);
+      }
+    }
+
+    if (!file_keys.empty()) {
+      std::vector<Status> file_statuses;
+      current->MultiGet(options, file_keys, file_values, &file_statuses,
+                        &stats);
+      for (size_t i = 0; i < file_index.size(); i++) {
+        (*statuses)[file_index[i]] = file_statuses[i];
+      }
+      have_stat_update = true;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      delete lkeys[i];
+    }
+    mutex_.Lock();
+  }
+
+  if (have_stat_update) {
+    bool schedule = false;
+    for (size_t i = 0; i < stats.size(); i++) {
+      if (current->UpdateStats(stats[i])) {
+        schedule = true;
+      }
+    }
+    if (schedule) {
+      MaybeScheduleCompaction();
+    }
+  }
+  mem->Unref();
+  for (size_t i = 0; i < imms.size(); i++) {
+    imms[i]->Unref();
+  }
+  current->Unref();
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
@@ -1169,7 +1826,11 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed,
+                       (options.prefix_same_as_start &&
+                                options_.prefix_extractor != nullptr
+                            ? internal_prefix_extractor_.user_transform()
+                            : nullptr));
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1206,8 +1867,23 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
   MutexLock l(&mutex_);
   writers_.push_back(&w);
-  while (!w.done && &w != writers_.front()) {
-    w.cv.Wait();
+  // In pipelined mode a group member waits outside writers_ once its group
+  // has been logged, so writers_ may be empty here.
+  while (!w.done && (writers_.empty() || &w != writers_.front())) {
+    if (w.insert_into != nullptr) {
+      // The leader of our group asked us to insert our own batch.
+      MemTable* mem = w.insert_into;
+      w.insert_into = nullptr;
+      mutex_.Unlock();
+      Status s = WriteBatchInternal::InsertIntoConcurrently(w.batch, mem);
+      mutex_.Lock();
+      w.status = s;
+      if (--w.leader->pending_inserts == 0) {
+        w.leader->cv.Signal();
+      }
+    } else {
+      w.cv.Wait();
+    }
   }
   if (w.done) {
     return w.status;
@@ -1215,17 +1891,25 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
   // May temporarily unlock and wait.
   Status status = MakeRoomForWrite(updates == nullptr);
-  uint64_t last_sequence = versions_->LastSequence();
+  uint64_t last_sequence = LastAllocatedSequence();
   Writer* last_writer = &w;
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
     WriteBatch* write_batch = BuildBatchGroup(&last_writer);
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(write_batch);
+    const bool pipelined = options_.enable_pipelined_write;
+    const bool concurrent =
+        options_.allow_concurrent_memtable_write && last_writer != &w;
+    if (pipelined || concurrent) {
+      PrepareWriteGroup(&w, last_writer, last_sequence);
+    }
 
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
     // and protects against concurrent loggers and concurrent writes
-    // into mem_.
+    // into mem_.  In pipelined mode the memtable insert happens later,
+    // in WriteGroupToMemTable(), and concurrent inserts need the lock to
+    // wake up the rest of the group.
     {
       mutex_.Unlock();
       status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
@@ -1236,7 +1920,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
           sync_error = true;
         }
       }
-      if (status.ok()) {
+      if (status.ok() && !pipelined && !concurrent) {
         status = WriteBatchInternal::InsertInto(write_batch, mem_);
       }
       mutex_.Lock();
@@ -1249,6 +1933,12 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     }
     if (write_batch == tmp_batch_) tmp_batch_->Clear();
 
+    if (pipelined) {
+      return WriteGroupToMemTable(&w, status);
+    }
+    if (status.ok() && concurrent) {
+      status = InsertGroupConcurrently(&w, mem_);
+    }
     versions_->SetLastSequence(last_sequence);
   }
 
@@ -1271,6 +1961,126 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+SequenceNumber DBImpl::LastAllocatedSequence() {
+  mutex_.AssertHeld();
+  if (memtable_writers_.empty()) {
+    return versions_->LastSequence();
+  }
+  return memtable_writers_.back()->last_sequence;
+}
+
+// REQUIRES: mutex_ is held
+// REQUIRES: leader is at the front of the writer queue
+void DBImpl::PrepareWriteGroup(Writer* leader, Writer* last_writer,
+                               SequenceNumber last_sequence) {
+  mutex_.AssertHeld();
+  assert(writers_.front() == leader);
+  std::vector<Writer*>& group = leader->group;
+  group.clear();
+  SequenceNumber sequence = LastAllocatedSequence() + 1;
+  for (Writer* w : writers_) {
+    if (w->batch != nullptr) {
+      WriteBatchInternal::SetSequence(w->batch, sequence);
+      sequence += WriteBatchInternal::Count(w->batch);
+    }
+    group.push_back(w);
+    if (w == last_writer) break;
+  }
+  assert(sequence == last_sequence + 1);
+  leader->last_sequence = last_sequence;
+}
+
+// REQUIRES: mutex_ is held
+Status DBImpl::InsertGroupConcurrently(Writer* leader, MemTable* mem) {
+  mutex_.AssertHeld();
+  const std::vector<Writer*>& group = leader->group;
+  leader->pending_inserts = 0;
+  for (Writer* w : group) {
+    if (w != leader && w->batch != nullptr) {
+      w->leader = leader;
+      w->insert_into = mem;
+      leader->pending_inserts++;
+      w->cv.Signal();
+    }
+  }
+
+  mutex_.Unlock();
+  Status status = WriteBatchInternal::InsertIntoConcurrently(leader->batch, mem);
+  mutex_.Lock();
+  while (leader->pending_inserts > 0) {
+    leader->cv.Wait();
+  }
+  for (Writer* w : group) {
+    if (status.ok() && w != leader && w->batch != nullptr) {
+      status = w->status;
+    }
+  }
+  return status;
+}
+
+// REQUIRES: mutex_ is held
+// REQUIRES: leader is at the front of the writer queue
+Status DBImpl::WriteGroupToMemTable(Writer* leader, Status status) {
+  mutex_.AssertHeld();
+  assert(options_.enable_pipelined_write);
+  assert(writers_.front() == leader);
+
+  // Hand the log over to the next group.  PrepareWriteGroup() already gave
+  // the batches of the group their sequence numbers, and the caller has
+  // released tmp_batch_.
+  std::vector<Writer*>& group = leader->group;
+  for (size_t i = 0; i < group.size(); i++) {
+    assert(writers_.front() == group[i]);
+    writers_.pop_front();
+  }
+  memtable_writers_.push_back(leader);
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  // Groups must become visible in log order, so wait for the earlier ones.
+  while (memtable_writers_.front() != leader) {
+    leader->cv.Wait();
+  }
+
+  if (status.ok()) {
+    // MakeRoomForWrite() does not switch mem_ while memtable_writers_ is
+    // non-empty, and this is the only thread inserting into it.
+    if (options_.allow_concurrent_memtable_write && group.size() > 1) {
+      status = InsertGroupConcurrently(leader, mem_);
+    } else {
+      MemTable* mem = mem_;
+      mutex_.Unlock();
+      for (size_t i = 0; i < group.size() && status.ok(); i++) {
+        if (group[i]->batch != nullptr) {
+          status = WriteBatchInternal::InsertInto(group[i]->batch, mem);
+        }
+      }
+      mutex_.Lock();
+    }
+  }
+  versions_->SetLastSequence(leader->last_sequence);
+
+  memtable_writers_.pop_front();
+  for (size_t i = 0; i < group.size(); i++) {
+    Writer* ready = group[i];
+    if (ready != leader) {
+      ready->status = status;
+      ready->done = true;
+      ready->cv.Signal();
+    }
+  }
+  group.clear();
+
+  if (!memtable_writers_.empty()) {
+    memtable_writers_.front()->cv.Signal();
+  } else if (!writers_.empty()) {
+    // The head of the write queue may be waiting to switch memtables.
+    writers_.front()->cv.Signal();
+  }
+  return status;
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
 WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
@@ -1344,8 +2154,13 @@ Status DBImpl::MakeRoomForWrite(bool force) {
     } else if (!force && mem_->ApproximateMemoryUsage() <= options_.write_buffer_size) {
       // 当前memtable仍有空间
       break;
-    } else if (imm_ != nullptr) {
-      // 当前memtable已填满，但之前的memtable还在压缩中，所以等待
+    } else if (!memtable_writers_.empty()) {
+      // Logged groups are still being inserted into mem_; wait for them
+      // before switching memtables.
+      writers_.front()->cv.Wait();
+    } else if (imm_.size() >=
+               static_cast<size_t>(options_.max_write_buffer_number - 1)) {
+      // 当前memtable已填满，但等待压缩的memtable数已达上限，所以等待
       background_work_finished_signal_.Wait();
     } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // level-0 文件太多了
@@ -1382,13 +2197,15 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       }
       delete logfile_;
 
+      // 将当前MemTable连同其日志编号放入待压缩队列
+      imm_.push_back(ImmutableMemTable{mem_, logfile_number_});
+      has_imm_.store(true, std::memory_order_release);
+
       logfile_ = lfile;
       logfile_number_ = new_log_number;
       log_ = new log::Writer(lfile);
 
       // 创建新的MemTable
-      imm_ = mem_;
-      has_imm_.store(true, std::memory_order_release);
       mem_ = new MemTable(internal_comparator_);
       mem_->Ref();
       force = false;  // Do not force another compaction if have room
@@ -1447,14 +2264,39 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     if (mem_) {
       total_usage += mem_->ApproximateMemoryUsage();
     }
-    if (imm_) {
-      total_usage += imm_->ApproximateMemoryUsage();
+    for (size_t i = 0; i < imm_.size(); i++) {
+      total_usage += imm_[i].mem->ApproximateMemoryUsage();
     }
     char buf[50];
     std::snprintf(buf, sizeof(buf), "%llu",
                   static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "background-stats") {
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "Pool Threads Busy Queued   Completed AvgQueue(ms) "
+                  "MaxQueue(ms) AvgRun(ms)\n"
+                  "-------------------------------------------------"
+                  "-----------------------\n");
+    value->append(buf);
+    static const Env::Priority kPriorities[] = {Env::HIGH, Env::LOW};
+    for (Env::Priority pri : kPriorities) {
+      Env::BackgroundStats stats;
+      env_->GetBackgroundStats(pri, &stats);
+      const double completed =
+          stats.completed > 0 ? static_cast<double>(stats.completed) : 1.0;
+      std::snprintf(buf, sizeof(buf),
+                    "%-4s %7d %4d %6d %11llu %12.3f %12.3f %10.3f\n",
+                    pri == Env::HIGH ? "high" : "low", stats.threads,
+                    stats.busy_threads, stats.queue_length,
+                    static_cast<unsigned long long>(stats.completed),
+                    stats.total_queue_micros / completed / 1e3,
+                    stats.max_queue_micros / 1e3,
+                    stats.total_run_micros / completed / 1e3);
+      value->append(buf);
+    }
+    return true;
   }
 
   return false;
@@ -1492,6 +2334,16 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+void DB::MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                  std::vector<std::string>* values,
+                  std::vector<Status>* statuses) {
+  values->resize(keys.size());
+  statuses->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    (*statuses)[i] = Get(options, keys[i], &(*values)[i]);
+  }
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1525,9 +2377,13 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
   }
   if (s.ok()) {
     impl->RemoveObsoleteFiles();
+    impl->UpdatePendingCompactionBytes();
     impl->MaybeScheduleCompaction();
   }
   impl->mutex_.Unlock();
+  if (s.ok() && impl->options_.preload_tables_on_open) {
+    s = impl->PreloadTables();
+  }
   if (s.ok()) {
     assert(impl->mem_ != nullptr);
     *dbptr = impl;
@@ -1537,6 +2393,96 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
   return s;
 }
 
+namespace {
+
+// Tables to open in DBImpl::PreloadTables(), shared by its threads.
+struct TablePreloadState {
+  struct File {
+    uint64_t number;
+    uint64_t file_size;
+    int level;
+  };
+
+  explicit TablePreloadState(TableCache* table_cache)
+      : table_cache(table_cache), cv(&mu), next(0), running(0) {}
+
+  TableCache* const table_cache;
+  std::vector<File> tables;  // Set before the threads start
+
+  port::Mutex mu;
+  port::CondVar cv;
+  size_t next GUARDED_BY(mu);  // Index of the next table to open
+  int running GUARDED_BY(mu);  // Number of threads that have not finished
+  Status status GUARDED_BY(mu);  // First error
+};
+
+static void PreloadTablesThread(void* arg) {
+  TablePreloadState* state = reinterpret_cast<TablePreloadState*>(arg);
+  state->mu.Lock();
+  while (state->next < state->tables.size()) {
+    const TablePreloadState::File& t = state->tables[state->next++];
+    state->mu.Unlock();
+    Status s = state->table_cache->Preload(t.number, t.file_size, t.level);
+    state->mu.Lock();
+    if (!s.ok() && state->status.ok()) {
+      state->status = s;
+    }
+  }
+  state->running--;
+  state->cv.SignalAll();
+  state->mu.Unlock();
+}
+
+}  // namespace
+
+Status DBImpl::PreloadTables() {
+  const uint64_t start_micros = env_->NowMicros();
+  TablePreloadState state(table_cache_);
+
+  // The files of a version that is referenced are not deleted.
+  mutex_.Lock();
+  Version* current = versions_->current();
+  current->Ref();
+  const size_t max_tables = TableCacheSize(options_);
+  for (int level = 0; level < config::kNumLevels; level++) {
+    std::vector<FileMetaData*> files;
+    current->GetOverlappingInputs(level, nullptr, nullptr, &files);
+    for (size_t i = 0; i < files.size() && state.tables.size() < max_tables;
+         i++) {
+      state.tables.push_back({files[i]->number, files[i]->file_size, level});
+    }
+  }
+  mutex_.Unlock();
+
+  const int threads = static_cast<int>(std::min<size_t>(
+      kNumTablePreloadThreads, state.tables.size()));
+  state.mu.Lock();
+  state.running = threads;
+  state.mu.Unlock();
+  for (int i = 0; i < threads; i++) {
+    env_->StartThread(&PreloadTablesThread, &state);
+  }
+  state.mu.Lock();
+  while (state.running > 0) {
+    state.cv.Wait();
+  }
+  Status s = state.status;
+  state.mu.Unlock();
+
+  mutex_.Lock();
+  current->Unref();
+  mutex_.Unlock();
+
+  Log(options_.info_log, "Preloaded %d tables in %llu micros: %s",
+      static_cast<int>(state.tables.size()),
+      static_cast<unsigned long long>(env_->NowMicros() - start_micros),
+      s.ToString().c_str());
+  if (!options_.paranoid_checks) {
+    s = Status::OK();  // Failed tables are opened again when used
+  }
+  return s;
+}
+
 Snapshot::~Snapshot() = default;
 
 Status DestroyDB(const std::string& dbname, const Options& options) {
@@ -9,6 +9,7 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
@@ -42,6 +43,9 @@ class DBImpl : public DB {
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  void MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<Status>* statuses) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
@@ -85,6 +89,12 @@ class DBImpl : public DB {
     InternalKey tmp_storage;   // Used to keep track of compaction progress
   };
 
+  // A memtable that is full and waiting to be written to a table.
+  struct ImmutableMemTable {
+    MemTable* mem;
+    uint64_t log_number;  // Log file holding the updates in "mem"
+  };
+
   // Per level compaction stats.  stats_[level] stores the stats for
   // compactions that produced data for the specified "level".
   struct CompactionStats {
@@ -115,32 +125,106 @@ class DBImpl : public DB {
 
   void MaybeIgnoreError(Status* s) const;
 
+  // Open the tables of the current version in the table cache, on several
+  // threads (see Options::preload_tables_on_open).
+  Status PreloadTables() LOCKS_EXCLUDED(mutex_);
+
   // Delete any unneeded files and stale in-memory entries.
   void RemoveObsoleteFiles() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  // Compact the in-memory write buffer to disk.  Switches to a new
-  // log-file/memtable and writes a new descriptor iff successful.
-  // Errors are recorded in bg_error_.
+  // Compact the immutable in-memory write buffers to disk, merging them
+  // into a single table.  Writes a new descriptor that drops their log
+  // files iff successful.  Errors are recorded in bg_error_.
+  // REQUIRES: !imm_.empty() && !imm_compaction_running_
   void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Ref every immutable memtable and store them in *imms, newest first.
+  void RefImmutableMemTables(std::vector<MemTable*>* imms)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   Status RecoverLogFile(uint64_t log_number, bool last_log, bool* save_manifest,
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Like calling RecoverLogFile() on each of "logs" in turn, with their
+  // records read and decoded on other threads while the opening thread
+  // inserts the earlier ones.  See Options::parallel_log_recovery.
+  Status RecoverLogFilesInParallel(const std::vector<uint64_t>& logs,
+                                   bool* save_manifest, VersionEdit* edit,
+                                   SequenceNumber* max_sequence)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Write *mem, a memtable filled in from a log, out as a level-0 table if
+  // it is full, and set it to null then.
+  Status MaybeFlushRecoveredMemTable(MemTable** mem, int* compactions,
+                                     bool* save_manifest, VersionEdit* edit)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Called once the log "log_number" has been read, with the outcome in
+  // "status": keep the log and "mem", its last memtable, as the current
+  // ones if Options::reuse_logs allows, or else write "mem" out.  Takes
+  // over the reference to "mem", which may be null.
+  Status FinishRecoveredLog(uint64_t log_number, bool last_log,
+                            int compactions, MemTable* mem, Status status,
+                            bool* save_manifest, VersionEdit* edit)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Build a table from the merged contents of "mems" and record it in
+  // *edit.  The number of the new table is stored in *file_number and left
+  // in pending_outputs_; the caller erases it once *edit has been applied.
+  Status WriteLevel0Table(const std::vector<MemTable*>& mems,
+                          VersionEdit* edit, Version* base,
+                          uint64_t* file_number)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Report the change in the pending compaction bytes of the current
+  // version to options_.rate_limiter, if any.
+  void UpdatePendingCompactionBytes() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Apply *edit to the current version and record it in the MANIFEST.
+  // Waits for LogAndApply() calls made by other background threads, since
+  // VersionSet::LogAndApply() must not be called concurrently.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   WriteBatch* BuildBatchGroup(Writer** last_writer)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Sequence number of the last update written to the log.  Ahead of
+  // versions_->LastSequence() while pipelined writes are being applied.
+  SequenceNumber LastAllocatedSequence()
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Record the writers from "leader" through "last_writer" in
+  // leader->group and give each batch its own sequence numbers, ending at
+  // "last_sequence".  Needed when the batches are inserted one by one.
+  void PrepareWriteGroup(Writer* leader, Writer* last_writer,
+                         SequenceNumber last_sequence)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Insert every batch of leader->group into "mem", with each member of
+  // the group inserting its own batch on its own thread.
+  Status InsertGroupConcurrently(Writer* leader, MemTable* mem)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Pipelined write mode: move leader->group, whose updates are already in
+  // the log, from writers_ to memtable_writers_ so that the next group can
+  // start logging, then insert it into the memtable once every earlier
+  // group has been inserted.  "status" is the result of logging the group.
+  Status WriteGroupToMemTable(Writer* leader, Status status)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGFlushWork(void* db);
+  void BackgroundFlushCall();
+  // Returns false if there was nothing to do that did not conflict with
+  // background work already in progress.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
@@ -159,6 +243,7 @@ class DBImpl : public DB {
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  const InternalKeySliceTransform internal_prefix_extractor_;
   const Options options_;  // options_.comparator == &internal_comparator_
   const bool owns_info_log_;
   const bool owns_cache_;
@@ -175,8 +260,9 @@ class DBImpl : public DB {
   std::atomic<bool> shutting_down_;
   port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
   MemTable* mem_;
-  MemTable* imm_ GUARDED_BY(mutex_);  // Memtable being compacted
-  std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
+  // Memtables waiting to be compacted, oldest first.
+  std::deque<ImmutableMemTable> imm_ GUARDED_BY(mutex_);
+  std::atomic<bool> has_imm_;  // So bg thread can detect non-empty imm_
   WritableFile* logfile_;
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
@@ -186,14 +272,33 @@ class DBImpl : public DB {
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
+  // Leaders of the logged groups waiting to be inserted into mem_, in
+  // log order.  Only used by the pipelined write mode.
+  std::deque<Writer*> memtable_writers_ GUARDED_BY(mutex_);
+
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Has a flush of imm_ been scheduled on the high priority thread or is
+  // it running?  Only changed under mutex_, but atomic so that compactions
+  // can check it without the lock.
+  std::atomic<bool> background_flush_scheduled_;
+
+  // Number of background compactions that are scheduled or running.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Number of compactions picked from versions_ that have not finished yet.
+  int compactions_in_progress_ GUARDED_BY(mutex_);
+
+  // Is some background thread writing imm_ to a table?
+  bool imm_compaction_running_ GUARDED_BY(mutex_);
+
+  // Is some thread inside versions_->LogAndApply()?
+  bool manifest_write_in_progress_ GUARDED_BY(mutex_);
+  port::CondVar manifest_write_finished_signal_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
@@ -203,6 +308,9 @@ class DBImpl : public DB {
   Status bg_error_ GUARDED_BY(mutex_);
 
   CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+
+  // Pending compaction bytes last reported to options_.rate_limiter.
+  int64_t reported_pending_compaction_bytes_ GUARDED_BY(mutex_);
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
@@ -210,6 +318,7 @@ class DBImpl : public DB {
 Options SanitizeOptions(const std::string& db,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalKeySliceTransform* iprefix,
                         const Options& src);
 
 }  // namespace leveldb
@@ -46,11 +46,13 @@ class DBIter : public Iterator {
   enum Direction { kForward, kReverse };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, const SliceTransform* prefix_extractor)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        prefix_extractor_(prefix_extractor),
+        prefix_active_(false),
         direction_(kForward),
         valid_(false),
         rnd_(seed),
@@ -88,6 +90,17 @@ class DBIter : public Iterator {
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
+  // Returns false if the iteration is limited to the prefix of the last
+  // Seek() target and internal key "k" does not have that prefix.
+  bool InPrefix(const Slice& k) const {
+    if (!prefix_active_ || k.size() < 8) {
+      return true;  // Let ParseKey() report short keys
+    }
+    const Slice user_key = ExtractUserKey(k);
+    return prefix_extractor_->InDomain(user_key) &&
+           prefix_extractor_->Transform(user_key) == Slice(prefix_);
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -110,6 +123,9 @@ class DBIter : public Iterator {
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  const SliceTransform* const prefix_extractor_;  // May be nullptr
+  std::string prefix_;  // Prefix of the last Seek() target
+  bool prefix_active_;  // Whether iteration is limited to prefix_
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
@@ -179,6 +195,9 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   assert(iter_->Valid());
   assert(direction_ == kForward);
   do {
+    if (!InPrefix(iter_->key())) {
+      break;
+    }
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
       switch (ikey.type) {
@@ -239,6 +258,9 @@ void DBIter::FindPrevUserEntry() {
   ValueType value_type = kTypeDeletion;
   if (iter_->Valid()) {
     do {
+      if (!InPrefix(iter_->key())) {
+        break;
+      }
       ParsedInternalKey ikey;
       if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
         if ((value_type != kTypeDeletion) &&
@@ -277,6 +299,12 @@ void DBIter::FindPrevUserEntry() {
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  prefix_active_ =
+      prefix_extractor_ != nullptr && prefix_extractor_->InDomain(target);
+  if (prefix_active_) {
+    Slice prefix = prefix_extractor_->Transform(target);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
@@ -291,6 +319,7 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  prefix_active_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -302,6 +331,7 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  prefix_active_ = false;
   ClearSavedValue();
   iter_->SeekToLast();
   FindPrevUserEntry();
@@ -311,8 +341,10 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed,
+                        const SliceTransform* prefix_extractor) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    prefix_extractor);
 }
 
 }  // namespace leveldb
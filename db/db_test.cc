@@ -6,6 +6,7 @@
 
 #include <atomic>
 #include <cinttypes>
+#include <cstring>
 #include <string>
 
 #include "gtest/gtest.h"
@@ -16,6 +17,9 @@
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/persistent_cache.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -138,9 +142,18 @@ class SpecialEnv : public EnvWrapper {
   // Force log file close to fail while this bool is true.
   std::atomic<bool> log_file_close_;
 
+  // The next sstable Sync() call made while this is true clears it, sets
+  // table_sync_held_ and blocks until table_sync_held_ is cleared.
+  std::atomic<bool> hold_next_table_sync_;
+  std::atomic<bool> table_sync_held_;
+
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // With count_random_reads_, copy the data read into the caller's buffer,
+  // as files that are not memory-mapped do, so that blocks can be cached.
+  bool copy_random_reads_;
+
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
         delay_data_sync_(false),
@@ -150,7 +163,10 @@ class SpecialEnv : public EnvWrapper {
         manifest_sync_error_(false),
         manifest_write_error_(false),
         log_file_close_(false),
-        count_random_reads_(false) {}
+        hold_next_table_sync_(false),
+        table_sync_held_(false),
+        count_random_reads_(false),
+        copy_random_reads_(false) {}
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     class DataFile : public WritableFile {
@@ -188,6 +204,13 @@ class SpecialEnv : public EnvWrapper {
         while (env_->delay_data_sync_.load(std::memory_order_acquire)) {
           DelayMilliseconds(100);
         }
+        if (IsLdbFile(fname_) && env_->hold_next_table_sync_.exchange(
+                                     false, std::memory_order_acq_rel)) {
+          env_->table_sync_held_.store(true, std::memory_order_release);
+          while (env_->table_sync_held_.load(std::memory_order_acquire)) {
+            DelayMilliseconds(10);
+          }
+        }
         return base_->Sync();
       }
     };
@@ -237,21 +260,28 @@ class SpecialEnv : public EnvWrapper {
      private:
       RandomAccessFile* target_;
       AtomicCounter* counter_;
+      const bool copy_;
 
      public:
-      CountingFile(RandomAccessFile* target, AtomicCounter* counter)
-          : target_(target), counter_(counter) {}
+      CountingFile(RandomAccessFile* target, AtomicCounter* counter,
+                   bool copy)
+          : target_(target), counter_(counter), copy_(copy) {}
       ~CountingFile() override { delete target_; }
       Status Read(uint64_t offset, size_t n, Slice* result,
                   char* scratch) const override {
         counter_->Increment();
-        return target_->Read(offset, n, result, scratch);
+        Status s = target_->Read(offset, n, result, scratch);
+        if (s.ok() && copy_ && result->data() != scratch) {
+          std::memcpy(scratch, result->data(), result->size());
+          *result = Slice(scratch, result->size());
+        }
+        return s;
       }
     };
 
     Status s = target()->NewRandomAccessFile(f, r);
     if (s.ok() && count_random_reads_) {
-      *r = new CountingFile(*r, &random_read_counter_);
+      *r = new CountingFile(*r, &random_read_counter_, copy_random_reads_);
     }
     return s;
   }
@@ -306,6 +336,37 @@ class DBTest : public testing::Test {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemTableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kPartitionedIndex:
+        // With a filter, since index partitions shift data block offsets.
+        options.index_partition_size = 128;
+        options.filter_policy = filter_policy_;
+        break;
+      case kFullFilterBlock:
+        options.filter_policy = filter_policy_;
+        options.filter_block_type = kFullFilter;
+        break;
+      case kPartitionedFilterBlock:
+        options.index_partition_size = 128;
+        options.filter_policy = filter_policy_;
+        options.filter_block_type = kPartitionedFilter;
+        break;
+      case kDataBlockHashIndex:
+        options.data_block_hash_index = true;
+        break;
+      case kCacheIndexAndFilterBlocks:
+        options.filter_policy = filter_policy_;
+        options.cache_index_and_filter_blocks = true;
+        options.pin_l0_filter_and_index_blocks_in_cache = true;
+        break;
+      case kParallelLogRecovery:
+        options.parallel_log_recovery = true;
+        break;
       default:
         break;
     }
@@ -364,6 +425,30 @@ class DBTest : public testing::Test {
     return result;
   }
 
+  // Look up "keys" with a single MultiGet() call and return the results
+  // formatted like "v1,NOT_FOUND,v3".
+  std::string MultiGet(const std::vector<std::string>& keys,
+                       const Snapshot* snapshot = nullptr) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(options, key_slices, &values, &statuses);
+    std::string result;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (i > 0) result += ",";
+      if (statuses[i].IsNotFound()) {
+        result += "NOT_FOUND";
+      } else if (!statuses[i].ok()) {
+        result += statuses[i].ToString();
+      } else {
+        result += values[i];
+      }
+    }
+    return result;
+  }
+
   // Return a string that contains all key,value pairs in order,
   // formatted like "(k1->v1)(k2->v2)".
   std::string Contents() {
@@ -562,7 +647,21 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kUncompressed,
+    kPipelinedWrite,
+    kConcurrentMemTableWrite,
+    kPartitionedIndex,
+    kFullFilterBlock,
+    kPartitionedFilterBlock,
+    kDataBlockHashIndex,
+    kCacheIndexAndFilterBlocks,
+    kParallelLogRecovery,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
   int option_config_;
@@ -637,6 +736,47 @@ TEST_F(DBTest, GetFromImmutableLayer) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, GetFromQueuedImmutableMemTables) {
+  do {
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.write_buffer_size = 100000;  // Small write buffer
+    options.max_write_buffer_number = 4;
+    Reopen(&options);
+
+    ASSERT_LEVELDB_OK(Put("foo", "v1"));
+
+    // Block sync calls so that the first flush cannot finish and the
+    // following memtables queue up behind it without stalling writes.
+    env_->delay_data_sync_.store(true, std::memory_order_release);
+    Put("k1", std::string(100000, 'x'));  // Fill memtable.
+    Put("k2", std::string(100000, 'y'));  // Queue 1st immutable memtable.
+    Put("foo", "v2");                     // Queue 2nd immutable memtable.
+    Put("k3", std::string(100000, 'z'));
+    Put("k4", std::string(100000, 'w'));  // Queue 3rd immutable memtable.
+    ASSERT_EQ("v2", Get("foo"));
+    ASSERT_EQ(std::string(100000, 'x'), Get("k1"));
+    ASSERT_EQ(std::string(100000, 'y'), Get("k2"));
+    ASSERT_EQ(std::string(100000, 'z'), Get("k3"));
+    ASSERT_EQ("[ v2, v1 ]", AllEntriesFor("foo"));
+    ASSERT_EQ(0, TotalTableFiles());
+    // Release sync calls.
+    env_->delay_data_sync_.store(false, std::memory_order_release);
+
+    // The memtables queued behind the first flush are merged into fewer
+    // level-0 tables.
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_LT(TotalTableFiles(), 4);
+    ASSERT_EQ("v2", Get("foo"));
+    ASSERT_EQ(std::string(100000, 'w'), Get("k4"));
+
+    Reopen(&options);
+    ASSERT_EQ("v2", Get("foo"));
+    ASSERT_EQ(std::string(100000, 'y'), Get("k2"));
+    ASSERT_EQ(std::string(100000, 'w'), Get("k4"));
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, GetFromVersions) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -656,6 +796,15 @@ TEST_F(DBTest, GetMemUsage) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, GetBackgroundStats) {
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  std::string val;
+  ASSERT_TRUE(db_->GetProperty("leveldb.background-stats", &val));
+  ASSERT_NE(std::string::npos, val.find("\nhigh ")) << val;
+  ASSERT_NE(std::string::npos, val.find("\nlow ")) << val;
+}
+
 TEST_F(DBTest, GetSnapshot) {
   do {
     // Try with both a short key and a long key
@@ -803,6 +952,55 @@ TEST_F(DBTest, GetEncountersEmptyLevel) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, MultiGet) {
+  do {
+    ASSERT_EQ("", MultiGet({}));
+    ASSERT_EQ("NOT_FOUND,NOT_FOUND", MultiGet({"a", "b"}));
+
+    // Spread the data across several levels, level-0 files, the
+    // immutable memtable and the memtable.
+    ASSERT_LEVELDB_OK(Put("a", "va1"));
+    ASSERT_LEVELDB_OK(Put("c", "vc1"));
+    ASSERT_LEVELDB_OK(Put("e", "ve1"));
+    ASSERT_LEVELDB_OK(Put("g", "vg1"));
+    Compact("a", "z");
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_LEVELDB_OK(Delete("e"));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Put("b", "vb1"));
+    ASSERT_LEVELDB_OK(Put("g", "vg2"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Put("d", "vd1"));
+    ASSERT_LEVELDB_OK(Delete("a"));
+
+    ASSERT_EQ("NOT_FOUND,vb1,vc2,vd1,NOT_FOUND,NOT_FOUND,vg2,NOT_FOUND",
+              MultiGet({"a", "b", "c", "d", "e", "f", "g", "h"}));
+    // Unsorted input with duplicates.
+    ASSERT_EQ("vg2,vc2,NOT_FOUND,vc2,vb1",
+              MultiGet({"g", "c", "a", "c", "b"}));
+    ASSERT_EQ("va1,NOT_FOUND,vc2,NOT_FOUND,NOT_FOUND,vg1",
+              MultiGet({"a", "b", "c", "d", "e", "g"}, snapshot));
+    db_->ReleaseSnapshot(snapshot);
+
+    // Results must match Get() for every key.
+    std::vector<std::string> keys;
+    for (char c = 'a'; c <= 'h'; c++) {
+      keys.push_back(std::string(1, c));
+    }
+    std::vector<std::string> results;
+    for (const std::string& k : keys) {
+      results.push_back(Get(k));
+    }
+    std::string expected;
+    for (size_t i = 0; i < results.size(); i++) {
+      if (i > 0) expected += ",";
+      expected += results[i];
+    }
+    ASSERT_EQ(expected, MultiGet(keys));
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, IterEmpty) {
   Iterator* iter = db_->NewIterator(ReadOptions());
 
@@ -1079,6 +1277,120 @@ static std::string Key(int i) {
   return std::string(buf);
 }
 
+TEST_F(DBTest, MultiGetManyBlocks) {
+  do {
+    // Keys spread over many data blocks of one table, so that their blocks
+    // are read in several batches.
+    Random rnd(301);
+    std::vector<std::string> values;
+    for (int i = 0; i < 500; i++) {
+      values.push_back(RandomString(&rnd, 1000));
+      ASSERT_LEVELDB_OK(Put(Key(2 * i), values.back()));
+    }
+    Compact(Key(0), Key(1000));
+
+    for (int pass = 0; pass < 2; pass++) {
+      // Every third key, and keys between and after the stored ones.
+      std::vector<std::string> keys;
+      std::string expected;
+      for (int i = 0; i < 1010; i += 3) {
+        keys.push_back(Key(i));
+        if (!expected.empty()) expected += ",";
+        expected += (i % 2 == 0 && i < 1000) ? values[i / 2] : "NOT_FOUND";
+      }
+      // The second pass finds the blocks in the cache.
+      ASSERT_EQ(expected, MultiGet(keys));
+    }
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, DirectIO) {
+  // The test env does not forward direct I/O, so use the default env.
+  Options options = CurrentOptions();
+  options.env = Env::Default();
+  options.create_if_missing = true;
+  options.write_buffer_size = 100000;
+  options.use_direct_io_for_compaction = true;
+  options.use_direct_reads = true;
+  DestroyAndReopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 1000; i++) {
+    values.push_back(RandomString(&rnd, 1000));
+    ASSERT_LEVELDB_OK(Put(Key(i), values.back()));
+  }
+  // Overwrite half of the keys so that compactions merge several inputs.
+  for (int i = 0; i < 1000; i += 2) {
+    values[i] = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  db_->CompactRange(nullptr, nullptr);
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < 1000; i++) {
+      ASSERT_EQ(values[i], Get(Key(i)));
+    }
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_EQ(Key(count), iter->key().ToString());
+      ASSERT_EQ(values[count], iter->value().ToString());
+      count++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    ASSERT_EQ(1000, count);
+    delete iter;
+    Reopen(&options);
+  }
+}
+
+TEST_F(DBTest, CompactionReadahead) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.create_if_missing = true;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+
+  // Compact two overlapping tables of 100 to 200 data blocks, block by
+  // block and then in chunks.
+  int reads[2];
+  for (int pass = 0; pass < 2; pass++) {
+    options.compaction_readahead_size = (pass == 0) ? 0 : 1 << 20;
+    DestroyAndReopen(&options);
+
+    Random rnd(301);
+    std::vector<std::string> values;
+    for (int i = 0; i < 400; i++) {
+      values.push_back(RandomString(&rnd, 1000));
+      ASSERT_LEVELDB_OK(Put(Key(i), values.back()));
+    }
+    dbfull()->TEST_CompactMemTable();
+    for (int i = 0; i < 400; i += 2) {
+      values[i] = RandomString(&rnd, 1000);
+      ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+    }
+    dbfull()->TEST_CompactMemTable();
+
+    env_->random_read_counter_.Reset();
+    db_->CompactRange(nullptr, nullptr);
+    reads[pass] = env_->random_read_counter_.Read();
+    std::fprintf(stderr, "readahead %d => %d reads\n",
+                 static_cast<int>(options.compaction_readahead_size),
+                 reads[pass]);
+    ASSERT_EQ("0,0,1", FilesPerLevel());
+
+    for (int i = 0; i < 400; i++) {
+      ASSERT_EQ(values[i], Get(Key(i)));
+    }
+  }
+  ASSERT_GE(reads[0], 100);
+  ASSERT_LE(reads[1], reads[0] / 10);
+
+  Close();
+  delete options.block_cache;
+}
+
 TEST_F(DBTest, MinorCompactionsHappen) {
   Options options = CurrentOptions();
   options.write_buffer_size = 10000;
@@ -1154,6 +1466,121 @@ TEST_F(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST_F(DBTest, ConcurrentCompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_background_compactions = 4;
+  Reopen(&options);
+
+  // Overwrite and delete random keys so that flushes and compactions at
+  // several levels are needed while writes are going on.
+  Random rnd(301);
+  const int kNumKeys = 4000;
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 20000; i++) {
+    const std::string key = Key(rnd.Uniform(kNumKeys));
+    if (rnd.OneIn(10)) {
+      ASSERT_LEVELDB_OK(Delete(key));
+      model.erase(key);
+    } else {
+      const std::string value = RandomString(&rnd, 500);
+      ASSERT_LEVELDB_OK(Put(key, value));
+      model[key] = value;
+    }
+  }
+  ASSERT_GT(TotalTableFiles() - NumTableFilesAtLevel(0), 0);
+
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      auto iter = model.find(Key(i));
+      ASSERT_EQ(iter == model.end() ? "NOT_FOUND" : iter->second, Get(Key(i)));
+    }
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    auto model_iter = model.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++model_iter) {
+      ASSERT_TRUE(model_iter != model.end());
+      ASSERT_EQ(model_iter->first, iter->key().ToString());
+      ASSERT_EQ(model_iter->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(model_iter == model.end());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+
+    if (round == 0) {
+      // Manual compactions wait for the automatic ones in progress.
+      db_->CompactRange(nullptr, nullptr);
+    } else if (round == 1) {
+      Reopen(&options);
+    }
+  }
+}
+
+namespace {
+
+struct CompactLevelState {
+  DBImpl* db;
+  int level;
+  std::atomic<bool> done;
+};
+
+static void CompactLevelThread(void* arg) {
+  CompactLevelState* state = reinterpret_cast<CompactLevelState*>(arg);
+  state->db->TEST_CompactRange(state->level, nullptr, nullptr);
+  state->done.store(true, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST_F(DBTest, FlushDuringCompactionKeepsLevelsDisjoint) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+
+  // Level 1 and level 2 each get a table at both ends of the key space,
+  // with a gap in between.
+  for (int i = 0; i < 2; i++) {
+    const std::string value = (i == 0 ? "old" : "new");
+    ASSERT_LEVELDB_OK(Put("a", value));
+    ASSERT_LEVELDB_OK(Put("c", value));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_LEVELDB_OK(Put("x", value));
+    ASSERT_LEVELDB_OK(Put("z", value));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ("0,2,2", FilesPerLevel());
+
+  // Merge level 1 into a single level-2 table covering [a,z], and hold it
+  // before it is installed.
+  env_->hold_next_table_sync_.store(true, std::memory_order_release);
+  CompactLevelState state;
+  state.db = dbfull();
+  state.level = 1;
+  state.done.store(false, std::memory_order_release);
+  env_->StartThread(&CompactLevelThread, &state);
+  while (!env_->table_sync_held_.load(std::memory_order_acquire)) {
+    DelayMilliseconds(10);
+  }
+
+  // A flush in the gap must stay above the range that is being written.
+  // Failures do not return early, so that the compaction is let go.
+  EXPECT_LEVELDB_OK(Put("m", "v"));
+  EXPECT_LEVELDB_OK(Put("n", "v"));
+  EXPECT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  EXPECT_EQ("0,3,2", FilesPerLevel());
+
+  env_->table_sync_held_.store(false, std::memory_order_release);
+  while (!state.done.load(std::memory_order_acquire)) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  ASSERT_EQ("new", Get("a"));
+  ASSERT_EQ("new", Get("c"));
+  ASSERT_EQ("v", Get("m"));
+  ASSERT_EQ("v", Get("n"));
+  ASSERT_EQ("new", Get("x"));
+  ASSERT_EQ("new", Get("z"));
+}
+
 TEST_F(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1613,6 +2040,9 @@ TEST_F(DBTest, CustomComparator) {
   new_options.comparator = &cmp;
   new_options.filter_policy = nullptr;   // Cannot use bloom filters
   new_options.write_buffer_size = 1000;  // Compact more often
+  // Equal keys like "[10]" and "[0xa]" have different bytes, so the option
+  // must be ignored.
+  new_options.data_block_hash_index = true;
   DestroyAndReopen(&new_options);
   ASSERT_LEVELDB_OK(Put("[10]", "ten"));
   ASSERT_LEVELDB_OK(Put("[0x14]", "twenty"));
@@ -1977,6 +2407,370 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+static std::string PrefixKey(int prefix, int i) {
+  char buf[100];
+  std::snprintf(buf, sizeof(buf), "p%03d-%03d", prefix, i);
+  return std::string(buf);
+}
+
+TEST_F(DBTest, PrefixSeek) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.filter_block_type = kFullFilter;
+  options.prefix_extractor = NewFixedPrefixTransform(4);  // "pNNN"
+  Reopen(&options);
+
+  // Populate two layers with the even prefixes only
+  for (int p = 0; p < 100; p += 2) {
+    for (int i = 0; i < 10; i++) {
+      ASSERT_LEVELDB_OK(Put(PrefixKey(p, i), "v1"));
+    }
+  }
+  Compact("a", "z");
+  for (int p = 0; p < 100; p += 10) {
+    ASSERT_LEVELDB_OK(Put(PrefixKey(p, 5), "v2"));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  ReadOptions prefix_options;
+  prefix_options.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(prefix_options);
+
+  // Open every table
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) count++;
+  ASSERT_EQ(500, count);
+
+  // Iteration stops at the end of the prefix
+  std::string result;
+  for (iter->Seek("p010"); iter->Valid(); iter->Next()) {
+    result += iter->key().ToString() + "=" + iter->value().ToString() + " ";
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  ASSERT_EQ(
+      "p010-000=v1 p010-001=v1 p010-002=v1 p010-003=v1 p010-004=v1 "
+      "p010-005=v2 p010-006=v1 p010-007=v1 p010-008=v1 p010-009=v1 ",
+      result);
+
+  // In both directions
+  iter->Seek("p012-002");
+  ASSERT_EQ("p012-002", iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ("p012-001", iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ("p012-000", iter->key().ToString());
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+
+  // Seeks to absent prefixes rarely read a data block
+  env_->random_read_counter_.Reset();
+  for (int p = 1; p < 100; p += 2) {
+    iter->Seek(PrefixKey(p, 0).substr(0, 4));
+    ASSERT_TRUE(!iter->Valid());
+    ASSERT_LEVELDB_OK(iter->status());
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "50 missing prefixes => %d reads\n", reads);
+  ASSERT_LE(reads, 5);
+
+  // A target too short to have a prefix is not limited to one
+  iter->Seek("p");
+  count = 0;
+  for (; iter->Valid(); iter->Next()) count++;
+  ASSERT_EQ(500, count);
+  delete iter;
+
+  // Without prefix_same_as_start, Seek() finds the next prefix
+  iter = db_->NewIterator(ReadOptions());
+  iter->Seek("p011");
+  ASSERT_EQ("p012-000", iter->key().ToString());
+  delete iter;
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
+TEST_F(DBTest, PersistentCache) {
+  // The cache is kept on another Env, whose reads are not counted.
+  Env* cache_env = Env::Default();
+  const std::string cache_path = dbname_ + "_persistent_cache";
+  PersistentCache* persistent_cache;
+  ASSERT_LEVELDB_OK(
+      NewPersistentCache(cache_env, cache_path, 1 << 20, &persistent_cache));
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.persistent_cache = persistent_cache;
+  Reopen(&options);
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i) + std::string(100, 'v')));
+  }
+  Compact("a", "z");
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // The first reads of the blocks fill the persistent cache, and later
+  // reads are served from it.
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i) + std::string(100, 'v'), Get(Key(i)));
+  }
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i) + std::string(100, 'v'), Get(Key(i)));
+  }
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+
+  // The cache stays warm across restarts: only opening the tables reads
+  // their files.
+  Close();
+  delete persistent_cache;
+  ASSERT_LEVELDB_OK(
+      NewPersistentCache(cache_env, cache_path, 1 << 20, &persistent_cache));
+  options.persistent_cache = persistent_cache;
+  Reopen(&options);
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i) + std::string(100, 'v'), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d reads after restart => %d file reads\n", N, reads);
+  ASSERT_LE(reads, 2 * TotalTableFiles());  // Footer and index block
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete persistent_cache;
+  std::vector<std::string> filenames;
+  cache_env->GetChildren(cache_path, &filenames);
+  for (const std::string& filename : filenames) {
+    cache_env->RemoveFile(cache_path + "/" + filename);
+  }
+  cache_env->RemoveDir(cache_path);
+}
+
+TEST_F(DBTest, CacheIndexAndFilterBlocks) {
+  env_->count_random_reads_ = true;
+  env_->copy_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(1 << 20);
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.cache_index_and_filter_blocks = true;
+  Reopen(&options);
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i) + std::string(100, 'v')));
+  }
+  Compact("a", "z");
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_EQ(1, TotalTableFiles());
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i) + std::string(100, 'v'), Get(Key(i)));
+  }
+
+  // Once evicted, the filter and index blocks are read again, and then
+  // served from the cache.
+  options.block_cache->Prune();
+  ASSERT_EQ(0, options.block_cache->TotalCharge());
+  env_->random_read_counter_.Reset();
+  ASSERT_EQ("NOT_FOUND", Get(Key(0) + ".missing"));
+  ASSERT_EQ(2, env_->random_read_counter_.Read());
+  env_->random_read_counter_.Reset();
+  ASSERT_EQ("NOT_FOUND", Get(Key(1) + ".missing"));
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+
+  // Those of level 0 tables can be pinned.
+  options.pin_l0_filter_and_index_blocks_in_cache = true;
+  Reopen(&options);
+  for (int i = 0; NumTableFilesAtLevel(0) == 0; i++) {
+    ASSERT_LT(i, 10);
+    ASSERT_LEVELDB_OK(Put(Key(0), "new"));
+    dbfull()->TEST_CompactMemTable();
+  }
+  options.block_cache->Prune();
+  ASSERT_GT(options.block_cache->TotalCharge(), 0);
+
+  // And are unpinned when the tables are closed.
+  Close();
+  options.block_cache->Prune();
+  ASSERT_EQ(0, options.block_cache->TotalCharge());
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, TrivialMoveUnpinsLevel0Tables) {
+  env_->count_random_reads_ = true;
+  env_->copy_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(1 << 20);
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.cache_index_and_filter_blocks = true;
+  options.pin_l0_filter_and_index_blocks_in_cache = true;
+  Reopen(&options);
+
+  // Recovering the log with a small write buffer leaves level 0 tables
+  // with disjoint key ranges, some of which are moved to level 1.
+  const int N = 200;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'v')));
+  }
+  options.write_buffer_size = 20000;
+  Reopen(&options);
+  options.block_cache->Prune();
+  ASSERT_GT(options.block_cache->TotalCharge(), 0);
+  for (int i = 0; NumTableFilesAtLevel(1) == 0 ||
+                  NumTableFilesAtLevel(0) >= config::kL0_CompactionTrigger;
+       i++) {
+    ASSERT_LT(i, 100);
+    DelayMilliseconds(100);
+  }
+
+  // Rewriting the tables left in level 0 closes them, so only the moved
+  // tables could still hold blocks in the cache.
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  options.block_cache->Prune();
+  ASSERT_EQ(0, options.block_cache->TotalCharge());
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, PreloadTablesOnOpen) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.filter_policy = nullptr;
+  Reopen(&options);
+
+  // One table per key.
+  const int kTables = 20;
+  for (int i = 0; i < kTables; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ(kTables, TotalTableFiles());
+
+  // Opening a table reads its footer and index block, and getting a key
+  // reads a data block.
+  env_->count_random_reads_ = true;
+  for (bool preload : {false, true}) {
+    options.preload_tables_on_open = preload;
+    Reopen(&options);
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < kTables; i++) {
+      ASSERT_EQ("v", Get(Key(i)));
+    }
+    ASSERT_EQ(preload ? kTables : 3 * kTables,
+              env_->random_read_counter_.Read());
+  }
+
+  // Errors are ignored, unless paranoid_checks is set.
+  Close();
+  std::vector<std::string> filenames;
+  ASSERT_LEVELDB_OK(env_->GetChildren(dbname_, &filenames));
+  uint64_t number;
+  FileType type;
+  for (const std::string& filename : filenames) {
+    if (ParseFileName(filename, &number, &type) && type == kTableFile) {
+      break;
+    }
+  }
+  const std::string fname = TableFileName(dbname_, number);
+  std::string contents;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, fname, &contents));
+  contents[contents.size() - 1] ^= 1;  // Bad magic number
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, contents, fname));
+  options.preload_tables_on_open = true;
+  ASSERT_LEVELDB_OK(TryReopen(&options));
+  options.paranoid_checks = true;
+  ASSERT_TRUE(!TryReopen(&options).ok());
+}
+
+namespace {
+
+// Counts the bytes requested by the DB, without limiting them.
+class CountingRateLimiter : public RateLimiter {
+ public:
+  void Request(int64_t bytes, Env::Priority pri) override {
+    MutexLock l(&mu_);
+    bytes_[pri] += bytes;
+  }
+  void SetBytesPerSecond(int64_t bytes_per_second) override {}
+  int64_t GetBytesPerSecond() const override { return 0; }
+  int64_t GetTotalBytesThrough(Env::Priority pri) const override {
+    MutexLock l(&mu_);
+    return bytes_[pri];
+  }
+  void AddPendingCompactionBytes(int64_t delta) override {
+    MutexLock l(&mu_);
+    pending_ += delta;
+    EXPECT_GE(pending_, 0);
+  }
+  int64_t pending() const {
+    MutexLock l(&mu_);
+    return pending_;
+  }
+
+ private:
+  mutable port::Mutex mu_;
+  int64_t bytes_[2] GUARDED_BY(mu_) = {0, 0};
+  int64_t pending_ GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace
+
+TEST_F(DBTest, RateLimiter) {
+  CountingRateLimiter limiter;
+  Options options = CurrentOptions();
+  options.rate_limiter = &limiter;
+  Reopen(&options);
+
+  // Flushes are metered at high priority.
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'v')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(1, TotalTableFiles());
+  const int64_t flushed = limiter.GetTotalBytesThrough(Env::HIGH);
+  ASSERT_GE(flushed, 100 * 1000);
+  ASSERT_EQ(0, limiter.GetTotalBytesThrough(Env::LOW));
+
+  // Compactions are metered at low priority.
+  for (int i = 0; i < 100; i += 2) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'w')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_GT(limiter.GetTotalBytesThrough(Env::HIGH), flushed);
+  ASSERT_GE(limiter.GetTotalBytesThrough(Env::LOW), 100 * 1000);
+  ASSERT_EQ(std::string(1000, 'w'), Get(Key(0)));
+
+  // The pending compaction bytes reported by a DB go away with it.
+  Close();
+  ASSERT_EQ(0, limiter.pending());
+}
+
 TEST_F(DBTest, LogCloseError) {
   // Regression test for bug where we could ignore log file
   // Close() error when switching to a new log file.
@@ -103,17 +103,37 @@ void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
   // We rely on the fact that the code in table.cc does not mind us
   // adjusting keys[].
   Slice* mkey = const_cast<Slice*>(keys);
+  int m = 0;
   for (int i = 0; i < n; i++) {
-    mkey[i] = ExtractUserKey(keys[i]);
-    // TODO(sanjay): Suppress dups?
+    const Slice user_key = ExtractUserKey(keys[i]);
+    // Suppress the adjacent dups left by multiple versions of a user key,
+    // or by keys that share a prefix.
+    if (m > 0 && mkey[m - 1] == user_key) {
+      continue;
+    }
+    mkey[m++] = user_key;
   }
-  user_policy_->CreateFilter(keys, n, dst);
+  user_policy_->CreateFilter(keys, m, dst);
 }
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
   return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
 }
 
+const char* InternalKeySliceTransform::Name() const {
+  return user_transform_->Name();
+}
+
+Slice InternalKeySliceTransform::Transform(const Slice& key) const {
+  const Slice prefix = user_transform_->Transform(ExtractUserKey(key));
+  assert(prefix.data() == key.data());
+  return Slice(key.data(), prefix.size() + 8);
+}
+
+bool InternalKeySliceTransform::InDomain(const Slice& key) const {
+  return user_transform_->InDomain(ExtractUserKey(key));
+}
+
 LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
   size_t user_key_size = user_key.size();
   size_t needed = user_key_size + 13;  // A conservative estimate (保守估计)
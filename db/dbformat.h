@@ -13,6 +13,7 @@
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -125,6 +126,25 @@ class InternalFilterPolicy : public FilterPolicy {
   bool KeyMayMatch(const Slice& key, const Slice& filter) const override;
 };
 
+// Filter prefixes of internal keys with a user prefix extractor.
+//
+// Transform() returns the prefix of the user key followed by the 8 bytes
+// that come after it in the internal key.  The result thus has the shape
+// of an internal key, which InternalFilterPolicy strips back down to the
+// user prefix before handing it to the user filter policy.
+class InternalKeySliceTransform : public SliceTransform {
+ private:
+  const SliceTransform* const user_transform_;
+
+ public:
+  explicit InternalKeySliceTransform(const SliceTransform* t)
+      : user_transform_(t) {}
+  const SliceTransform* user_transform() const { return user_transform_; }
+  const char* Name() const override;
+  Slice Transform(const Slice& key) const override;
+  bool InDomain(const Slice& key) const override;
+};
+
 // Modules in this directory should keep internal keys wrapped inside
 // the following class instead of plain strings so that we do not
 // incorrectly use string comparisons instead of an InternalKeyComparator.
@@ -73,8 +73,9 @@ class MemTableIterator : public Iterator {
 
 Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
 
-void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
-                   const Slice& value) {
+const char* MemTable::EncodeEntry(SequenceNumber s, ValueType type,
+                                  const Slice& key, const Slice& value,
+                                  bool concurrent) {
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -88,7 +89,8 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
                              VarintLength(val_size) + val_size;
   
   // 分配存储空间
-  char* buf = arena_.Allocate(encoded_len);
+  char* buf = concurrent ? arena_.AllocateConcurrently(encoded_len)
+                         : arena_.Allocate(encoded_len);
 
   // 打包InternalKey，序列化后就是LookupKey
   char* p = EncodeVarint32(buf, internal_key_size);  // pack internal_key_size
@@ -104,9 +106,18 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   
   std::memcpy(p, value.data(), val_size);  // pack value
   assert(p + val_size == buf + encoded_len);
+  return buf;
+}
 
+void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
+                   const Slice& value) {
   // 插入跳表
-  table_.Insert(buf);
+  table_.Insert(EncodeEntry(s, type, key, value, false));
+}
+
+void MemTable::AddConcurrently(SequenceNumber s, ValueType type,
+                               const Slice& key, const Slice& value) {
+  table_.InsertConcurrently(EncodeEntry(s, type, key, value, true));
 }
 
 bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
@@ -58,6 +58,11 @@ class MemTable {
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
+  // Like Add(), but may be called from several threads at once, as long
+  // as no Add() runs at the same time.
+  void AddConcurrently(SequenceNumber seq, ValueType type, const Slice& key,
+                       const Slice& value);
+
   // If memtable contains a value for key, store it in *value and return true.
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
@@ -78,6 +83,11 @@ class MemTable {
 
   ~MemTable();  // Private since only Unref() should be used to delete it
 
+  // Encode an entry for Add() or AddConcurrently() into arena memory.
+  const char* EncodeEntry(SequenceNumber seq, ValueType type,
+                          const Slice& key, const Slice& value,
+                          bool concurrent);
+
   KeyComparator comparator_;
   int refs_;
   Arena arena_;
@@ -2,19 +2,43 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <functional>
+
 #include "gtest/gtest.h"
 #include "db/db_impl.h"
 #include "db/filename.h"
+#include "db/log_format.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/iterator.h"
 #include "leveldb/write_batch.h"
 #include "util/logging.h"
 #include "util/testutil.h"
 
 namespace leveldb {
 
+// Fails to open one file for sequential reads.
+class UnopenableFileEnv : public EnvWrapper {
+ public:
+  UnopenableFileEnv() : EnvWrapper(Env::Default()) {}
+
+  void SetUnopenableFile(const std::string& fname) { unopenable_ = fname; }
+
+  Status NewSequentialFile(const std::string& fname,
+                           SequentialFile** result) override {
+    if (fname == unopenable_) {
+      *result = nullptr;
+      return Status::IOError(fname, "unopenable");
+    }
+    return target()->NewSequentialFile(fname, result);
+  }
+
+ private:
+  std::string unopenable_;
+};
+
 class RecoveryTest : public testing::Test {
  public:
   RecoveryTest() : env_(Env::Default()), db_(nullptr) {
@@ -152,6 +176,76 @@ class RecoveryTest : public testing::Test {
     delete file;
   }
 
+  // Directly construct a log file holding a single raw record.
+  void MakeRawLogFile(uint64_t lognum, Slice record) {
+    std::string fname = LogFileName(dbname_, lognum);
+    WritableFile* file;
+    ASSERT_LEVELDB_OK(env_->NewWritableFile(fname, &file));
+    log::Writer writer(file);
+    ASSERT_LEVELDB_OK(writer.AddRecord(record));
+    ASSERT_LEVELDB_OK(file->Flush());
+    delete file;
+  }
+
+  // Flip a bit in the payload of the first record of a log file, so that
+  // its checksum no longer matches.
+  void CorruptLogFile(uint64_t lognum) {
+    std::string fname = LogFileName(dbname_, lognum);
+    std::string contents;
+    ASSERT_LEVELDB_OK(ReadFileToString(env_, fname, &contents));
+    ASSERT_LT(log::kHeaderSize, contents.size());
+    contents[log::kHeaderSize] ^= 0x80;
+    ASSERT_LEVELDB_OK(WriteStringToFile(env_, contents, fname));
+  }
+
+  // Returns all the key/value pairs of the open database.
+  std::string Contents() {
+    std::string result;
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      result += iter->key().ToString() + "=" + iter->value().ToString() + ",";
+    }
+    EXPECT_LEVELDB_OK(iter->status());
+    delete iter;
+    return result;
+  }
+
+  // Rebuild the database from "foo=bar" and the logs that make_logs() adds
+  // after the given one, then recover it both serially and in parallel,
+  // with and without paranoid_checks.  Both recoveries must give the same
+  // status and contents; the serial outcomes are stored in *lenient and
+  // *paranoid.
+  void CheckParallelRecovery(const std::function<void(uint64_t)>& make_logs,
+                             Env* env, std::string* lenient,
+                             std::string* paranoid) {
+    for (int paranoid_checks = 0; paranoid_checks < 2; paranoid_checks++) {
+      std::string outcomes[2];
+      for (int parallel = 0; parallel < 2; parallel++) {
+        Close();
+        DestroyDB(dbname_, Options());
+        Open();
+        ASSERT_LEVELDB_OK(Put("foo", "bar"));
+        Close();
+        make_logs(FirstLogFile());
+
+        Options opt;
+        opt.reuse_logs = true;
+        opt.paranoid_checks = (paranoid_checks != 0);
+        opt.parallel_log_recovery = (parallel != 0);
+        opt.env = env;
+        Status s = OpenWithStatus(&opt);
+        outcomes[parallel] = s.ToString() + ";";
+        if (s.ok()) {
+          outcomes[parallel] += Contents();
+        }
+      }
+      ASSERT_EQ(outcomes[0], outcomes[1])
+          << "paranoid_checks=" << paranoid_checks;
+      *(paranoid_checks ? paranoid : lenient) = outcomes[0];
+    }
+    Close();
+  }
+
  private:
   std::string dbname_;
   Env* env_;
@@ -322,6 +416,124 @@ TEST_F(RecoveryTest, MultipleLogFiles) {
   ASSERT_EQ("there", Get("hi"));
 }
 
+TEST_F(RecoveryTest, ParallelRecovery) {
+  // Make a large log, followed by a few small ones.
+  const int kNum = 1000;
+  for (int i = 0; i < kNum; i++) {
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "%050d", i);
+    ASSERT_LEVELDB_OK(Put(buf, buf));
+  }
+  Close();
+  ASSERT_EQ(1, NumLogs());
+  uint64_t old_log = FirstLogFile();
+  MakeLogFile(old_log + 1, 2000, "hello", "world");
+  MakeLogFile(old_log + 2, 2001, "hi", "there");
+  char key7[100];
+  std::snprintf(key7, sizeof(key7), "%050d", 7);
+  MakeLogFile(old_log + 3, 2002, key7, "overwritten");
+
+  // Replay them into several memtables.
+  Options opt;
+  opt.reuse_logs = true;
+  opt.parallel_log_recovery = true;
+  opt.write_buffer_size = (kNum * 100) / 4;
+  Open(&opt);
+  ASSERT_LE(2, NumTables());
+  ASSERT_EQ(1, NumLogs());
+  ASSERT_LE(old_log + 3, FirstLogFile());
+  for (int i = 0; i < kNum; i++) {
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "%050d", i);
+    ASSERT_EQ(i == 7 ? std::string("overwritten") : std::string(buf),
+              Get(buf));
+  }
+  ASSERT_EQ("world", Get("hello"));
+  ASSERT_EQ("there", Get("hi"));
+
+  // The last sequence number was recovered, so new writes win.
+  ASSERT_LEVELDB_OK(Put("hello", "again"));
+  Open(&opt);
+  ASSERT_EQ("again", Get("hello"));
+  ASSERT_EQ("there", Get("hi"));
+}
+
+TEST_F(RecoveryTest, ParallelRecoveryOfLargeLog) {
+  // Make a log much larger than the amount that the parallel recovery
+  // buffers, so that it is passed between the stages in many chunks and
+  // the reading stage has to wait for the insertions.
+  Options opt;
+  opt.reuse_logs = true;
+  opt.write_buffer_size = 64 << 20;
+  Open(&opt);
+  const int kNum = 2000;
+  const int kValueSize = 10000;
+  for (int i = 0; i < kNum; i++) {
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "%016d", i);
+    ASSERT_LEVELDB_OK(Put(buf, std::string(kValueSize, 'a' + i % 26)));
+  }
+  Close();
+  ASSERT_EQ(0, NumTables());
+  ASSERT_EQ(1, NumLogs());
+  uint64_t old_log = FirstLogFile();
+  ASSERT_LT(16 << 20, FileSize(LogName(old_log)));
+
+  opt.parallel_log_recovery = true;
+  opt.write_buffer_size = 4 << 20;
+  Open(&opt);
+  ASSERT_LE(4, NumTables());
+  ASSERT_NE(old_log, FirstLogFile()) << "must not reuse log";
+  for (int i = 0; i < kNum; i++) {
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "%016d", i);
+    ASSERT_EQ(std::string(kValueSize, 'a' + i % 26), Get(buf));
+  }
+}
+
+TEST_F(RecoveryTest, ParallelRecoveryOfCorruptedRecord) {
+  std::string lenient, paranoid;
+  CheckParallelRecovery(
+      [this](uint64_t old_log) {
+        MakeLogFile(old_log + 1, 1000, "hello", "world");
+        MakeLogFile(old_log + 2, 1001, "hi", "there");
+        MakeLogFile(old_log + 3, 1002, "foo", "bar2");
+        CorruptLogFile(old_log + 2);
+      },
+      env(), &lenient, &paranoid);
+  ASSERT_EQ("OK;foo=bar2,hello=world,", lenient);
+  ASSERT_EQ(0, paranoid.find("Corruption: checksum mismatch;")) << paranoid;
+}
+
+TEST_F(RecoveryTest, ParallelRecoveryOfShortRecord) {
+  std::string lenient, paranoid;
+  CheckParallelRecovery(
+      [this](uint64_t old_log) {
+        MakeLogFile(old_log + 1, 1000, "hello", "world");
+        MakeRawLogFile(old_log + 2, "short");
+        MakeLogFile(old_log + 3, 1002, "foo", "bar2");
+      },
+      env(), &lenient, &paranoid);
+  ASSERT_EQ("OK;foo=bar2,hello=world,", lenient);
+  ASSERT_EQ("Corruption: log record too small;", paranoid);
+}
+
+TEST_F(RecoveryTest, ParallelRecoveryOfUnopenableLog) {
+  UnopenableFileEnv unopenable_env;
+  std::string lenient, paranoid;
+  CheckParallelRecovery(
+      [this, &unopenable_env](uint64_t old_log) {
+        MakeLogFile(old_log + 1, 1000, "hello", "world");
+        MakeLogFile(old_log + 2, 1001, "hi", "there");
+        MakeLogFile(old_log + 3, 1002, "foo", "bar2");
+        unopenable_env.SetUnopenableFile(LogName(old_log + 2));
+      },
+      &unopenable_env, &lenient, &paranoid);
+  ASSERT_EQ("OK;foo=bar2,hello=world,", lenient);
+  ASSERT_EQ(0, paranoid.find("IO error: ")) << paranoid;
+  ASSERT_NE(std::string::npos, paranoid.find("unopenable")) << paranoid;
+}
+
 TEST_F(RecoveryTest, ManifestMissing) {
   ASSERT_LEVELDB_OK(Put("foo", "bar"));
   Close();
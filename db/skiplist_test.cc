@@ -6,6 +6,8 @@
 
 #include <atomic>
 #include <set>
+#include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "leveldb/env.h"
@@ -125,6 +127,39 @@ TEST(SkipTest, InsertAndLookup) {
   }
 }
 
+TEST(SkipTest, InsertConcurrently) {
+  const int kThreads = 4;
+  const int kKeysPerThread = 20000;
+  Arena arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+
+  // Interleave the keys of the threads so that they keep racing to link
+  // nodes next to each other.
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&list, t]() {
+      for (int i = 0; i < kKeysPerThread; i++) {
+        list.InsertConcurrently(static_cast<Key>(i) * kThreads + t);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  Key expected = 0;
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    ASSERT_EQ(expected, iter.key());
+    expected++;
+  }
+  ASSERT_EQ(static_cast<Key>(kThreads) * kKeysPerThread, expected);
+  for (Key k = 0; k < expected; k += 97) {
+    ASSERT_TRUE(list.Contains(k));
+  }
+}
+
 // We want to make sure that with a single writer and multiple
 // concurrent readers (with no synchronization other than when a
 // reader's iterator is created), the reader always observes all the
@@ -4,25 +4,134 @@
 
 #include "db/table_cache.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "db/filename.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
+namespace {
+
+// Reads the input file of a compaction, of "file_size" bytes, in chunks of
+// "readahead_size" bytes: a read that misses the buffer fills it from its
+// offset on, so that the reads of the blocks that follow are served from
+// memory.  Reads of at least "readahead_size" bytes go straight to the
+// file.
+class ReadaheadRandomAccessFile : public RandomAccessFile {
+ public:
+  // The new instance owns "file".
+  ReadaheadRandomAccessFile(RandomAccessFile* file, uint64_t file_size,
+                            size_t readahead_size)
+      : file_(file),
+        file_size_(file_size),
+        readahead_size_(readahead_size),
+        buffer_(nullptr),
+        buffer_offset_(0),
+        buffer_size_(0) {}
+
+  ~ReadaheadRandomAccessFile() override {
+    delete[] buffer_;
+    delete file_;
+  }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    if (n >= readahead_size_) {
+      return file_->Read(offset, n, result, scratch);
+    }
+
+    MutexLock l(&mu_);
+    if (!ReadFromBuffer(offset, n, result, scratch)) {
+      if (offset >= file_size_) {
+        *result = Slice();
+        return Status::OK();
+      }
+      if (buffer_ == nullptr) {
+        buffer_ = new char[readahead_size_];
+      }
+      // Some files do not allow reads past their end.
+      const size_t size = static_cast<size_t>(
+          std::min<uint64_t>(readahead_size_, file_size_ - offset));
+      Slice contents;
+      Status s = file_->Read(offset, size, &contents, buffer_);
+      if (!s.ok()) {
+        buffer_size_ = 0;
+        *result = Slice();
+        return s;
+      }
+      if (contents.data() != buffer_) {
+        // The file returned its own memory (e.g. a mapped region).
+        std::memcpy(buffer_, contents.data(), contents.size());
+      }
+      buffer_offset_ = offset;
+      buffer_size_ = contents.size();
+      if (!ReadFromBuffer(offset, n, result, scratch)) {
+        *result = Slice();  // The file is shorter than file_size_
+      }
+    }
+    return Status::OK();
+  }
+
+  // The file is read in large chunks anyway.
+  Status Prefetch(uint64_t offset, size_t n) const override {
+    return Status::OK();
+  }
+
+ private:
+  // Copies the part of [offset, offset + n) that the buffer holds to
+  // scratch and returns true, unless the buffer would have to be refilled
+  // for the read.
+  bool ReadFromBuffer(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const uint64_t buffer_end = buffer_offset_ + buffer_size_;
+    const bool at_eof = buffer_end >= file_size_;
+    if (buffer_size_ == 0 || offset < buffer_offset_ ||
+        (offset + n > buffer_end && !(at_eof && offset <= buffer_end))) {
+      return false;
+    }
+    const size_t size =
+        static_cast<size_t>(std::min<uint64_t>(n, buffer_end - offset));
+    std::memcpy(scratch, buffer_ + (offset - buffer_offset_), size);
+    *result = Slice(scratch, size);
+    return true;
+  }
+
+  RandomAccessFile* const file_;
+  const uint64_t file_size_;
+  const size_t readahead_size_;
+
+  mutable port::Mutex mu_;
+  // Holds buffer_size_ bytes read from the file at buffer_offset_.
+  mutable char* buffer_ GUARDED_BY(mu_);
+  mutable uint64_t buffer_offset_ GUARDED_BY(mu_);
+  mutable size_t buffer_size_ GUARDED_BY(mu_);
+};
+
+}  // namespace
+
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
 };
 
-static void DeleteEntry(const Slice& key, void* value) {
-  TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+static void DeleteTableAndFile(void* arg, void* ignored) {
+  TableAndFile* tf = reinterpret_cast<TableAndFile*>(arg);
   delete tf->table;
   delete tf->file;
   delete tf;
 }
 
+static void DeleteEntry(const Slice& key, void* value) {
+  DeleteTableAndFile(value, nullptr);
+}
+
 static void UnrefEntry(void* arg1, void* arg2) {
   Cache* cache = reinterpret_cast<Cache*>(arg1);
   Cache::Handle* h = reinterpret_cast<Cache::Handle*>(arg2);
@@ -38,7 +147,24 @@ TableCache::TableCache(const std::string& dbname, const Options& options,
 
 TableCache::~TableCache() { delete cache_; }
 
-Status TableCache::FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle** handle) {
+Status TableCache::OpenTableFile(uint64_t file_number, bool direct,
+                                 RandomAccessFile** file) {
+  std::string fname = TableFileName(dbname_, file_number);
+  Status s = direct ? env_->NewDirectRandomAccessFile(fname, file)
+                    : env_->NewRandomAccessFile(fname, file);
+  if (!s.ok()) {
+    std::string old_fname = SSTTableFileName(dbname_, file_number);
+    Status old_s = direct ? env_->NewDirectRandomAccessFile(old_fname, file)
+                          : env_->NewRandomAccessFile(old_fname, file);
+    if (old_s.ok()) {
+      s = Status::OK();
+    }
+  }
+  return s;
+}
+
+Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
+                             int level, Cache::Handle** handle) {
   // 以file_number为key查找
   Status s;
   char buf[sizeof(file_number)];
@@ -50,18 +176,14 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size, Cache::Ha
     return s;
   }
 
-  std::string fname = TableFileName(dbname_, file_number);
   RandomAccessFile* file = nullptr;
   Table* table = nullptr;
-  s = env_->NewRandomAccessFile(fname, &file);
-  if (!s.ok()) {
-    std::string old_fname = SSTTableFileName(dbname_, file_number);
-    if (env_->NewRandomAccessFile(old_fname, &file).ok()) {
-      s = Status::OK();
-    }
-  }
+  s = OpenTableFile(file_number, options_.use_direct_reads, &file);
   if (s.ok()) {
-    s = Table::Open(options_, file, file_size, &table);
+    const bool pin_meta_blocks =
+        level == 0 && options_.pin_l0_filter_and_index_blocks_in_cache;
+    s = Table::Open(options_, file, file_size, file_number, pin_meta_blocks,
+                    &table);
   }
 
   if (!s.ok()) {
@@ -80,13 +202,13 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size, Cache::Ha
 
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number, uint64_t file_size,
-                                  Table** tableptr) {
+                                  int level, Table** tableptr) {
   if (tableptr != nullptr) {
     *tableptr = nullptr;
   }
 
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, level, &handle);
   if (!s.ok()) {
     return NewErrorIterator(s);
   }
@@ -100,12 +222,57 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+Iterator* TableCache::NewCompactionIterator(const ReadOptions& options,
+                                            uint64_t file_number,
+                                            uint64_t file_size, int level) {
+  if (!options_.use_direct_io_for_compaction &&
+      options_.compaction_readahead_size == 0) {
+    return NewIterator(options, file_number, file_size, level);
+  }
+
+  // The blocks are read once and not cached, and those of the table
+  // cache are not looked up, since they would be under another cache id.
+  Options table_options = options_;
+  table_options.block_cache = nullptr;
+  table_options.block_cache_compressed = nullptr;
+  table_options.cache_index_and_filter_blocks = false;
+  // The operating system does not read ahead of direct I/O, so unless
+  // the file is read in large chunks, the iterator reads ahead itself.
+  table_options.use_direct_reads =
+      options_.use_direct_io_for_compaction &&
+      options_.compaction_readahead_size == 0;
+  RandomAccessFile* file = nullptr;
+  Table* table = nullptr;
+  Status s = OpenTableFile(file_number, options_.use_direct_io_for_compaction,
+                           &file);
+  if (s.ok() && options_.compaction_readahead_size > 0) {
+    file = new ReadaheadRandomAccessFile(file, file_size,
+                                         options_.compaction_readahead_size);
+  }
+  if (s.ok()) {
+    s = Table::Open(table_options, file, file_size, file_number, false,
+                    &table);
+  }
+  if (!s.ok()) {
+    assert(table == nullptr);
+    delete file;
+    return NewErrorIterator(s);
+  }
+  TableAndFile* tf = new TableAndFile;
+  tf->file = file;
+  tf->table = table;
+  Iterator* result = table->NewIterator(options);
+  result->RegisterCleanup(&DeleteTableAndFile, tf, nullptr);
+  return result;
+}
+
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
-                       uint64_t file_size, const Slice& k, void* arg,
+                       uint64_t file_size, int level, const Slice& k,
+                       void* arg,
                        void (*handle_result)(void*, const Slice&,
                                              const Slice&)) {
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, level, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
     s = t->InternalGet(options, k, arg, handle_result);
@@ -114,6 +281,34 @@ Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
   return s;
 }
 
+void TableCache::MultiGet(const ReadOptions& options, uint64_t file_number,
+                          uint64_t file_size, int level, int n,
+                          const Slice* keys, void** args, Status* statuses,
+                          void (*handle_result)(void*, const Slice&,
+                                                const Slice&)) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, level, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    t->InternalMultiGet(options, n, keys, args, statuses, handle_result);
+    cache_->Release(handle);
+  } else {
+    for (int i = 0; i < n; i++) {
+      statuses[i] = s;
+    }
+  }
+}
+
+Status TableCache::Preload(uint64_t file_number, uint64_t file_size,
+                           int level) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, level, &handle);
+  if (s.ok()) {
+    cache_->Release(handle);
+  }
+  return s;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
@@ -29,26 +29,60 @@ class TableCache {
   ~TableCache();
 
   // Return an iterator for the specified file number (the corresponding
-  // file length must be exactly "file_size" bytes).  If "tableptr" is
+  // file length must be exactly "file_size" bytes).  "level" is the level
+  // of the file in the current version, or -1 if it is unknown; it is used
+  // when the table gets opened (see
+  // Options::pin_l0_filter_and_index_blocks_in_cache).  If "tableptr" is
   // non-null, also sets "*tableptr" to point to the Table object
   // underlying the returned iterator, or to nullptr if no Table object
   // underlies the returned iterator.  The returned "*tableptr" object is owned
   // by the cache and should not be deleted, and is valid for as long as the
   // returned iterator is live.
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
-                        uint64_t file_size, Table** tableptr = nullptr);
+                        uint64_t file_size, int level,
+                        Table** tableptr = nullptr);
+
+  // Like NewIterator(), for an input file of a compaction.  With
+  // Options::use_direct_io_for_compaction or
+  // Options::compaction_readahead_size, the table is opened apart from the
+  // cache, on a file read with direct I/O or in large chunks, and closed
+  // once the returned iterator is deleted.
+  Iterator* NewCompactionIterator(const ReadOptions& options,
+                                  uint64_t file_number, uint64_t file_size,
+                                  int level);
 
   // If a seek to internal key "k" in specified file finds an entry,
   // call (*handle_result)(arg, found_key, found_value).
   Status Get(const ReadOptions& options, uint64_t file_number,
-             uint64_t file_size, const Slice& k, void* arg,
+             uint64_t file_size, int level, const Slice& k, void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&));
 
+  // Batched form of Get() for the "n" internal keys in "keys[]", which
+  // must be sorted in increasing order.  The table is looked up (and
+  // opened if necessary) once for the whole batch.  For each i, calls
+  // (*handle_result)(args[i], found_key, found_value) if a seek to keys[i]
+  // finds an entry and stores the outcome of that lookup in statuses[i].
+  void MultiGet(const ReadOptions& options, uint64_t file_number,
+                uint64_t file_size, int level, int n, const Slice* keys,
+                void** args,
+                Status* statuses,
+                void (*handle_result)(void*, const Slice&, const Slice&));
+
+  // Open the table for the specified file number if it is not open yet,
+  // and keep it in the cache.  Arguments are as for NewIterator().
+  Status Preload(uint64_t file_number, uint64_t file_size, int level);
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
  private:
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  Status FindTable(uint64_t file_number, uint64_t file_size, int level,
+                   Cache::Handle**);
+
+  // Opens the file of the table numbered "file_number", with direct I/O
+  // if "direct" is set.
+  Status OpenTableFile(uint64_t file_number, bool direct,
+                       RandomAccessFile** file);
 
   Env* const env_;
   const std::string dbname_;
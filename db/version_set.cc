@@ -64,6 +64,15 @@ static int64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
   return sum;
 }
 
+static bool AnyBeingCompacted(const std::vector<FileMetaData*>& files) {
+  for (size_t i = 0; i < files.size(); i++) {
+    if (files[i]->being_compacted) {
+      return true;
+    }
+  }
+  return false;
+}
+
 Version::~Version() {
   assert(refs_ == 0);
 
@@ -216,15 +225,32 @@ static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
     return cache->NewIterator(options, DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+                              DecodeFixed64(file_value.data() + 8), -1);
+  }
+}
+
+// Like GetFileIterator(), for the input files of a compaction.
+static Iterator* GetCompactionFileIterator(void* arg,
+                                           const ReadOptions& options,
+                                           const Slice& file_value) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 16) {
+    return NewErrorIterator(
+        Status::Corruption("FileReader invoked with unexpected value"));
+  } else {
+    return cache->NewCompactionIterator(options,
+                                        DecodeFixed64(file_value.data()),
+                                        DecodeFixed64(file_value.data() + 8),
+                                        -1);
   }
 }
 
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
+  // The index keys are the files' largest keys.
   return NewTwoLevelIterator(
       new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator,
-      vset_->table_cache_, options);
+      vset_->table_cache_, options, /*exact_index=*/true);
 }
 
 void Version::AddIterators(const ReadOptions& options,
@@ -232,7 +258,7 @@ void Version::AddIterators(const ReadOptions& options,
   // Merge all level zero files together since they may overlap
   for (size_t i = 0; i < files_[0].size(); i++) {
     iters->push_back(vset_->table_cache_->NewIterator(
-        options, files_[0][i]->number, files_[0][i]->file_size));
+        options, files_[0][i]->number, files_[0][i]->file_size, 0));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -359,8 +385,9 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->last_file_read_level = level;
 
       state->s = state->vset->table_cache_->Get(*state->options, f->number,
-                                                f->file_size, state->ikey,
-                                                &state->saver, SaveValue);
+                                                f->file_size, level,
+                                                state->ikey, &state->saver,
+                                                SaveValue);
       if (!state->s.ok()) {
         state->found = true;
         return false;
@@ -406,6 +433,159 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
+namespace {
+// Per-key state for Version::MultiGet().
+struct MultiGetKey {
+  Saver saver;
+  Slice ikey;
+  FileMetaData* last_file_read;
+  int last_file_read_level;
+  bool done;
+};
+}  // namespace
+
+void Version::MultiGet(const ReadOptions& options,
+                       const std::vector<const LookupKey*>& keys,
+                       const std::vector<std::string*>& vals,
+                       std::vector<Status>* statuses,
+                       std::vector<GetStats>* stats) {
+  const size_t n = keys.size();
+  const InternalKeyComparator& icmp = vset_->icmp_;
+  const Comparator* ucmp = icmp.user_comparator();
+  statuses->assign(n, Status::NotFound(Slice()));
+  stats->resize(n);
+
+  std::vector<MultiGetKey> state(n);
+  std::vector<uint32_t> pending(n);
+  for (size_t i = 0; i < n; i++) {
+    MultiGetKey* k = &state[i];
+    k->saver.state = kNotFound;
+    k->saver.ucmp = ucmp;
+    k->saver.user_key = keys[i]->user_key();
+    k->saver.value = vals[i];
+    k->ikey = keys[i]->internal_key();
+    k->last_file_read = nullptr;
+    k->last_file_read_level = -1;
+    k->done = false;
+    (*stats)[i].seek_file = nullptr;
+    (*stats)[i].seek_file_level = -1;
+    pending[i] = i;
+  }
+
+  // Visit the keys in internal key order so that each table file sees
+  // its share of the batch as one sorted run.
+  std::stable_sort(pending.begin(), pending.end(),
+                   [&state, &icmp](uint32_t a, uint32_t b) {
+                     return icmp.Compare(state[a].ikey, state[b].ikey) < 0;
+                   });
+
+  std::vector<uint32_t> batch;
+  std::vector<Slice> batch_keys;
+  std::vector<void*> batch_args;
+  std::vector<Status> batch_status;
+
+  // Look up every key in "batch" in file "f" and record the outcome the
+  // same way Version::Get() does for a single key.
+  auto search_file = [&](int level, FileMetaData* f) {
+    if (batch.empty()) return;
+    const int m = static_cast<int>(batch.size());
+    batch_keys.resize(m);
+    batch_args.resize(m);
+    batch_status.resize(m);
+    for (int j = 0; j < m; j++) {
+      MultiGetKey* k = &state[batch[j]];
+      GetStats* s = &(*stats)[batch[j]];
+      if (s->seek_file == nullptr && k->last_file_read != nullptr) {
+        // We have had more than one seek for this read.  Charge the 1st file.
+        s->seek_file = k->last_file_read;
+        s->seek_file_level = k->last_file_read_level;
+      }
+      k->last_file_read = f;
+      k->last_file_read_level = level;
+      batch_keys[j] = k->ikey;
+      batch_args[j] = &k->saver;
+    }
+    vset_->table_cache_->MultiGet(options, f->number, f->file_size, level, m,
+                                  &batch_keys[0], &batch_args[0],
+                                  &batch_status[0], SaveValue);
+    for (int j = 0; j < m; j++) {
+      MultiGetKey* k = &state[batch[j]];
+      Status* s = &(*statuses)[batch[j]];
+      if (!batch_status[j].ok()) {
+        *s = batch_status[j];
+        k->done = true;
+        continue;
+      }
+      switch (k->saver.state) {
+        case kNotFound:
+          break;  // Keep searching in other files
+        case kFound:
+          *s = Status::OK();
+          k->done = true;
+          break;
+        case kDeleted:
+          k->done = true;
+          break;
+        case kCorrupt:
+          *s = Status::Corruption("corrupted key for ", k->saver.user_key);
+          k->done = true;
+          break;
+      }
+    }
+    batch.clear();
+  };
+
+  // Search level-0 in order from newest to oldest.
+  std::vector<FileMetaData*> tmp(files_[0]);
+  std::sort(tmp.begin(), tmp.end(), NewestFirst);
+  for (FileMetaData* f : tmp) {
+    for (uint32_t i : pending) {
+      const Slice user_key = state[i].saver.user_key;
+      if (!state[i].done &&
+          ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+          ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+        batch.push_back(i);
+      }
+    }
+    search_file(0, f);
+  }
+
+  // Search other levels.  Since "pending" is sorted, the keys that map to
+  // a given file in a level form a contiguous run.
+  for (int level = 1; level < config::kNumLevels; level++) {
+    size_t num_files = files_[level].size();
+    if (num_files == 0) continue;
+
+    size_t live = 0;
+    for (uint32_t i : pending) {
+      if (!state[i].done) pending[live++] = i;
+    }
+    pending.resize(live);
+    if (pending.empty()) break;
+
+    FileMetaData* batch_file = nullptr;
+    for (uint32_t i : pending) {
+      MultiGetKey* k = &state[i];
+      uint32_t index = FindFile(icmp, files_[level], k->ikey);
+      FileMetaData* f = nullptr;
+      if (index < num_files) {
+        f = files_[level][index];
+        if (ucmp->Compare(k->saver.user_key, f->smallest.user_key()) < 0) {
+          // All of "f" is past any data for user_key
+          f = nullptr;
+        }
+      }
+      if (f == nullptr) continue;
+      if (f != batch_file) {
+        search_file(level, batch_file);
+        batch_file = f;
+      }
+      batch.push_back(i);
+    }
+    search_file(level, batch_file);
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -483,7 +663,9 @@ int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
     InternalKey limit(largest_user_key, 0, static_cast<ValueType>(0));
     std::vector<FileMetaData*> overlaps;
     while (level < config::kMaxMemCompactLevel) {
-      if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
+      if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key) ||
+          vset_->OutputRangeInUse(level + 1, smallest_user_key,
+                                  largest_user_key)) {
         break;
       }
       if (level + 2 < config::kNumLevels) {
@@ -1055,6 +1237,7 @@ void VersionSet::Finalize(Version* v) {
       score = static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
     }
 
+    v->compaction_scores_[level] = score;
     if (score > best_score) {
       best_level = level;
       best_score = score;
@@ -1133,8 +1316,9 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
         // "ikey" falls in the range for this table.  Add the
         // approximate offset of "ikey" within the table.
         Table* tableptr;
-        Iterator* iter = table_cache_->NewIterator(
-            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
+        Iterator* iter =
+            table_cache_->NewIterator(ReadOptions(), files[i]->number,
+                                      files[i]->file_size, level, &tableptr);
         if (tableptr != nullptr) {
           result += tableptr->ApproximateOffsetOf(ikey.Encode());
         }
@@ -1163,6 +1347,34 @@ int64_t VersionSet::NumLevelBytes(int level) const {
   return TotalFileSize(current_->files_[level]);
 }
 
+int64_t VersionSet::EstimatedPendingCompactionBytes() const {
+  int64_t result = 0;
+  int64_t carried = 0;  // Bytes pushed down from the level above
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    const int64_t level_bytes = TotalFileSize(files) + carried;
+    int64_t excess;
+    if (level == 0) {
+      const int num_files = static_cast<int>(files.size());
+      excess = num_files >= config::kL0_CompactionTrigger ? level_bytes : 0;
+    } else {
+      excess = std::max<int64_t>(
+          level_bytes - static_cast<int64_t>(MaxBytesForLevel(options_, level)),
+          0);
+    }
+    if (excess > 0) {
+      // Moving the excess down also rewrites the overlapping part of the
+      // next level, which is assumed to be spread evenly over the keys.
+      const int64_t next_bytes = TotalFileSize(current_->files_[level + 1]);
+      result += excess + static_cast<int64_t>(
+                             static_cast<double>(excess) * next_bytes /
+                             std::max<int64_t>(level_bytes, 1));
+    }
+    carried = excess;
+  }
+  return result;
+}
+
 int64_t VersionSet::MaxNextLevelOverlappingBytes() {
   int64_t result = 0;
   std::vector<FileMetaData*> overlaps;
@@ -1229,12 +1441,14 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];  
         // 每个文件一个迭代器
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]->number, files[i]->file_size);
+          list[num++] = table_cache_->NewCompactionIterator(
+              options, files[i]->number, files[i]->file_size, 0);
         }
       } else { // level≥1
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
-            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]), &GetFileIterator, table_cache_, options);
+            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
+            &GetCompactionFileIterator, table_cache_, options);
       }
     }
   }
@@ -1246,49 +1460,58 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
 
 // 找出level和level+1中的待压文件列表，存储到Compaction::inputs_中
 Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
-   
+  Compaction* c = nullptr;
+
   //===================================================
-  // 先检查是否有满足compact条件的level和file，将此level和file为compact的基础
-  // 如果是第0层，则还要找到所有和file有重叠的文件，作为compact基础
+  // 触发压缩的时机：a.某levle中数据太多 b.搜索(seek)
+  // 我们更倾向a（即先测试size_compaction）
   //===================================================
-  //   触发压缩的时机：a.某levle中数据太多 b.搜索(seek) 
-  //   我们更倾向a（即先测试size_compaction）
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {
-    // 1. 决定要进行压缩的 level，以该 level 构建 Compaction 实例
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);    
-    c = new Compaction(options_, level);
-
-    // 2. 在该层中，选择一个文件
-    // 2.1 先选择 最大Key > 上次压缩文件的最大Key 的文件
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
-        break;
-      }
+  // Try the levels that need a size compaction in decreasing order of
+  // score.  Within a level, start with the first file after the level's
+  // compact_pointer_ and skip files that are already being compacted.
+  int levels[config::kNumLevels - 1];
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    levels[level] = level;
+  }
+  const Version* v = current_;
+  std::stable_sort(levels, levels + config::kNumLevels - 1,
+                   [v](int a, int b) {
+                     return v->compaction_scores_[a] > v->compaction_scores_[b];
+                   });
+  for (int i = 0; i < config::kNumLevels - 1 && c == nullptr; i++) {
+    const int level = levels[i];
+    if (current_->compaction_scores_[level] < 1) {
+      break;
     }
-    // 2.2 如果没有这样的文件，则选择第一个文件
-    if (c->inputs_[0].empty()) {
-      c->inputs_[0].push_back(current_->files_[level][0]);
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    size_t start = 0;
+    while (start < files.size() && !compact_pointer_[level].empty() &&
+           icmp_.Compare(files[start]->largest.Encode(),
+                         compact_pointer_[level]) <= 0) {
+      start++;
     }
-  } else if (seek_compaction) {
-    // 直接选择上次算出来的层和对应文件
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return nullptr;
+    for (size_t j = 0; j < files.size() && c == nullptr; j++) {
+      FileMetaData* f = files[(start + j) % files.size()];
+      if (!f->being_compacted) {
+        c = PickCompactionForFile(level, f);
+      }
+    }
+  }
+
+  // 直接选择上次算出来的层和对应文件
+  FileMetaData* seek_file = current_->file_to_compact_;
+  if (c == nullptr && seek_file != nullptr && !seek_file->being_compacted) {
+    c = PickCompactionForFile(current_->file_to_compact_level_, seek_file);
   }
 
-  // c->inputs_[0] 只有一个文件
+  return c;
+}
 
+Compaction* VersionSet::PickCompactionForFile(int level, FileMetaData* f) {
+  assert(level >= 0);
+  assert(level + 1 < config::kNumLevels);
+  Compaction* c = new Compaction(options_, level);
+  c->inputs_[0].push_back(f);
   c->input_version_ = current_;
   c->input_version_->Ref();
 
@@ -1303,8 +1526,10 @@ Compaction* VersionSet::PickCompaction() {
     assert(!c->inputs_[0].empty());
   }
 
-  SetupOtherInputs(c);
-
+  if (!SetupOtherInputs(c)) {
+    delete c;
+    return nullptr;
+  }
   return c;
 }
 
@@ -1381,7 +1606,7 @@ void AddBoundaryInputs(const InternalKeyComparator& icmp,
   }
 }
 
-void VersionSet::SetupOtherInputs(Compaction* c) {
+bool VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
   InternalKey smallest, largest;
 
@@ -1396,10 +1621,21 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   // 类似地，添加边界重叠的文件
   AddBoundaryInputs(icmp_, current_->files_[level + 1], &c->inputs_[1]);
 
+  // Inputs shared with a running compaction would be merged twice.
+  if (AnyBeingCompacted(c->inputs_[0]) || AnyBeingCompacted(c->inputs_[1])) {
+    return false;
+  }
+
   // 获取level和level+1中的所有候选文件的key范围
   InternalKey all_start, all_limit;
   GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
 
+  // The outputs may span the whole range, including gaps between the
+  // level+1 inputs that another running compaction may be filling.
+  if (OutputRangeInUse(level + 1, all_start.user_key(), all_limit.user_key())) {
+    return false;
+  }
+
   // 看看能否在不改变“level+1”文件数量的情况下增加“level”中的输入数量
   if (!c->inputs_[1].empty()) {
     std::vector<FileMetaData*> expanded0;
@@ -1409,13 +1645,18 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     const int64_t inputs1_size = TotalFileSize(c->inputs_[1]);
     const int64_t expanded0_size = TotalFileSize(expanded0);
     if (expanded0.size() > c->inputs_[0].size() &&
-        inputs1_size + expanded0_size < ExpandedCompactionByteSizeLimit(options_)) {
+        inputs1_size + expanded0_size < ExpandedCompactionByteSizeLimit(options_) &&
+        !AnyBeingCompacted(expanded0)) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
       current_->GetOverlappingInputs(level + 1, &new_start, &new_limit, &expanded1);
       AddBoundaryInputs(icmp_, current_->files_[level + 1], &expanded1);
-      if (expanded1.size() == c->inputs_[1].size()) {
+      InternalKey expanded_start, expanded_limit;
+      GetRange2(expanded0, expanded1, &expanded_start, &expanded_limit);
+      if (expanded1.size() == c->inputs_[1].size() &&
+          !OutputRangeInUse(level + 1, expanded_start.user_key(),
+                            expanded_limit.user_key())) {
         Log(options_->info_log,
             "Expanding@%d %d+%d (%ld+%ld bytes) to %d+%d (%ld+%ld bytes)\n",
             level, int(c->inputs_[0].size()), int(c->inputs_[1].size()),
@@ -1441,6 +1682,56 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   // 这样若压缩失败，下次将尝试不同的键范围
   compact_pointer_[level] = largest.Encode().ToString();
   c->edit_.SetCompactPointer(level, largest);
+
+  c->smallest_ = all_start;
+  c->largest_ = all_limit;
+  c->MarkInputsBeingCompacted(true);
+  return true;
+}
+
+void VersionSet::AddOutputRange(int level, const InternalKey& smallest,
+                                const InternalKey& largest) {
+  output_ranges_[level].emplace_back(smallest, largest);
+}
+
+void VersionSet::RemoveOutputRange(int level, const InternalKey& smallest,
+                                   const InternalKey& largest) {
+  std::vector<std::pair<InternalKey, InternalKey>>& ranges =
+      output_ranges_[level];
+  for (size_t i = 0; i < ranges.size(); i++) {
+    if (ranges[i].first.Encode() == smallest.Encode() &&
+        ranges[i].second.Encode() == largest.Encode()) {
+      ranges.erase(ranges.begin() + i);
+      return;
+    }
+  }
+  assert(false);
+}
+
+void VersionSet::AddOutputRanges(const VersionEdit& edit) {
+  for (const auto& new_file : edit.new_files_) {
+    AddOutputRange(new_file.first, new_file.second.smallest,
+                   new_file.second.largest);
+  }
+}
+
+void VersionSet::RemoveOutputRanges(const VersionEdit& edit) {
+  for (const auto& new_file : edit.new_files_) {
+    RemoveOutputRange(new_file.first, new_file.second.smallest,
+                      new_file.second.largest);
+  }
+}
+
+bool VersionSet::OutputRangeInUse(int level, const Slice& smallest_user_key,
+                                  const Slice& largest_user_key) const {
+  const Comparator* ucmp = icmp_.user_comparator();
+  for (const auto& range : output_ranges_[level]) {
+    if (ucmp->Compare(smallest_user_key, range.second.user_key()) <= 0 &&
+        ucmp->Compare(largest_user_key, range.first.user_key()) >= 0) {
+      return true;
+    }
+  }
+  return false;
 }
 
 Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
@@ -1472,7 +1763,10 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
   c->input_version_ = current_;
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
-  SetupOtherInputs(c);
+  if (!SetupOtherInputs(c)) {
+    delete c;
+    return nullptr;
+  }
   return c;
 }
 
@@ -1480,6 +1774,7 @@ Compaction::Compaction(const Options* options, int level)
     : level_(level),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       input_version_(nullptr),
+      inputs_marked_(false),
       grandparent_index_(0),
       seen_key_(false),
       overlapped_bytes_(0) {
@@ -1490,10 +1785,29 @@ Compaction::Compaction(const Options* options, int level)
 
 Compaction::~Compaction() {
   if (input_version_ != nullptr) {
+    if (inputs_marked_) {
+      MarkInputsBeingCompacted(false);
+    }
     input_version_->Unref();
   }
 }
 
+void Compaction::MarkInputsBeingCompacted(bool value) {
+  inputs_marked_ = value;
+  VersionSet* vset = input_version_->vset_;
+  if (value) {
+    vset->AddOutputRange(level_ + 1, smallest_, largest_);
+  } else {
+    vset->RemoveOutputRange(level_ + 1, smallest_, largest_);
+  }
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      assert(inputs_[which][i]->being_compacted != value);
+      inputs_[which][i]->being_compacted = value;
+    }
+  }
+}
+
 bool Compaction::IsTrivialMove() const {
   const VersionSet* vset = input_version_->vset_;
   // Avoid a move if there is lots of overlapping grandparent data.
@@ -1559,6 +1873,9 @@ bool Compaction::ShouldStopBefore(const Slice& internal_key) {
 
 void Compaction::ReleaseInputs() {
   if (input_version_ != nullptr) {
+    if (inputs_marked_) {
+      MarkInputsBeingCompacted(false);
+    }
     input_version_->Unref();
     input_version_ = nullptr;
   }
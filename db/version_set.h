@@ -75,6 +75,16 @@ class Version {
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
 
+  // Batched form of Get().  For each i, looks up *keys[i] and stores the
+  // result in *vals[i] and (*statuses)[i], and its seek stats in
+  // (*stats)[i].  Keys are visited in sorted order so that all of the
+  // keys that need to be looked up in a given table file are handed to
+  // it in a single TableCache::MultiGet() call.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, const std::vector<const LookupKey*>& keys,
+                const std::vector<std::string*>& vals,
+                std::vector<Status>* statuses, std::vector<GetStats>* stats);
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -106,6 +116,8 @@ class Version {
 
   // Return the level at which we should place a new memtable compaction
   // result that covers the range [smallest_user_key,largest_user_key].
+  // The result is never pushed into a level where a compaction or flush
+  // that is still in progress may write keys of that range.
   int PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                  const Slice& largest_user_key);
 
@@ -128,7 +140,11 @@ class Version {
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1) {
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      compaction_scores_[level] = -1;
+    }
+  }
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -162,6 +178,10 @@ class Version {
   // are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
+
+  // Compaction score of every level that can be compacted; also
+  // initialized by Finalize().
+  double compaction_scores_[config::kNumLevels - 1];
 };
 
 class VersionSet {
@@ -208,6 +228,10 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
+  // Return an estimate of the number of bytes that compactions have to
+  // write before every level of the current version is within its limit.
+  int64_t EstimatedPendingCompactionBytes() const;
+
   // Return the last sequence number.
   uint64_t LastSequence() const { return last_sequence_; }
 
@@ -231,12 +255,20 @@ class VersionSet {
   // Returns nullptr if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
   // describes the compaction.  Caller should delete the result.
+  //
+  // Files that are inputs of compactions still in progress are never
+  // handed out again, nor are compactions that would write keys into a
+  // range of level+1 that a running one writes into, so several
+  // compactions returned by this method may run at the same time.
+  // Returns nullptr if every compaction that is needed would conflict
+  // with one that is already running.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns nullptr if there is nothing in that
   // level that overlaps the specified range.  Caller should delete
   // the result.
+  // REQUIRES: no other compaction or memtable flush is in progress.
   Compaction* CompactRange(int level, const InternalKey* begin,
                            const InternalKey* end);
 
@@ -248,6 +280,12 @@ class VersionSet {
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
+  // Record that the files added by "edit", which is not applied yet, are
+  // being written, so that no compaction or flush is placed in their key
+  // ranges until the matching RemoveOutputRanges(edit).
+  void AddOutputRanges(const VersionEdit& edit);
+  void RemoveOutputRanges(const VersionEdit& edit);
+
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
     Version* v = current_;
@@ -286,7 +324,27 @@ class VersionSet {
                  const std::vector<FileMetaData*>& inputs2,
                  InternalKey* smallest, InternalKey* largest);
 
-  void SetupOtherInputs(Compaction* c);
+  // Returns a compaction of "f" at "level" into "level+1", or nullptr if
+  // it would need an input that is already being compacted.
+  Compaction* PickCompactionForFile(int level, FileMetaData* f);
+
+  // Fill in the rest of the inputs of "c" and mark all of them as being
+  // compacted.  Returns false, leaving the compaction pointer of c's
+  // level untouched, if some of them are already being compacted or if
+  // a running compaction writes into the key range of c in level+1.
+  bool SetupOtherInputs(Compaction* c);
+
+  // Record [smallest,largest] as a key range that a compaction or flush
+  // in progress writes into "level", or forget one recorded before.
+  void AddOutputRange(int level, const InternalKey& smallest,
+                      const InternalKey& largest);
+  void RemoveOutputRange(int level, const InternalKey& smallest,
+                         const InternalKey& largest);
+
+  // Returns true iff a compaction or flush in progress writes into "level"
+  // some key of [smallest_user_key,largest_user_key].
+  bool OutputRangeInUse(int level, const Slice& smallest_user_key,
+                        const Slice& largest_user_key) const;
 
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
@@ -312,6 +370,11 @@ class VersionSet {
 
   // 每个级别下次压缩应开始的key：空字符串或有效的 InternalKey
   std::string compact_pointer_[config::kNumLevels];
+
+  // Key ranges that compactions and flushes in progress write into
+  // each level, as [smallest,largest] pairs.
+  std::vector<std::pair<InternalKey, InternalKey>>
+      output_ranges_[config::kNumLevels];
 };
 
 // A Compaction encapsulates information about a compaction.
@@ -362,6 +425,11 @@ class Compaction {
 
   Compaction(const Options* options, int level);
 
+  // Set the being_compacted flag of every input file to "value", and
+  // record or forget the key range that this compaction writes into
+  // level_+1.
+  void MarkInputsBeingCompacted(bool value);
+
   int level_;
   uint64_t max_output_file_size_;
   Version* input_version_;
@@ -369,6 +437,11 @@ class Compaction {
 
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
+  bool inputs_marked_;  // Are the inputs flagged as being_compacted?
+
+  // Range of the keys that this compaction writes into level_+1
+  InternalKey smallest_;
+  InternalKey largest_;
 
   // State used to check for number of overlapping grandparent files
   // (parent == level_ + 1, grandparent == level_ + 2)
@@ -5,7 +5,11 @@
 #include "db/version_set.h"
 
 #include "gtest/gtest.h"
+#include "db/table_cache.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 #include "util/testutil.h"
 
 namespace leveldb {
@@ -328,4 +332,77 @@ TEST_F(AddBoundaryInputsTest, TestDisjoinFilePointers) {
   ASSERT_EQ(f3, compaction_files_[2]);
 }
 
+class ConcurrentCompactionTest : public testing::Test {
+ public:
+  ConcurrentCompactionTest()
+      : dbname_(testing::TempDir() + "version_set_test"),
+        icmp_(BytewiseComparator()) {
+    DestroyDB(dbname_, options_);
+    EXPECT_LEVELDB_OK(options_.env->CreateDir(dbname_));
+    table_cache_ = new TableCache(dbname_, options_, 100);
+    vset_ = new VersionSet(dbname_, &options_, table_cache_, &icmp_);
+  }
+
+  ~ConcurrentCompactionTest() {
+    delete vset_;
+    delete table_cache_;
+    DestroyDB(dbname_, options_);
+  }
+
+  // Install a table of "file_size" bytes holding [smallest,largest] at
+  // "level", as a flush or compaction would.
+  void AddFile(int level, const char* smallest, const char* largest,
+               uint64_t file_size) {
+    VersionEdit edit;
+    edit.AddFile(level, vset_->NewFileNumber(), file_size,
+                 InternalKey(smallest, 100, kTypeValue),
+                 InternalKey(largest, 100, kTypeValue));
+    MutexLock l(&mu_);
+    ASSERT_LEVELDB_OK(vset_->LogAndApply(&edit, &mu_));
+  }
+
+  Compaction* CompactRange(int level, const char* begin, const char* end) {
+    InternalKey b(begin, kMaxSequenceNumber, kValueTypeForSeek);
+    InternalKey e(end, 0, static_cast<ValueType>(0));
+    return vset_->CompactRange(level, &b, &e);
+  }
+
+  int PickLevelForMemTableOutput(const char* smallest, const char* largest) {
+    return vset_->current()->PickLevelForMemTableOutput(smallest, largest);
+  }
+
+  VersionSet* vset_;
+
+ private:
+  const std::string dbname_;
+  Options options_;
+  InternalKeyComparator icmp_;
+  TableCache* table_cache_;
+  port::Mutex mu_;
+};
+
+TEST_F(ConcurrentCompactionTest, NoOverlappingOutputs) {
+  AddFile(1, "a", "c", 1000);
+  AddFile(1, "x", "z", 1000);
+
+  // Merging both files may produce a single level-2 table covering [a,z].
+  Compaction* running = CompactRange(1, "a", "z");
+  ASSERT_TRUE(running != nullptr);
+  ASSERT_EQ(2, running->num_input_files(0));
+
+  // A table that lands in the gap of level 1 meanwhile, filling it past
+  // its size limit, must not be compacted into level 2 yet.  Nor may a
+  // flush in that gap be pushed down to level 2.
+  AddFile(1, "m", "n", 20 << 20);
+  ASSERT_TRUE(vset_->NeedsCompaction());
+  ASSERT_TRUE(vset_->PickCompaction() == nullptr);
+  ASSERT_EQ(1, PickLevelForMemTableOutput("p", "q"));
+
+  delete running;
+  Compaction* c = vset_->PickCompaction();
+  ASSERT_TRUE(c != nullptr);
+  delete c;
+  ASSERT_EQ(2, PickLevelForMemTableOutput("p", "q"));
+}
+
 }  // namespace leveldb
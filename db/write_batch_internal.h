@@ -35,8 +35,17 @@ class WriteBatchInternal {
 
   static void SetContents(WriteBatch* batch, const Slice& contents);
 
+  // Like WriteBatch::Iterate(), for a batch with the given contents, which
+  // is iterated over in place.
+  static Status Iterate(const Slice& contents, WriteBatch::Handler* handler);
+
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  // Like InsertInto(), but uses MemTable::AddConcurrently() so that
+  // several batches can be inserted into "memtable" at once.
+  static Status InsertIntoConcurrently(const WriteBatch* batch,
+                                       MemTable* memtable);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
@@ -11,6 +11,8 @@
 #include "db/db_impl.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
 #include "util/testutil.h"
 
 namespace leveldb {
@@ -213,6 +215,37 @@ TEST_F(MemEnvTest, OverwriteOpenFile) {
   delete rand_file;
 }
 
+TEST_F(MemEnvTest, Schedule) {
+  struct RunState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    bool called = false;
+
+    static void Run(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->called = true;
+      state->cvar.Signal();
+    }
+  };
+
+  // Background work runs on the threads of the base Env.
+  Env::BackgroundStats before, stats;
+  env_->GetBackgroundStats(Env::HIGH, &before);
+  RunState state;
+  env_->Schedule(&RunState::Run, &state, Env::HIGH);
+  {
+    MutexLock l(&state.mu);
+    while (!state.called) {
+      state.cvar.Wait();
+    }
+  }
+  Env::Default()->GetBackgroundStats(Env::HIGH, &stats);
+  ASSERT_EQ(before.scheduled + 1, stats.scheduled);
+  ASSERT_EQ(env_->GetBackgroundThreads(Env::HIGH),
+            Env::Default()->GetBackgroundThreads(Env::HIGH));
+}
+
 TEST_F(MemEnvTest, DBTest) {
   Options options;
   options.create_if_missing = true;
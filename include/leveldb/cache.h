@@ -10,10 +10,11 @@
 // length strings, may use the length of the string as the charge for
 // the string.
 //
-// A builtin cache implementation with a least-recently-used eviction
-// policy is provided.  Clients may use their own implementations if
-// they want something more sophisticated (like scan-resistance, a
-// custom eviction policy, variable cache sizing, etc.)
+// Builtin cache implementations with a least-recently-used, a
+// scan-resistant (2Q) and a CLOCK eviction policy are provided.  Clients
+// may use their own implementations if they want something more
+// sophisticated (like a custom eviction policy, variable cache sizing,
+// etc.)
 
 #ifndef STORAGE_LEVELDB_INCLUDE_CACHE_H_
 #define STORAGE_LEVELDB_INCLUDE_CACHE_H_
@@ -27,10 +28,42 @@ namespace leveldb {
 
 class LEVELDB_EXPORT Cache;
 
+// The builtin caches are split into 2^num_shard_bits shards by key hash,
+// each with its own capacity and, except for the CLOCK cache, its own
+// mutex.  A negative num_shard_bits selects the default of 4 (16 shards);
+// more shards reduce lock contention between threads.
+
 // Create a new cache with a fixed size capacity.  This implementation
 // of Cache uses a least-recently-used eviction policy.
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), which uses the default number of shards and
+// a high_pri_pool_ratio of 0.5.  Entries inserted with Priority::kHigh are
+// only evicted once the low priority ones are gone, as long as they take
+// at most high_pri_pool_ratio of the capacity; beyond that, the least
+// recently used of them are treated as low priority.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, int num_shard_bits,
+                                  double high_pri_pool_ratio);
+
+// Create a new cache with a fixed size capacity that uses the 2Q eviction
+// policy: entries start out in a small FIFO queue, and only move to the
+// main LRU list when they are used again (or right away if inserted with
+// Priority::kHigh).  A scan through many entries
+// that are used once thus does not evict the entries that are used over
+// and over, as it does with an LRU cache.
+LEVELDB_EXPORT Cache* New2QCache(size_t capacity, int num_shard_bits = -1);
+
+// Create a new cache with a fixed size capacity that uses the CLOCK
+// eviction policy, an approximation of LRU.  Lookups and releases take no
+// locks, so the cache scales to many threads reading hot entries.
+// Entries are kept in a fixed-size table sized for capacity divided by
+// estimated_entry_charge (e.g. the block size for a block cache); entries
+// that do not fit in the table when it is full are not cached.  Entries
+// inserted with Priority::kHigh survive more turns of the clock hand.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity,
+                                    size_t estimated_entry_charge,
+                                    int num_shard_bits = -1);
+
 // 抽象的缓存接口
 class LEVELDB_EXPORT Cache {
  public:
@@ -46,6 +79,12 @@ class LEVELDB_EXPORT Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle {};
 
+  // How hard the cache should try to keep an entry, e.g. kHigh for the
+  // index and filter blocks of tables, which every read of a table needs,
+  // and kLow for data blocks.  Entries of either priority are evicted
+  // when the cache holds nothing else.
+  enum class Priority { kHigh, kLow };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -64,6 +103,13 @@ class LEVELDB_EXPORT Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Like Insert() above, with a "priority" for the entry.  The builtin
+  // caches prefer to evict entries of low priority.  The default
+  // implementation ignores the priority.
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority);
+
   // If the cache has no mapping for "key", returns nullptr.
   //
   // Else return a handle that corresponds to the mapping.  The caller
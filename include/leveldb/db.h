@@ -7,6 +7,8 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
@@ -87,6 +89,21 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Look up every key in "keys" as of a single implicit (or the supplied)
+  // snapshot.  On return, values->size() == statuses->size() ==
+  // keys.size(), and for each i (*statuses)[i] and (*values)[i] hold
+  // what Get(options, keys[i], &(*values)[i]) would have produced.
+  //
+  // This is cheaper than calling Get() once per key: the DB state is
+  // pinned once for the whole batch and lookups that land in the same
+  // table file share the work of consulting its index and filter.
+  //
+  // The default implementation simply calls Get() for every key.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -121,6 +138,8 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.background-stats" - returns a multi-line string that describes
+  //     the background threads of the Env and the work queued for them.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -57,6 +57,24 @@ class LEVELDB_EXPORT Env {
 
   virtual ~Env();
 
+  // Background work is queued and run separately for each priority, so
+  // HIGH priority work never waits behind LOW priority work.
+  enum Priority { LOW, HIGH };
+
+  // Statistics about the background work of one priority, as returned by
+  // GetBackgroundStats().  Counts and times accumulate from the creation
+  // of the Env.
+  struct BackgroundStats {
+    int threads = 0;         // Threads started and not exited
+    int busy_threads = 0;    // Threads running a work item
+    int queue_length = 0;    // Work items waiting for a thread
+    uint64_t scheduled = 0;  // Work items scheduled
+    uint64_t completed = 0;  // Work items that have finished running
+    uint64_t total_queue_micros = 0;  // Time work items spent queued
+    uint64_t max_queue_micros = 0;    // Longest time a work item was queued
+    uint64_t total_run_micros = 0;    // Time spent running work items
+  };
+
   // Return a default environment suitable for the current operating
   // system.  Sophisticated users may wish to provide their own Env
   // implementation instead of relying on this default environment.
@@ -110,6 +128,22 @@ class LEVELDB_EXPORT Env {
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
 
+  // Like NewRandomAccessFile() and NewWritableFile(), for files that are
+  // read or written with direct I/O, bypassing the operating system's
+  // cache, where the environment and file system support it.  Every read
+  // from the returned RandomAccessFile goes to the disk, so callers that
+  // read sequentially should read in large chunks.  Data appended to the
+  // returned WritableFile is only written out once a large buffer fills
+  // up, or by Sync() and Close().
+  //
+  // The default implementations return the files of NewRandomAccessFile()
+  // and NewWritableFile().  EnvWrapper does not forward these calls to its
+  // target, so that wrappers see every file opened through them.
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result);
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -197,6 +231,32 @@ class LEVELDB_EXPORT Env {
   // serialized.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Like Schedule(function, arg), but runs "(*function)(arg)" on the
+  // threads reserved for priority "pri".  Schedule(function, arg) uses
+  // LOW priority.
+  //
+  // The default implementation ignores "pri" and calls
+  // Schedule(function, arg).
+  virtual void Schedule(void (*function)(void* arg), void* arg, Priority pri);
+
+  // Allow up to "number" threads to run functions scheduled with priority
+  // "pri".  Threads are started on demand, as scheduled work queues up,
+  // and threads beyond a lowered limit exit once they finish their work.
+  //
+  // The default implementation ignores the request, leaving background
+  // work on whatever threads Schedule() already uses.
+  virtual void SetBackgroundThreads(int number, Priority pri);
+
+  // Return the maximum number of threads that may run functions scheduled
+  // with priority "pri" concurrently.
+  virtual int GetBackgroundThreads(Priority pri);
+
+  // Store statistics about the functions scheduled with priority "pri" in
+  // *stats, e.g. to tell whether background work is waiting for threads.
+  //
+  // The default implementation stores all zeros.
+  virtual void GetBackgroundStats(Priority pri, BackgroundStats* stats);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -248,6 +308,18 @@ class LEVELDB_EXPORT SequentialFile {
   virtual Status Skip(uint64_t n) = 0;
 };
 
+// One of the reads of a RandomAccessFile::MultiRead() batch.
+struct LEVELDB_EXPORT ReadRequest {
+  // Inputs: read up to "n" bytes starting at "offset" into scratch[0..n-1].
+  uint64_t offset = 0;
+  size_t n = 0;
+  char* scratch = nullptr;
+
+  // Outputs, as for RandomAccessFile::Read().
+  Slice result;
+  Status status;
+};
+
 // A file abstraction for randomly reading the contents of a file.
 class LEVELDB_EXPORT RandomAccessFile {
  public:
@@ -269,6 +341,26 @@ class LEVELDB_EXPORT RandomAccessFile {
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
+
+  // Perform the "n" reads described by reqs[0..n-1], as Read() would, and
+  // store the outcome of each in its "result" and "status".  The reads may
+  // be issued concurrently, so that a batch of reads from a device that
+  // serves several requests at once takes about as long as one read.
+  // Returns a non-OK status if some read failed.
+  //
+  // The default implementation calls Read() for each request in turn.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual Status MultiRead(ReadRequest* reqs, size_t n) const;
+
+  // Hint that the "n" bytes starting at "offset" will be read soon, so
+  // that the file may start fetching them in the background.  Reading
+  // past the end of the file is allowed, and the hint may be ignored.
+  //
+  // The default implementation does nothing.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual Status Prefetch(uint64_t offset, size_t n) const;
 };
 
 // A file abstraction for sequential writing.  The implementation
@@ -384,6 +476,18 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void Schedule(void (*f)(void*), void* a, Priority pri) override {
+    return target_->Schedule(f, a, pri);
+  }
+  void SetBackgroundThreads(int number, Priority pri) override {
+    return target_->SetBackgroundThreads(number, pri);
+  }
+  int GetBackgroundThreads(Priority pri) override {
+    return target_->GetBackgroundThreads(pri);
+  }
+  void GetBackgroundStats(Priority pri, BackgroundStats* stats) override {
+    return target_->GetBackgroundStats(pri, stats);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
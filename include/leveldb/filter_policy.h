@@ -67,6 +67,33 @@ class LEVELDB_EXPORT FilterPolicy {
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy like NewBloomFilterPolicy(), except that the
+// filters it creates keep all the probes for a key inside one 64-byte
+// cache line, so that a lookup costs one cache miss instead of about
+// bits_per_key * 0.69.  The price is a slightly higher false positive
+// rate for the same bits_per_key, and filters that are at least 64 bytes
+// long, so this is best used with kFullFilter or kPartitionedFilter (see
+// Options::filter_block_type) rather than with small per-block filters.
+//
+// The two policies share a name and each reads the filters of the other,
+// so a database may switch between them.  Older versions of leveldb treat
+// blocked filters as matching every key.
+LEVELDB_EXPORT const FilterPolicy* NewBlockedBloomFilterPolicy(
+    int bits_per_key);
+
+// Return a new filter policy that uses binary fuse filters (a more compact
+// variant of xor filters) with 8-bit fingerprints.  They take about 9 bits
+// per key for a ~0.4% false positive rate; a bloom filter needs about 11.5
+// bits per key for the same rate, and 10 bits per key give it ~1%.
+//
+// A filter is built from all of its keys at once, in time and temporary
+// memory linear in their number, and its lookups read three bytes that
+// are usually in different cache lines.  It is thus best used with
+// kFullFilter or kPartitionedFilter (see Options::filter_block_type).
+//
+// The comparator caveat of NewBloomFilterPolicy() applies here as well.
+LEVELDB_EXPORT const FilterPolicy* NewBinaryFuseFilterPolicy();
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
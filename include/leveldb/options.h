@@ -16,6 +16,9 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class PersistentCache;
+class RateLimiter;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -30,6 +33,20 @@ enum CompressionType {
   kZstdCompression = 0x2,
 };
 
+// Layout of the filters that a table stores for its keys when a
+// filter_policy is set.
+enum FilterBlockType {
+  // One filter for every 2KB range of data block offsets, located through
+  // the data block handle found in the index.
+  kBlockBasedFilter = 0x0,
+  // A single filter for the whole table, checked before the index.
+  kFullFilter = 0x1,
+  // One filter per index partition (see index_partition_size), with the
+  // partitions read through the block cache.  Same as kFullFilter if the
+  // index is not partitioned.
+  kPartitionedFilter = 0x2,
+};
+
 // Options to control the behavior of a database (passed to DB::Open)
 struct LEVELDB_EXPORT Options {
   // Create an Options object with default values for all fields.
@@ -73,17 +90,80 @@ struct LEVELDB_EXPORT Options {
   // on disk) before converting to a sorted on-disk file.
   //
   // Larger values increase performance, especially during bulk loads.
-  // Up to two write buffers may be held in memory at the same time,
-  // so you may wish to adjust this parameter to control memory usage.
-  // Also, a larger write buffer will result in a longer recovery time
-  // the next time the database is opened.
+  // Up to max_write_buffer_number write buffers may be held in memory at
+  // the same time, so you may wish to adjust this parameter to control
+  // memory usage.  Also, a larger write buffer will result in a longer
+  // recovery time the next time the database is opened.
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // Maximum number of write buffers held in memory, counting the one
+  // currently accepting writes.  Full buffers queue up for flushing, and
+  // writes only stall once the queue is full.  All queued buffers are
+  // merged into a single level-0 file when they are flushed.  Values below
+  // two are treated as two.
+  int max_write_buffer_number = 2;
+
+  // If true, the write path is split into two stages so that one group
+  // of writes can be appended to the log while the previous group is
+  // inserted into the memtable.  Updates still become visible to readers
+  // in log order.  Mostly useful with many concurrent writers.
+  bool enable_pipelined_write = false;
+
+  // If true, every writer in a group of concurrent writes inserts its own
+  // batch into the memtable on its own thread, instead of the group leader
+  // inserting all of them.  Updates still become visible only after the
+  // whole group has been inserted.
+  bool allow_concurrent_memtable_write = false;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
   int max_open_files = 1000;
 
+  // If true, DB::Open() opens the tables of the database on several
+  // threads before returning, instead of leaving each table to be opened
+  // by the first read that needs it.  Opening a table reads its footer,
+  // index and filter blocks.  No more tables are opened than the table
+  // cache holds (see max_open_files): those of level 0 first, then those
+  // of each level in turn.  With paranoid_checks, a table that fails to
+  // open makes DB::Open() fail.
+  bool preload_tables_on_open = false;
+
+  // Maximum number of compactions that may run concurrently on background
+  // threads.  Concurrent compactions always work on disjoint sets of input
+  // files.  Values above one also raise the number of threads that "env"
+  // uses for background work to at least this many.
+  int max_background_compactions = 1;
+
+  // If non-null, table files written by flushes and compactions are
+  // written through this limiter (see leveldb/rate_limiter.h), flushes at
+  // a higher priority than compactions.  The limiter may be shared by
+  // several DBs to cap their combined background writes.
+  RateLimiter* rate_limiter = nullptr;
+
+  // If true, compactions read their input tables and write their output
+  // tables with direct I/O (see Env::NewDirectRandomAccessFile()), so that
+  // they neither evict the pages of the tables being read in the
+  // foreground from the operating system's cache nor fill it with data
+  // that is already in the block cache.  Compactions then open their
+  // input tables apart from the table cache, and rely on reading ahead
+  // (see compaction_readahead_size) to read them in large chunks.
+  bool use_direct_io_for_compaction = false;
+
+  // If non-zero, compactions read their input tables in chunks of this
+  // many bytes, buffered in memory, rather than block by block.  Large
+  // values such as 2MB help on devices with high seek costs, such as hard
+  // disks and networked volumes.  Compactions then open their input
+  // tables apart from the table cache.
+  size_t compaction_readahead_size = 0;
+
+  // If true, the tables opened by the table cache to serve reads are read
+  // with direct I/O, so that block_cache is the only cache of their
+  // blocks.  A block_cache sized for the working set is then essential.
+  // Table iterators then read ahead into buffers of their own (see
+  // ReadOptions::readahead_size), as the operating system does not.
+  bool use_direct_reads = false;
+
   // Control over blocks (user data is stored in a set of blocks, and
   // a block is the unit of reading from disk).
 
@@ -91,6 +171,41 @@ struct LEVELDB_EXPORT Options {
   // If null, leveldb will automatically create and use an 8MB internal cache.
   Cache* block_cache = nullptr;
 
+  // If non-null, use the specified cache for compressed blocks, as read
+  // from the file.  A block that misses in block_cache is looked up here
+  // and uncompressed from memory before going to the file, so that more
+  // data fits in memory at the cost of uncompressing it again on each
+  // block_cache miss.  Uncompressed blocks, and blocks of files that are
+  // read through mmap (which are in memory already), are never stored here.
+  // If null, blocks are only cached uncompressed.
+  Cache* block_cache_compressed = nullptr;
+
+  // If non-null, blocks read from table files are also stored in this
+  // cache, typically on a local device that is faster than the one holding
+  // the database, and blocks that miss in block_cache and
+  // block_cache_compressed are read from it before the table files.  Blocks
+  // are stored as read from the file, i.e. compressed if they are.
+  //
+  // Blocks are identified by the number of their table file, so a
+  // persistent cache must only ever hold the blocks of one database, and
+  // be emptied if the database is destroyed.
+  PersistentCache* persistent_cache = nullptr;
+
+  // If true, the index and filter blocks of tables are stored in
+  // block_cache at Cache::Priority::kHigh, and charged to its capacity,
+  // instead of being held in memory for as long as a table is open.  They
+  // are read again when they miss in the cache.  Index and filter
+  // partitions are always read through block_cache, and are also inserted
+  // at high priority with this option.
+  bool cache_index_and_filter_blocks = false;
+
+  // If true, along with cache_index_and_filter_blocks, the index and filter
+  // blocks of tables that are in level 0 when opened stay pinned in
+  // block_cache while the tables are open.  Level 0 tables are checked by
+  // most reads, so this saves cache lookups and misses for them, at the
+  // cost of cache capacity that is not available for other blocks.
+  bool pin_l0_filter_and_index_blocks_in_cache = false;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -112,6 +227,26 @@ struct LEVELDB_EXPORT Options {
   // initially populating a large database.
   size_t max_file_size = 2 * 1024 * 1024;
 
+  // If non-zero, the index of each table is split into partitions of
+  // approximately this many bytes, with a small top-level index over the
+  // partitions.  Only the top-level index is kept in memory while a table
+  // is open; partitions are read through the block cache like data blocks.
+  // Useful with large max_file_size and small block_size, where a single
+  // index block per table would pin a lot of memory.  Tables written with
+  // this option cannot be read by older versions of leveldb.
+  size_t index_partition_size = 0;
+
+  // If true, every data block ends with a hash index from the user keys
+  // of its entries to the restart interval holding them.  Gets then find
+  // a key's interval with one hash probe instead of a binary search over
+  // the restart points, and reject most absent keys without comparing any
+  // keys, at the cost of about one byte per entry.  Tables written with
+  // this option cannot be read by older versions of leveldb.
+  //
+  // Ignored unless comparator is BytewiseComparator(), since keys that
+  // other comparators consider equal may have different bytes.
+  bool data_block_hash_index = false;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -138,10 +273,32 @@ struct LEVELDB_EXPORT Options {
   // Default: currently false, but may become true later.
   bool reuse_logs = false;
 
+  // If true, DB::Open() replays the logs left by the previous incarnation
+  // in a pipeline: one thread reads the log records and checks their
+  // checksums, another decodes them into their updates, and the opening
+  // thread inserts those into memtables and writes the memtables out as
+  // level-0 tables, in sequence order.  The recovered database is the
+  // same as without the pipeline.
+  bool parallel_log_recovery = false;
+
   // If non-null, use the specified filter policy to reduce disk reads.
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // Layout of the filters written for new tables.  Tables written with any
+  // of the layouts can be read regardless of this setting; older versions
+  // of leveldb just do not use kFullFilter and kPartitionedFilter filters.
+  FilterBlockType filter_block_type = kBlockBasedFilter;
+
+  // If non-null, the prefixes of keys, as computed by this transform, are
+  // added to the filters of new tables next to the keys themselves.
+  // Iterators opened with ReadOptions::prefix_same_as_start then skip the
+  // tables whose filter rules out the prefix of their Seek() target.
+  //
+  // Prefixes are only added to kFullFilter filters, and only consulted in
+  // tables built with a transform of the same name.
+  const SliceTransform* prefix_extractor = nullptr;
 };
 
 // Options that control read operations
@@ -159,6 +316,21 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If true and the database has a prefix_extractor, an iterator only
+  // yields the keys that share the prefix of the target of its last
+  // Seek(), and that Seek() skips the tables whose prefix filter rules
+  // the prefix out.  Seeking to a key without a prefix, or calling
+  // SeekToFirst() or SeekToLast(), iterates over the whole database.
+  bool prefix_same_as_start = false;
+
+  // Number of bytes that iterators ask the table files to read ahead of
+  // the data blocks they load (see RandomAccessFile::Prefetch()), so that
+  // long scans read the files in large chunks rather than block by block.
+  // If 0, an iterator only reads ahead once it finds itself loading the
+  // blocks of a file in order: starting with 8KB, and doubling the amount
+  // with every further read ahead up to 256KB.
+  size_t readahead_size = 0;
 };
 
 // Options that control write operations
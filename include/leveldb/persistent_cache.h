@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PersistentCache is a second tier of block cache kept on a fast local
+// device (see Options::persistent_cache), for tables that sit on slower
+// storage.  Blocks read from the tables are stored in it, and later block
+// cache misses are served from it instead of the table files.  Its
+// contents survive the process, so it stays warm across restarts.
+//
+// A PersistentCache has internal synchronization and may be safely
+// accessed concurrently from multiple threads.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+#define STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+
+class LEVELDB_EXPORT PersistentCache {
+ public:
+  PersistentCache() = default;
+
+  PersistentCache(const PersistentCache&) = delete;
+  PersistentCache& operator=(const PersistentCache&) = delete;
+
+  // Writes out the entries that are still buffered in memory.
+  virtual ~PersistentCache();
+
+  // Store "data" under "key".  Does nothing if "key" is already present.
+  // The cache is best-effort: entries may be dropped at any time, e.g.
+  // when writing them fails or to make room for newer entries.
+  virtual void Insert(const Slice& key, const Slice& data) = 0;
+
+  // If the cache holds exactly "n" bytes under "key", and they pass their
+  // checksum, copy them to scratch[0..n-1] and return true.  Otherwise
+  // return false.  Safe to call concurrently with Insert().
+  virtual bool Lookup(const Slice& key, size_t n, char* scratch) = 0;
+
+  // Return the number of bytes the cache takes on its device.
+  virtual uint64_t TotalSize() = 0;
+};
+
+// Open a persistent cache of at most about "capacity" bytes in the
+// directory "path" of "env", creating the directory if it is missing.
+// Entries written to the directory by an earlier cache are kept, except
+// for those that fail their crc32c checksum.
+//
+// The cache appends entries to segment files of a few megabytes each, and
+// keeps an index of them in memory; when the cache is full, the oldest
+// segment is deleted.  The directory must not be used by anything else,
+// nor by two caches at once.
+//
+// On success, stores a pointer to the new cache in *result and returns
+// OK.  The caller should delete *result when it is no longer needed, and
+// after any database that is using it has been closed.
+LEVELDB_EXPORT Status NewPersistentCache(Env* env, const std::string& path,
+                                         uint64_t capacity,
+                                         PersistentCache** result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
@@ -0,0 +1,74 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter caps the rate at which table files are written by flushes
+// and compactions (see Options::rate_limiter), so that background writes
+// do not saturate a disk that foreground reads are waiting on.  Writes are
+// metered at the priority of the background work doing them: flushes at
+// Env::HIGH and compactions at Env::LOW.  When both are waiting, flushes
+// are served first, since stalled flushes end up stalling writes.
+//
+// A RateLimiter has internal synchronization and may be safely shared by
+// several DBs, e.g. all the DBs on one disk.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <cstdint>
+
+#include "leveldb/env.h"
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT RateLimiter {
+ public:
+  RateLimiter() = default;
+
+  RateLimiter(const RateLimiter&) = delete;
+  RateLimiter& operator=(const RateLimiter&) = delete;
+
+  virtual ~RateLimiter();
+
+  // Block until "bytes" may be written at priority "pri".
+  virtual void Request(int64_t bytes, Env::Priority pri) = 0;
+
+  // Change the number of bytes that may be written per second.  For an
+  // auto-tuned limiter, this is the upper bound of the rate.
+  // REQUIRES: bytes_per_second > 0
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) = 0;
+
+  // Return the number of bytes that may currently be written per second.
+  virtual int64_t GetBytesPerSecond() const = 0;
+
+  // Return the number of bytes that have been granted at priority "pri".
+  virtual int64_t GetTotalBytesThrough(Env::Priority pri) const = 0;
+
+  // Called by the DBs using the limiter as the estimated number of bytes
+  // their compactions still have to write changes, with the difference
+  // from their last report, so that a shared limiter sees the sum over
+  // all of them.  The default implementation ignores the reports.
+  virtual void AddPendingCompactionBytes(int64_t delta);
+};
+
+// Return a new rate limiter that allows "bytes_per_second" bytes to be
+// written per second, in bursts of at most the bytes allowed for one
+// "refill_period_micros" period.  Shorter periods make writes smoother at
+// the cost of more frequent wakeups.
+//
+// If "auto_tuned" is true, the rate starts at "bytes_per_second" and is
+// tuned within [bytes_per_second / 20, bytes_per_second] from the pending
+// compaction bytes reported by the DBs: it is raised while they grow, so
+// that compactions keep up with the writes, and lowered while they shrink
+// or stay at zero, to leave the disk to foreground reads.
+//
+// The caller should delete the result when it is no longer needed, and
+// after any database that is using it has been closed.
+LEVELDB_EXPORT RateLimiter* NewGenericRateLimiter(
+    int64_t bytes_per_second, int64_t refill_period_micros = 100 * 1000,
+    bool auto_tuned = false);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
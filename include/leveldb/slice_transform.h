@@ -0,0 +1,53 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps a key to its prefix.  A database configured with
+// one (see Options::prefix_extractor) adds the prefixes of its keys to
+// the table filters, so that iterators restricted to the prefix of their
+// Seek() target (see ReadOptions::prefix_same_as_start) can skip the
+// tables that hold no key with that prefix.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // The name of the transform.  It is recorded in each table built with
+  // the transform, and the table's prefix filter is only used when the
+  // name matches, so the name must change whenever Transform() does.
+  virtual const char* Name() const = 0;
+
+  // Return the prefix of "key".
+  // REQUIRES: InDomain(key).
+  //
+  // The result must be a prefix of key, i.e. start at key.data().  The
+  // keys that share a prefix must be contiguous in the order of the
+  // database comparator, as they are under the bytewise comparator.
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Return true if "key" has a prefix.  Keys without one are never
+  // filtered by prefix.
+  virtual bool InDomain(const Slice& key) const = 0;
+};
+
+// Return a new transform that maps every key of at least "prefix_len"
+// bytes to its first prefix_len bytes.  Shorter keys have no prefix.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const SliceTransform* NewFixedPrefixTransform(
+    size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
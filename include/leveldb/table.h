@@ -7,17 +7,18 @@
 
 #include <cstdint>
 
+#include "leveldb/cache.h"
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
+#include "leveldb/options.h"
 
 namespace leveldb {
 
 class Block;
+struct BlockContents;
 class BlockHandle;
 class Footer;
-struct Options;
 class RandomAccessFile;
-struct ReadOptions;
 class TableCache;
 
 // Table表示从字符串到字符串的排序映射
@@ -53,8 +54,97 @@ class LEVELDB_EXPORT Table {
  private:
   friend class TableCache;
   struct Rep;
+  struct FilterRef;
+  class BlockPrefetcher;
+
+  // Like the public Open(), for the table file numbered "file_number" in
+  // its database, whose blocks may be kept in options.persistent_cache.
+  // With pin_meta_blocks, the index and filter blocks that are stored in
+  // options.block_cache (see Options::cache_index_and_filter_blocks) stay
+  // there until the table is deleted.
+  static Status Open(const Options& options, RandomAccessFile* file,
+                     uint64_t file_size, uint64_t file_number,
+                     bool pin_meta_blocks, Table** table);
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  // With point_lookup, the returned iterator may use the hash index of a
+  // data block: see Block::NewIterator().
+  static Iterator* BlockReader(void*, const ReadOptions&, const Slice&,
+                               bool point_lookup);
+  // Like BlockReader(), for the iterators of NewIterator(): "arg" is the
+  // iterator's BlockPrefetcher, which reads ahead of the blocks it loads.
+  static Iterator* PrefetchingBlockReader(void*, const ReadOptions&,
+                                          const Slice&);
+  // Like BlockReader(), for the partitions of a partitioned index.
+  static Iterator* IndexPartitionReader(void*, const ReadOptions&,
+                                        const Slice&);
+
+  // Returns an iterator over the index entries of the table, whose values
+  // are data block handles.  Walks the index partitions if the table has
+  // a partitioned index.
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+
+  // Looks up the block identified by "handle" in options.block_cache, or
+  // reads it from "file" (the table file, or an iterator's view of it) and
+  // inserts it there at "priority".  On success, stores the block in
+  // *block and the handle to release in *cache_handle, or nullptr in
+  // *cache_handle if the caller owns *block.
+  Status GetBlock(const ReadOptions&, RandomAccessFile* file,
+                  const BlockHandle& handle, Cache::Priority priority,
+                  Block** block, Cache::Handle** cache_handle) const;
+
+  // Returns an iterator over the block loaded by GetBlock().
+  Iterator* NewBlockIterator(const ReadOptions&, RandomAccessFile* file,
+                             const BlockHandle& handle,
+                             Cache::Priority priority,
+                             bool point_lookup) const;
+
+  // Like GetBlock(), for the filter block or filter partition identified
+  // by "handle".  The result must be passed to ReleaseFilterBlock().
+  Status GetFilterBlock(const ReadOptions&, const BlockHandle& handle,
+                        Cache::Priority priority, BlockContents** contents,
+                        Cache::Handle** cache_handle) const;
+  void ReleaseFilterBlock(BlockContents* contents,
+                          Cache::Handle* cache_handle) const;
+
+  // Priority in the block cache of index and filter partitions.
+  Cache::Priority MetaBlockPriority() const;
+
+  // Batched form of GetBlock() for handles[0..n-1], storing the outcome
+  // of each in blocks[i], cache_handles[i] and statuses[i].  The blocks
+  // that are not cached are read with a single RandomAccessFile::MultiRead().
+  void GetBlocks(const ReadOptions&, int n, const BlockHandle* handles,
+                 Cache::Priority priority, Block** blocks,
+                 Cache::Handle** cache_handles, Status* statuses) const;
+
+  // The steps of GetBlock(): LookupBlock() returns true if the block is in
+  // options.block_cache, and AddBlock() makes a block of "contents" and
+  // inserts it there.
+  bool LookupBlock(const BlockHandle& handle, Block** block,
+                   Cache::Handle** cache_handle) const;
+  void AddBlock(const ReadOptions&, const BlockHandle& handle,
+                Cache::Priority priority, const BlockContents& contents,
+                Block** block, Cache::Handle** cache_handle) const;
+
+  // Reads and uncompresses the block identified by "handle" from "file",
+  // going through options.block_cache_compressed and
+  // options.persistent_cache if they are set.
+  Status ReadBlockContents(const ReadOptions&, RandomAccessFile* file,
+                           const BlockHandle& handle,
+                           BlockContents* contents) const;
+
+  // The steps of ReadBlockContents(): LookupBlockContents() returns true,
+  // with the outcome in *contents and *s, if the block is in one of the
+  // caches.  Otherwise, once the block has been read from the file as
+  // stored (see ReadRawBlock()), FinishBlockContents() adds it to the
+  // caches and uncompresses it, taking ownership of "raw" as
+  // UncompressBlock() does.  Only blocks read from the file (from_file)
+  // are added to options.persistent_cache.
+  bool LookupBlockContents(const ReadOptions&, const BlockHandle& handle,
+                           BlockContents* contents, Status* s) const;
+  Status FinishBlockContents(const ReadOptions&, const BlockHandle& handle,
+                             const BlockContents& raw, bool from_file,
+                             BlockContents* contents) const;
 
   explicit Table(Rep* rep) : rep_(rep) {}
 
@@ -65,8 +155,25 @@ class LEVELDB_EXPORT Table {
                      void (*handle_result)(void* arg, const Slice& k,
                                            const Slice& v));
 
-  void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+  // Batched form of InternalGet() for the "n" keys in "keys[]", which
+  // must be sorted in increasing order.  For each i, calls
+  // (*handle_result)(args[i], ...) as InternalGet(keys[i]) would and
+  // stores the status of that lookup in statuses[i].  Consecutive keys
+  // that map to the same index entry share a single index seek and a
+  // single data block read, and the data blocks of several keys are read
+  // concurrently (see GetBlocks()).
+  void InternalMultiGet(const ReadOptions&, int n, const Slice* keys,
+                        void** args, Status* statuses,
+                        void (*handle_result)(void* arg, const Slice& k,
+                                              const Slice& v));
+
+  void ReadMeta(const Footer& footer, bool pin_meta_blocks);
+  // Returns true if the table has a usable filter of the given type.
+  bool ReadFilter(const Slice& filter_handle_value, FilterBlockType type,
+                  bool pin_meta_blocks);
+  // Keeps the filter in "block" with the table, taking ownership of its
+  // data if block.heap_allocated.
+  void SetFilter(const BlockContents& block, FilterBlockType type);
 
   Rep* const rep_;
 };
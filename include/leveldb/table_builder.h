@@ -87,6 +87,8 @@ class LEVELDB_EXPORT TableBuilder {
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  void AddIndexEntry(const Slice& key, const BlockHandle& handle);
+  void FlushIndexPartition();
 
   struct Rep;
   Rep* rep_;
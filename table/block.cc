@@ -17,25 +17,39 @@
 
 namespace leveldb {
 
-inline uint32_t Block::NumRestarts() const {
-  assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
-}
-
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      num_restarts_(0),
+      hash_buckets_(nullptr),
+      num_buckets_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
-  } else {
-    size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    return;
+  }
+  size_t restarts_end = size_ - sizeof(uint32_t);
+  num_restarts_ = DecodeFixed32(data_ + restarts_end);
+  if (num_restarts_ & kBlockHashIndexFlag) {
+    num_restarts_ &= ~kBlockHashIndexFlag;
+    if (restarts_end < sizeof(uint32_t)) {
       size_ = 0;
-    } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      return;
+    }
+    restarts_end -= sizeof(uint32_t);
+    num_buckets_ = DecodeFixed32(data_ + restarts_end);
+    if (num_buckets_ == 0 || num_buckets_ > restarts_end) {
+      size_ = 0;
+      return;
     }
+    restarts_end -= num_buckets_;
+    hash_buckets_ = reinterpret_cast<const uint8_t*>(data_ + restarts_end);
+  }
+  if (num_restarts_ > restarts_end / sizeof(uint32_t)) {
+    // The size is too small for num_restarts_
+    size_ = 0;
+  } else {
+    restart_offset_ = restarts_end - num_restarts_ * sizeof(uint32_t);
   }
 }
 
@@ -80,6 +94,9 @@ class Block::Iter : public Iterator {
   const char* const data_;       // underlying block contents
   uint32_t const restarts_;      // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_;  // Number of uint32_t entries in restart array
+  // Hash index used by Seek(), or nullptr
+  const uint8_t* const hash_buckets_;
+  uint32_t const num_buckets_;
 
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
@@ -114,11 +131,14 @@ class Block::Iter : public Iterator {
 
  public:
   Iter(const Comparator* comparator, const char* data, uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts, const uint8_t* hash_buckets,
+       uint32_t num_buckets)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        hash_buckets_(hash_buckets),
+        num_buckets_(num_buckets),
         current_(restarts_),
         restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
@@ -162,6 +182,10 @@ class Block::Iter : public Iterator {
   }
 
   void Seek(const Slice& target) override {
+    if (hash_buckets_ != nullptr && HashSeek(target)) {
+      return;
+    }
+
     // Binary search in restart array to find the last restart point
     // with a key < target
     uint32_t left = 0;
@@ -247,6 +271,46 @@ class Block::Iter : public Iterator {
     value_.clear();
   }
 
+  // Looks up target's user key in the hash index.  Returns false if the
+  // index cannot tell which restart interval holds it.
+  bool HashSeek(const Slice& target) {
+    const uint8_t restart_index =
+        hash_buckets_[BlockHashIndexHash(target) % num_buckets_];
+    if (restart_index == kHashIndexCollision) {
+      return false;
+    }
+    if (restart_index == kHashIndexNoEntry) {
+      // The user key is not in the block.
+      current_ = restarts_;
+      restart_index_ = num_restarts_;
+      return true;
+    }
+    if (restart_index >= num_restarts_) {
+      CorruptionError();
+      return true;
+    }
+
+    // All entries for the user key are in this restart interval, and all
+    // entries before it are smaller than target.
+    const uint32_t limit =
+        static_cast<uint32_t>(restart_index + 1) < num_restarts_
+            ? GetRestartPoint(restart_index + 1)
+            : restarts_;
+    SeekToRestartPoint(restart_index);
+    while (ParseNextKey()) {
+      if (current_ >= limit) {
+        // No entry for the user key is >= target.
+        current_ = restarts_;
+        restart_index_ = num_restarts_;
+        return true;
+      }
+      if (Compare(key_, target) >= 0) {
+        return true;
+      }
+    }
+    return true;
+  }
+
   bool ParseNextKey() {
     current_ = NextEntryOffset();
     const char* p = data_ + current_;
@@ -277,15 +341,16 @@ class Block::Iter : public Iterator {
   }
 };
 
-Iterator* Block::NewIterator(const Comparator* comparator) {
+Iterator* Block::NewIterator(const Comparator* comparator,
+                              bool point_lookup) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
-  const uint32_t num_restarts = NumRestarts();
-  if (num_restarts == 0) {
+  if (num_restarts_ == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    return new Iter(comparator, data_, restart_offset_, num_restarts_,
+                    point_lookup ? hash_buckets_ : nullptr, num_buckets_);
   }
 }
 
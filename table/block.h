@@ -26,17 +26,25 @@ class Block {
   ~Block();
 
   size_t size() const { return size_; }
-  Iterator* NewIterator(const Comparator* comparator);
+
+  // With point_lookup, Seek(target) on the result may go through the
+  // block's hash index, if it has one.  Keys must then be internal keys,
+  // and Seek() is only guaranteed to find the first entry >= target if
+  // that entry has target's user key: otherwise the iterator may be left
+  // invalid or at another entry >= target.
+  Iterator* NewIterator(const Comparator* comparator,
+                        bool point_lookup = false);
 
  private:
   class Iter;
 
-  uint32_t NumRestarts() const;
-
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
-  bool owned_;               // Block owns data_[]
+  uint32_t num_restarts_;
+  const uint8_t* hash_buckets_;  // Hash index, or nullptr if none
+  uint32_t num_buckets_;
+  bool owned_;  // Block owns data_[]
 };
 
 }  // namespace leveldb
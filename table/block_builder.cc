@@ -20,6 +20,17 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// A block built with a hash index (Options::data_block_hash_index) instead
+// ends with:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+//     num_restarts | kBlockHashIndexFlag: uint32
+// buckets[BlockHashIndexHash(key) % num_buckets] is the index of the
+// restart interval holding the user key of "key", kHashIndexNoEntry if no
+// entry of the block has that bucket, or kHashIndexCollision if entries in
+// several restart intervals do.
 
 #include "table/block_builder.h"
 
@@ -28,12 +39,25 @@
 
 #include "leveldb/comparator.h"
 #include "leveldb/options.h"
+#include "table/format.h"
 #include "util/coding.h"
 
 namespace leveldb {
 
-BlockBuilder::BlockBuilder(const Options* options)
-    : options_(options), restarts_(), counter_(0), finished_(false) {
+// Load factor of the hash index buckets
+static const double kHashIndexUtilRatio = 0.75;
+
+static uint32_t NumHashIndexBuckets(size_t num_entries) {
+  // An odd bucket count spreads the hashes better than a power of two.
+  return static_cast<uint32_t>(num_entries / kHashIndexUtilRatio) | 1;
+}
+
+BlockBuilder::BlockBuilder(const Options* options, bool hash_index)
+    : options_(options),
+      restarts_(),
+      counter_(0),
+      finished_(false),
+      hash_index_(hash_index) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);  // First restart point is at offset 0
 }
@@ -45,12 +69,17 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  key_hashes_.clear();
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
-  return (buffer_.size() +                       // Raw data buffer
-          restarts_.size() * sizeof(uint32_t) +  // Restart array
-          sizeof(uint32_t));                     // Restart array length
+  size_t estimate = buffer_.size() +                       // Raw data buffer
+                    restarts_.size() * sizeof(uint32_t) +  // Restart array
+                    sizeof(uint32_t);  // Restart array length
+  if (hash_index_) {
+    estimate += NumHashIndexBuckets(key_hashes_.size()) + sizeof(uint32_t);
+  }
+  return estimate;
 }
 
 Slice BlockBuilder::Finish() {
@@ -58,9 +87,26 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  // 序列化：重启点数量
-  PutFixed32(&buffer_, restarts_.size());
-  
+  if (hash_index_ && restarts_.size() <= kMaxHashIndexRestarts) {
+    const uint32_t num_buckets = NumHashIndexBuckets(key_hashes_.size());
+    std::string buckets(num_buckets, static_cast<char>(kHashIndexNoEntry));
+    for (const auto& entry : key_hashes_) {
+      char& bucket = buckets[entry.first % num_buckets];
+      const char restart_index = static_cast<char>(entry.second);
+      if (bucket == static_cast<char>(kHashIndexNoEntry)) {
+        bucket = restart_index;
+      } else if (bucket != restart_index) {
+        bucket = static_cast<char>(kHashIndexCollision);
+      }
+    }
+    buffer_.append(buckets);
+    PutFixed32(&buffer_, num_buckets);
+    PutFixed32(&buffer_, restarts_.size() | kBlockHashIndexFlag);
+  } else {
+    // 序列化：重启点数量
+    PutFixed32(&buffer_, restarts_.size());
+  }
+
   finished_ = true;
   return Slice(buffer_);
 }
@@ -99,6 +145,10 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   last_key_.append(key.data() + shared, non_shared);
   assert(Slice(last_key_) == key);
   counter_++;
+
+  if (hash_index_) {
+    key_hashes_.emplace_back(BlockHashIndexHash(key), restarts_.size() - 1);
+  }
 }
 
 }  // namespace leveldb
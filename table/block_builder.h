@@ -6,6 +6,8 @@
 #define STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 
 #include <cstdint>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "leveldb/slice.h"
@@ -16,7 +18,9 @@ struct Options;
 
 class BlockBuilder {
  public:
-  explicit BlockBuilder(const Options* options);
+  // With hash_index, Finish() appends a hash index over the user keys of
+  // the entries, for point lookups of internal keys.
+  explicit BlockBuilder(const Options* options, bool hash_index = false);
 
   BlockBuilder(const BlockBuilder&) = delete;
   BlockBuilder& operator=(const BlockBuilder&) = delete;
@@ -47,6 +51,9 @@ class BlockBuilder {
   int counter_;                     // Number of entries emitted since restart
   bool finished_;                   // Has Finish() been called?
   std::string last_key_;
+  const bool hash_index_;
+  // For every entry added: the hash of its user key and its restart interval
+  std::vector<std::pair<uint32_t, uint32_t>> key_hashes_;
 };
 
 }  // namespace leveldb
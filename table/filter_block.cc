@@ -73,6 +73,48 @@ void FilterBlockBuilder::GenerateFilter() {
   start_.clear();
 }
 
+FullFilterBlockBuilder::FullFilterBlockBuilder(const FilterPolicy* policy)
+    : policy_(policy) {}
+
+void FullFilterBlockBuilder::AddKey(const Slice& key) {
+  start_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+}
+
+void FullFilterBlockBuilder::AddPrefix(const Slice& prefix) {
+  prefix_start_.push_back(prefixes_.size());
+  prefixes_.append(prefix.data(), prefix.size());
+}
+
+Slice FullFilterBlockBuilder::Finish() {
+  const size_t num_keys = start_.size();
+  const size_t num_prefixes = prefix_start_.size();
+  start_.push_back(keys_.size());  // Simplify length computation
+  prefix_start_.push_back(prefixes_.size());
+  tmp_keys_.resize(num_keys + num_prefixes);
+  for (size_t i = 0; i < num_keys; i++) {
+    const char* base = keys_.data() + start_[i];
+    size_t length = start_[i + 1] - start_[i];
+    tmp_keys_[i] = Slice(base, length);
+  }
+  for (size_t i = 0; i < num_prefixes; i++) {
+    const char* base = prefixes_.data() + prefix_start_[i];
+    size_t length = prefix_start_[i + 1] - prefix_start_[i];
+    tmp_keys_[num_keys + i] = Slice(base, length);
+  }
+
+  result_.clear();
+  policy_->CreateFilter(tmp_keys_.data(), static_cast<int>(tmp_keys_.size()),
+                        &result_);
+
+  tmp_keys_.clear();
+  keys_.clear();
+  start_.clear();
+  prefixes_.clear();
+  prefix_start_.clear();
+  return Slice(result_);
+}
+
 FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
                                      const Slice& contents)
     : policy_(policy), data_(nullptr), offset_(nullptr), num_(0), base_lg_(0) {
@@ -49,6 +49,39 @@ class FilterBlockBuilder {
   std::vector<uint32_t> filter_offsets_;
 };
 
+// A FullFilterBlockBuilder builds a single filter over all the keys added
+// since the previous call to Finish(): the keys of the whole table for
+// kFullFilter, or of one index partition for kPartitionedFilter.
+//
+// The sequence of calls to FullFilterBlockBuilder must match the regexp:
+//      ((AddKey | AddPrefix)* Finish)*
+class FullFilterBlockBuilder {
+ public:
+  explicit FullFilterBlockBuilder(const FilterPolicy*);
+
+  FullFilterBlockBuilder(const FullFilterBlockBuilder&) = delete;
+  FullFilterBlockBuilder& operator=(const FullFilterBlockBuilder&) = delete;
+
+  void AddKey(const Slice& key);
+
+  // Adds a key prefix (see Options::prefix_extractor).  Prefixes are passed
+  // to the filter policy after all the keys, in the order they were added,
+  // so that repeats of a prefix stay adjacent.
+  void AddPrefix(const Slice& prefix);
+
+  // Returns the filter, which stays valid until the next call.
+  Slice Finish();
+
+ private:
+  const FilterPolicy* policy_;
+  std::string keys_;             // Flattened key contents
+  std::vector<size_t> start_;    // Starting index in keys_ of each key
+  std::string prefixes_;         // Flattened prefix contents
+  std::vector<size_t> prefix_start_;  // Starting index in prefixes_
+  std::string result_;           // Filter returned by Finish()
+  std::vector<Slice> tmp_keys_;  // policy_->CreateFilter() argument
+};
+
 class FilterBlockReader {
  public:
   // REQUIRES: "contents" and *policy must stay live while *this is live.
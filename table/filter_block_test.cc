@@ -119,4 +119,25 @@ TEST_F(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(!reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST_F(FilterBlockTest, FullFilter) {
+  FullFilterBlockBuilder builder(&policy_);
+  builder.AddKey("foo");
+  builder.AddKey("bar");
+  std::string first = builder.Finish().ToString();
+  ASSERT_TRUE(policy_.KeyMayMatch("foo", first));
+  ASSERT_TRUE(policy_.KeyMayMatch("bar", first));
+  ASSERT_TRUE(!policy_.KeyMayMatch("box", first));
+
+  // Each Finish() covers only the keys added since the previous one.
+  builder.AddKey("box");
+  Slice second = builder.Finish();
+  ASSERT_TRUE(policy_.KeyMayMatch("box", second));
+  ASSERT_TRUE(!policy_.KeyMayMatch("foo", second));
+  ASSERT_TRUE(!policy_.KeyMayMatch("bar", second));
+
+  // Empty filter
+  Slice empty = builder.Finish();
+  ASSERT_TRUE(!policy_.KeyMayMatch("foo", empty));
+}
+
 }  // namespace leveldb
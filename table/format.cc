@@ -4,12 +4,15 @@
 
 #include "table/format.h"
 
+#include <vector>
+
 #include "leveldb/env.h"
 #include "leveldb/options.h"
 #include "port/port.h"
 #include "table/block.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
@@ -34,8 +37,10 @@ void Footer::EncodeTo(std::string* dst) const {
   metaindex_handle_.EncodeTo(dst);
   index_handle_.EncodeTo(dst);
   dst->resize(2 * BlockHandle::kMaxEncodedLength);  // Padding
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
+  const uint64_t magic =
+      partitioned_index_ ? kPartitionedIndexTableMagicNumber : kTableMagicNumber;
+  PutFixed32(dst, static_cast<uint32_t>(magic & 0xffffffffu));
+  PutFixed32(dst, static_cast<uint32_t>(magic >> 32));
   assert(dst->size() == original_size + kEncodedLength);
   (void)original_size;  // Disable unused variable warning.
 }
@@ -50,7 +55,11 @@ Status Footer::DecodeFrom(Slice* input) {
   const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
   const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) |
                           (static_cast<uint64_t>(magic_lo)));
-  if (magic != kTableMagicNumber) {
+  if (magic == kTableMagicNumber) {
+    partitioned_index_ = false;
+  } else if (magic == kPartitionedIndexTableMagicNumber) {
+    partitioned_index_ = true;
+  } else {
     return Status::Corruption("not an sstable (bad magic number)");
   }
 
@@ -66,19 +75,11 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
-// 根据BlockHandle，从文件file中读出Block的数据，输出到result
-Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result) {
-  result->data = Slice();
-  result->cachable = false;
-  result->heap_allocated = false;
-
-  // Read the block contents as well as the type/crc footer.
-  // See table_builder.cc for the code that built this structure.
-  size_t n = static_cast<size_t>(handle.size());
-  char* buf = new char[n + kBlockTrailerSize];
-  Slice contents;
-  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+// 检查读入buf的Block原始数据contents（读取状态为s），输出到raw
+// 接管buf的所有权
+static Status CheckRawBlock(const ReadOptions& options, size_t n, char* buf,
+                            Status s, const Slice& contents,
+                            BlockContents* raw) {
   if (!s.ok()) {
     delete[] buf;
     return s;
@@ -100,22 +101,73 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
     }
   }
 
-  // 解压数据
+  if (data != buf) {
+    // File implementation gave us pointer to some other data.
+    // Use it directly under the assumption that it will be live
+    // while the file is open.
+    delete[] buf;
+    raw->data = Slice(data, n + 1);
+  } else {
+    raw->data = Slice(buf, n + 1);
+    raw->heap_allocated = true;
+    raw->cachable = true;
+  }
+  return Status::OK();
+}
+
+// 根据BlockHandle，从文件file中读出Block的原始数据(可能是压缩的)，输出到raw
+Status ReadRawBlock(RandomAccessFile* file, const ReadOptions& options,
+                    const BlockHandle& handle, BlockContents* raw) {
+  raw->data = Slice();
+  raw->cachable = false;
+  raw->heap_allocated = false;
+
+  // Read the block contents as well as the type/crc footer.
+  // See table_builder.cc for the code that built this structure.
+  size_t n = static_cast<size_t>(handle.size());
+  char* buf = new char[n + kBlockTrailerSize];
+  Slice contents;
+  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+  return CheckRawBlock(options, n, buf, s, contents, raw);
+}
+
+// 用一次MultiRead()读出n个Block的原始数据
+void ReadRawBlocks(RandomAccessFile* file, const ReadOptions& options, int n,
+                   const BlockHandle* handles, BlockContents* raws,
+                   Status* statuses) {
+  std::vector<ReadRequest> reqs(n);
+  for (int i = 0; i < n; i++) {
+    raws[i].data = Slice();
+    raws[i].cachable = false;
+    raws[i].heap_allocated = false;
+    reqs[i].offset = handles[i].offset();
+    reqs[i].n = static_cast<size_t>(handles[i].size()) + kBlockTrailerSize;
+    reqs[i].scratch = new char[reqs[i].n];
+  }
+  file->MultiRead(reqs.data(), reqs.size());
+  for (int i = 0; i < n; i++) {
+    statuses[i] = CheckRawBlock(options, static_cast<size_t>(handles[i].size()),
+                                reqs[i].scratch, reqs[i].status,
+                                reqs[i].result, &raws[i]);
+  }
+}
+
+// 解压raw中的数据，输出到result
+Status UncompressBlock(const BlockContents& raw, BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+
+  const char* data = raw.data.data();
+  const size_t n = raw.data.size() - 1;
+  char* buf = raw.heap_allocated ? const_cast<char*>(data) : nullptr;
   switch (data[n]) {
     case kNoCompression:
-      if (data != buf) {
-        // File implementation gave us pointer to some other data.
-        // Use it directly under the assumption that it will be live
-        // while the file is open.
-        delete[] buf;
-        result->data = Slice(data, n);
-        result->heap_allocated = false;
-        result->cachable = false;  // Do not double-cache
-      } else {
-        result->data = Slice(buf, n);
-        result->heap_allocated = true;
-        result->cachable = true;
-      }
+      // Hand over the raw buffer, if any: data not read into our own
+      // buffer is not cached, so as not to double-cache it.
+      result->data = Slice(data, n);
+      result->heap_allocated = raw.heap_allocated;
+      result->cachable = raw.cachable;
 
       // Ok
       break;
@@ -163,4 +215,25 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   return Status::OK();
 }
 
+// 根据BlockHandle，从文件file中读出Block的数据，输出到result
+Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
+                 const BlockHandle& handle, BlockContents* result) {
+  BlockContents raw;
+  Status s = ReadRawBlock(file, options, handle, &raw);
+  if (!s.ok()) {
+    result->data = Slice();
+    result->cachable = false;
+    result->heap_allocated = false;
+    return s;
+  }
+  return UncompressBlock(raw, result);
+}
+
+uint32_t BlockHashIndexHash(const Slice& key) {
+  // Keys shorter than an internal key trailer only occur in tables that
+  // are not written by a DB, which never do point lookups.
+  const size_t user_key_size = key.size() >= 8 ? key.size() - 8 : key.size();
+  return Hash(key.data(), user_key_size, 0x5bd1e995);
+}
+
 }  // namespace leveldb
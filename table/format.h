@@ -58,16 +58,24 @@ class Footer {
   const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
   void set_metaindex_handle(const BlockHandle& h) { metaindex_handle_ = h; }
 
-  // The block handle for the index block of the table
+  // The block handle for the index block of the table.  For a table with
+  // a partitioned index this is the top-level index, whose entries point
+  // at index partitions rather than data blocks.
   const BlockHandle& index_handle() const { return index_handle_; }
   void set_index_handle(const BlockHandle& h) { index_handle_ = h; }
 
+  // Whether the table has a partitioned index.  Recorded through the magic
+  // number so that readers that do not know the format reject the table.
+  bool partitioned_index() const { return partitioned_index_; }
+  void set_partitioned_index(bool v) { partitioned_index_ = v; }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  bool partitioned_index_ = false;
 };
 
 // kTableMagicNumber was picked by running
@@ -75,9 +83,31 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Magic number of tables with a partitioned index: kTableMagicNumber with
+// the lowest bit flipped.
+static const uint64_t kPartitionedIndexTableMagicNumber =
+    kTableMagicNumber ^ 1;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// A block whose trailing restart count has this bit set also holds a hash
+// index over the user keys of its entries (Options::data_block_hash_index).
+// See block_builder.cc for the layout.
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+
+// Hash index buckets hold the index of the restart interval with the keys
+// that hash to them, or one of these markers.  Blocks with more restart
+// points than kMaxHashIndexRestarts are written without a hash index.
+static const uint8_t kHashIndexNoEntry = 255;
+static const uint8_t kHashIndexCollision = 254;
+static const uint32_t kMaxHashIndexRestarts = 253;
+
+// Returns the hash of "key" for a block hash index, whose bucket is the
+// hash modulo the number of buckets.  "key" is an internal key: only its
+// user key is hashed, so that lookups at any sequence number agree.
+uint32_t BlockHashIndexHash(const Slice& key);
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True if data can be cached
@@ -89,6 +119,24 @@ struct BlockContents {
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
                  const BlockHandle& handle, BlockContents* result);
 
+// Read the block identified by "handle" from "file" without uncompressing
+// it: on success, raw->data holds the block contents as stored, followed
+// by the one-byte compression type.  The crc is verified as by ReadBlock().
+Status ReadRawBlock(RandomAccessFile* file, const ReadOptions& options,
+                    const BlockHandle& handle, BlockContents* raw);
+
+// Like ReadRawBlock() for each of handles[0..n-1], storing the outcome of
+// each read in raws[i] and statuses[i].  The reads are issued together
+// with RandomAccessFile::MultiRead().
+void ReadRawBlocks(RandomAccessFile* file, const ReadOptions& options, int n,
+                   const BlockHandle* handles, BlockContents* raws,
+                   Status* statuses);
+
+// Fill *result with the uncompressed contents of "raw", as returned by
+// ReadRawBlock().  If raw.heap_allocated, takes ownership of raw.data, which
+// may be handed over to *result; otherwise raw.data is only read.
+Status UncompressBlock(const BlockContents& raw, BlockContents* result);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
@@ -4,11 +4,18 @@
 
 #include "leveldb/table.h"
 
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/persistent_cache.h"
+#include "leveldb/slice_transform.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -21,22 +28,115 @@ struct Table::Rep {
   ~Rep() {
     delete filter;
     delete[] filter_data;
-    delete index_block;
+    delete filter_index;
+    if (filter_pin != nullptr) {
+      options.block_cache->Release(filter_pin);
+    }
+    if (index_pin != nullptr) {
+      options.block_cache->Release(index_pin);
+    } else {
+      delete index_block;
+    }
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
+  uint64_t file_number;  // 0 if unknown
   uint64_t cache_id;
-  FilterBlockReader* filter;
+  uint64_t compressed_cache_id;  // Id in options.block_cache_compressed
+  FilterBlockReader* filter;   // kBlockBasedFilter
+  Slice full_filter;           // kFullFilter, empty if absent
+  bool prefix_filtering;       // full_filter holds options.prefix_extractor's
+                               // key prefixes
+  Block* filter_index;         // kPartitionedFilter
   const char* filter_data;
 
+  // With options.cache_index_and_filter_blocks, the index and filter blocks
+  // live in options.block_cache.  The fields above and index_block are then
+  // only set if the blocks are pinned there for the life of the table (and
+  // point to the cached blocks), or if they cannot be cached.
+  bool cache_meta_blocks;
+  bool filter_in_cache;         // Filter must be looked up in the cache
+  FilterBlockType filter_type;  // Valid if filter_in_cache
+  BlockHandle filter_handle;    // Valid if filter_in_cache
+  Cache::Handle* filter_pin;    // Pinned filter block, or nullptr
+  Cache::Handle* index_pin;     // Pinned index_block, or nullptr
+
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
-  Block* index_block;
+  BlockHandle index_handle;
+  Block* index_block;  // Top-level index if partitioned_index
+  bool partitioned_index;
+};
+
+// The filter of a table for the duration of a lookup: either the one held
+// by the table, or one looked up in (or read into) the block cache.
+struct Table::FilterRef {
+  FilterRef(const Table* table, const ReadOptions& options)
+      : block_based(table->rep_->filter),
+        full(table->rep_->full_filter),
+        partition_index(table->rep_->filter_index),
+        table_(table),
+        contents_(nullptr),
+        cache_handle_(nullptr),
+        owned_reader_(nullptr),
+        owned_index_(nullptr) {
+    const Rep* rep = table->rep_;
+    if (!rep->filter_in_cache ||
+        !table->GetFilterBlock(options, rep->filter_handle,
+                               Cache::Priority::kHigh, &contents_,
+                               &cache_handle_)
+             .ok()) {
+      return;  // Without a filter, every key may match.
+    }
+    if (rep->filter_type == kFullFilter) {
+      full = contents_->data;
+    } else if (rep->filter_type == kPartitionedFilter) {
+      BlockContents view = *contents_;
+      view.heap_allocated = false;
+      owned_index_ = partition_index = new Block(view);
+    } else {
+      owned_reader_ = block_based =
+          new FilterBlockReader(rep->options.filter_policy, contents_->data);
+    }
+  }
+
+  FilterRef(const FilterRef&) = delete;
+  FilterRef& operator=(const FilterRef&) = delete;
+
+  ~FilterRef() {
+    delete owned_reader_;
+    delete owned_index_;
+    if (contents_ != nullptr) {
+      table_->ReleaseFilterBlock(contents_, cache_handle_);
+    }
+  }
+
+  // Returns false if the whole-table or partitioned filter says that key
+  // is not present.  Always true for block-based filters, which are
+  // checked per data block.
+  bool KeyMayMatch(const ReadOptions& options, const Slice& key) const;
+
+  FilterBlockReader* block_based;  // kBlockBasedFilter, or nullptr
+  Slice full;                      // kFullFilter, empty if absent
+  Block* partition_index;          // kPartitionedFilter, or nullptr
+
+ private:
+  const Table* const table_;
+  BlockContents* contents_;  // Filter block from the cache, or nullptr
+  Cache::Handle* cache_handle_;
+  FilterBlockReader* owned_reader_;
+  Block* owned_index_;
 };
 
 Status Table::Open(const Options& options, RandomAccessFile* file,
                    uint64_t size, Table** table) {
+  return Open(options, file, size, 0, false, table);
+}
+
+Status Table::Open(const Options& options, RandomAccessFile* file,
+                   uint64_t size, uint64_t file_number, bool pin_meta_blocks,
+                   Table** table) {
   *table = nullptr;
   if (size < Footer::kEncodedLength) {
     return Status::Corruption("file is too short to be an sstable");
@@ -52,34 +152,69 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
   s = footer.DecodeFrom(&footer_input);
   if (!s.ok()) return s;
 
-  // 将 index block 数据读到 index_block_contents
-  BlockContents index_block_contents;
+  Rep* rep = new Table::Rep;
+  rep->options = options;
+  rep->file = file;
+  rep->file_number = file_number;
+  rep->metaindex_handle = footer.metaindex_handle();
+  rep->index_handle = footer.index_handle();
+  rep->index_block = nullptr;
+  rep->partitioned_index = footer.partitioned_index();
+  rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+  rep->compressed_cache_id = (options.block_cache_compressed
+                                  ? options.block_cache_compressed->NewId()
+                                  : 0);
+  rep->filter_data = nullptr;
+  rep->filter = nullptr;
+  rep->filter_index = nullptr;
+  rep->prefix_filtering = false;
+  rep->cache_meta_blocks =
+      options.cache_index_and_filter_blocks && options.block_cache != nullptr;
+  rep->filter_in_cache = false;
+  rep->filter_type = kBlockBasedFilter;
+  rep->filter_pin = nullptr;
+  rep->index_pin = nullptr;
+  Table* t = new Table(rep);
+
+  // 将 index block 数据读到 index_block
   ReadOptions opt;
   if (options.paranoid_checks) {
     opt.verify_checksums = true;
   }
-  s = ReadBlock(file, opt, footer.index_handle(), &index_block_contents);
+  if (rep->cache_meta_blocks) {
+    // Load the index block into the cache, where it is needed right away.
+    Block* index_block;
+    Cache::Handle* cache_handle;
+    s = t->GetBlock(opt, file, rep->index_handle, Cache::Priority::kHigh,
+                    &index_block, &cache_handle);
+    if (s.ok()) {
+      if (cache_handle == nullptr || pin_meta_blocks) {
+        rep->index_block = index_block;
+        rep->index_pin = cache_handle;
+      } else {
+        options.block_cache->Release(cache_handle);
+      }
+    }
+  } else {
+    BlockContents index_block_contents;
+    s = ReadBlock(file, opt, rep->index_handle, &index_block_contents);
+    if (s.ok()) {
+      rep->index_block = new Block(index_block_contents);
+    }
+  }
 
   if (s.ok()) {
     // We've successfully read the footer and the index block: we're
     // ready to serve requests.
-    Block* index_block = new Block(index_block_contents);
-    Rep* rep = new Table::Rep;
-    rep->options = options;
-    rep->file = file;
-    rep->metaindex_handle = footer.metaindex_handle();
-    rep->index_block = index_block;
-    rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
-    rep->filter_data = nullptr;
-    rep->filter = nullptr;
-    *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    t->ReadMeta(footer, pin_meta_blocks);
+    *table = t;
+  } else {
+    delete t;
   }
-
   return s;
 }
 
-void Table::ReadMeta(const Footer& footer) {
+void Table::ReadMeta(const Footer& footer, bool pin_meta_blocks) {
   if (rep_->options.filter_policy == nullptr) {
     return;  // Do not need any metadata
   }
@@ -98,21 +233,42 @@ void Table::ReadMeta(const Footer& footer) {
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  static const struct {
+    const char* prefix;
+    FilterBlockType type;
+  } kFilterPrefixes[] = {
+      {"fullfilter.", kFullFilter},
+      {"partitionedfilter.", kPartitionedFilter},
+      {"filter.", kBlockBasedFilter},
+  };
+  bool full_filter = false;
+  for (const auto& f : kFilterPrefixes) {
+    std::string key = f.prefix;
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      full_filter =
+          ReadFilter(iter->value(), f.type, pin_meta_blocks) &&
+          f.type == kFullFilter;
+      break;
+    }
+  }
+  if (full_filter && rep_->options.prefix_extractor != nullptr) {
+    std::string key = "prefix.";
+    key.append(rep_->options.prefix_extractor->Name());
+    iter->Seek(key);
+    rep_->prefix_filtering = iter->Valid() && iter->key() == Slice(key);
   }
   delete iter;
   delete meta;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+bool Table::ReadFilter(const Slice& filter_handle_value,
+                       FilterBlockType type, bool pin_meta_blocks) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
   if (!filter_handle.DecodeFrom(&v).ok()) {
-    return;
+    return false;
   }
 
   // We might want to unify with ReadBlock() if we start
@@ -121,18 +277,62 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
   }
-  BlockContents block;
-  if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
+  if (!rep_->cache_meta_blocks) {
+    BlockContents block;
+    if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
+      return false;
+    }
+    SetFilter(block, type);
+    return true;
+  }
+
+  BlockContents* contents;
+  Cache::Handle* cache_handle;
+  if (!GetFilterBlock(opt, filter_handle, Cache::Priority::kHigh, &contents,
+                      &cache_handle)
+           .ok()) {
+    return false;
+  }
+  if (cache_handle == nullptr) {
+    // Could not be cached: keep it with the table.
+    SetFilter(*contents, type);
+    delete contents;
+  } else if (pin_meta_blocks) {
+    BlockContents view = *contents;
+    view.heap_allocated = false;  // Owned by the cache
+    SetFilter(view, type);
+    rep_->filter_pin = cache_handle;
+  } else {
+    rep_->options.block_cache->Release(cache_handle);
+    rep_->filter_in_cache = true;
+    rep_->filter_type = type;
+    rep_->filter_handle = filter_handle;
+  }
+  return true;
+}
+
+void Table::SetFilter(const BlockContents& block, FilterBlockType type) {
+  if (type == kPartitionedFilter) {
+    // The filter partitions themselves are read on demand.
+    rep_->filter_index = new Block(block);
     return;
   }
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();  // Will need to delete later
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+  if (type == kFullFilter) {
+    rep_->full_filter = block.data;
+  } else {
+    rep_->filter =
+        new FilterBlockReader(rep_->options.filter_policy, block.data);
+  }
 }
 
 Table::~Table() { delete rep_; }
 
+// Maximum number of data blocks that InternalMultiGet() reads at once.
+static const size_t kMultiGetBlocks = 16;
+
 static void DeleteBlock(void* arg, void* ignored) {
   delete reinterpret_cast<Block*>(arg);
 }
@@ -148,84 +348,638 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
+static void DeleteFilterBlock(BlockContents* contents) {
+  if (contents->heap_allocated) {
+    delete[] contents->data.data();
+  }
+  delete contents;
+}
+
+static void DeleteCachedFilterBlock(const Slice& key, void* value) {
+  DeleteFilterBlock(reinterpret_cast<BlockContents*>(value));
+}
+
+static void DeleteCachedRawBlock(const Slice& key, void* value) {
+  BlockContents* raw = reinterpret_cast<BlockContents*>(value);
+  delete[] raw->data.data();
+  delete raw;
+}
+
+Status Table::ReadBlockContents(const ReadOptions& options,
+                                RandomAccessFile* file,
+                                const BlockHandle& handle,
+                                BlockContents* contents) const {
+  Status s;
+  if (LookupBlockContents(options, handle, contents, &s)) {
+    return s;
+  }
+  BlockContents raw;
+  s = ReadRawBlock(file, options, handle, &raw);
+  if (!s.ok()) {
+    return s;
+  }
+  return FinishBlockContents(options, handle, raw, true, contents);
+}
+
+bool Table::LookupBlockContents(const ReadOptions& options,
+                                const BlockHandle& handle,
+                                BlockContents* contents, Status* s) const {
+  Cache* compressed_cache = rep_->options.block_cache_compressed;
+  if (compressed_cache != nullptr) {
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, rep_->compressed_cache_id);
+    EncodeFixed64(cache_key_buffer + 8, handle.offset());
+    Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+    Cache::Handle* cache_handle = compressed_cache->Lookup(key);
+    if (cache_handle != nullptr) {
+      // Only compressed blocks are cached, so the result never points into
+      // the cached buffer.
+      BlockContents raw = *reinterpret_cast<const BlockContents*>(
+          compressed_cache->Value(cache_handle));
+      raw.heap_allocated = false;  // Owned by the cache
+      *s = UncompressBlock(raw, contents);
+      compressed_cache->Release(cache_handle);
+      return true;
+    }
+  }
+
+  PersistentCache* persistent_cache = rep_->options.persistent_cache;
+  if (persistent_cache != nullptr && rep_->file_number != 0) {
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, rep_->file_number);
+    EncodeFixed64(cache_key_buffer + 8, handle.offset());
+    Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+    const size_t n = static_cast<size_t>(handle.size()) + 1;  // With the type
+    char* buf = new char[n];
+    if (persistent_cache->Lookup(key, n, buf)) {
+      BlockContents raw;
+      raw.data = Slice(buf, n);
+      raw.cachable = true;
+      raw.heap_allocated = true;
+      *s = FinishBlockContents(options, handle, raw, false, contents);
+      return true;
+    }
+    delete[] buf;
+  }
+  return false;
+}
+
+Status Table::FinishBlockContents(const ReadOptions& options,
+                                  const BlockHandle& handle,
+                                  const BlockContents& raw, bool from_file,
+                                  BlockContents* contents) const {
+  PersistentCache* persistent_cache = rep_->options.persistent_cache;
+  if (from_file && persistent_cache != nullptr && rep_->file_number != 0 &&
+      options.fill_cache) {
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, rep_->file_number);
+    EncodeFixed64(cache_key_buffer + 8, handle.offset());
+    Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+    persistent_cache->Insert(key, raw.data);
+  }
+
+  // Uncompressed blocks would take the same space as in block_cache, and
+  // blocks that are not in our own buffer (e.g. mmap-ed) are in memory
+  // already.
+  Cache* compressed_cache = rep_->options.block_cache_compressed;
+  if (compressed_cache == nullptr ||
+      raw.data[raw.data.size() - 1] == kNoCompression || !raw.cachable ||
+      !options.fill_cache) {
+    return UncompressBlock(raw, contents);
+  }
+
+  // Uncompress from a view of the buffer, and move the buffer to the cache.
+  BlockContents view = raw;
+  view.heap_allocated = false;
+  Status s = UncompressBlock(view, contents);
+  if (s.ok()) {
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, rep_->compressed_cache_id);
+    EncodeFixed64(cache_key_buffer + 8, handle.offset());
+    Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+    Cache::Handle* cache_handle =
+        compressed_cache->Insert(key, new BlockContents(raw), raw.data.size(),
+                                 &DeleteCachedRawBlock);
+    compressed_cache->Release(cache_handle);
+  } else {
+    delete[] raw.data.data();
+  }
+  return s;
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
-  Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
-  Block* block = nullptr;
-  Cache::Handle* cache_handle = nullptr;
+  return BlockReader(arg, options, index_value, false);
+}
 
+Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
+                             const Slice& index_value, bool point_lookup) {
+  Table* table = reinterpret_cast<Table*>(arg);
   BlockHandle handle;
   Slice input = index_value;
   Status s = handle.DecodeFrom(&input);
   // We intentionally allow extra stuff in index_value so that we
   // can add more features in the future.
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  return table->NewBlockIterator(options, table->rep_->file, handle,
+                                 Cache::Priority::kLow, point_lookup);
+}
 
-  if (s.ok()) {
-    BlockContents contents;
-    if (block_cache != nullptr) {
-      char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer + 8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
-      cache_handle = block_cache->Lookup(key);
-      if (cache_handle != nullptr) {
-        block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
-      } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
-        if (s.ok()) {
-          block = new Block(contents);
-          if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(key, block, block->size(),
-                                               &DeleteCachedBlock);
-          }
-        }
+// Automatic read ahead starts with the kAutoReadaheadMinLoads-th load of a
+// block right after the previous one, and grows from
+// kInitialAutoReadaheadSize to kMaxAutoReadaheadSize bytes.
+static const int kAutoReadaheadMinLoads = 2;
+static const uint64_t kInitialAutoReadaheadSize = 8 * 1024;
+static const uint64_t kMaxAutoReadaheadSize = 256 * 1024;
+
+// Asks the table file to read ahead of the data blocks that one iterator
+// loads: by ReadOptions::readahead_size bytes, or if that is 0, by a
+// growing amount once the iterator loads the blocks in file order.  The
+// next read ahead is asked for when the iterator gets halfway through the
+// previous one, so that the file keeps reading ahead of the iterator.
+//
+// The operating system does not read ahead of files read with direct I/O
+// (Options::use_direct_reads), so the prefetcher then reads the range into
+// a buffer of its own instead, and the iterator reads its data blocks
+// through the prefetcher.  Only used by one iterator, so not thread-safe.
+class Table::BlockPrefetcher : public RandomAccessFile {
+ public:
+  BlockPrefetcher(const Table* table, size_t readahead_size)
+      : table_(table),
+        readahead_size_(readahead_size),
+        prev_end_(0),
+        sequential_loads_(0),
+        auto_readahead_size_(kInitialAutoReadaheadSize),
+        prefetch_start_(0),
+        prefetch_end_(0),
+        buffer_offset_(0) {}
+
+  BlockPrefetcher(const BlockPrefetcher&) = delete;
+  BlockPrefetcher& operator=(const BlockPrefetcher&) = delete;
+
+  const Table* table() const { return table_; }
+
+  // The file to read the iterator's data blocks from.
+  RandomAccessFile* file() {
+    return table_->rep_->options.use_direct_reads ? this : table_->rep_->file;
+  }
+
+  // Called before the iterator loads the block identified by "handle".
+  void Prefetch(const BlockHandle& handle) {
+    const uint64_t offset = handle.offset();
+    const uint64_t end = offset + handle.size() + kBlockTrailerSize;
+    const bool sequential = (offset == prev_end_);
+    prev_end_ = end;
+
+    uint64_t readahead = readahead_size_;
+    if (readahead == 0) {
+      if (!sequential) {
+        sequential_loads_ = 0;
+        auto_readahead_size_ = kInitialAutoReadaheadSize;
+        prefetch_start_ = prefetch_end_ = 0;
+        return;
+      }
+      if (++sequential_loads_ < kAutoReadaheadMinLoads) {
+        return;
       }
+      readahead = auto_readahead_size_;
+    }
+
+    if (table_->rep_->options.use_direct_reads) {
+      if (offset >= buffer_offset_ && end <= buffer_offset_ + buffer_.size()) {
+        return;  // The block was read ahead
+      }
+      FillBuffer(offset, end + readahead);
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
-      if (s.ok()) {
-        block = new Block(contents);
+      const bool overlaps =
+          offset >= prefetch_start_ && offset < prefetch_end_;
+      if (overlaps && end + readahead / 2 <= prefetch_end_) {
+        return;  // Enough of the previous read ahead is left
+      }
+      // Only ask for what was not asked for already.
+      uint64_t start = prefetch_end_;
+      if (!overlaps) {
+        start = prefetch_start_ = offset;
       }
+      prefetch_end_ = end + readahead;
+      // Only a hint: a failure shows up when the block is read.
+      table_->rep_->file->Prefetch(start, prefetch_end_ - start);
+    }
+    if (readahead_size_ == 0) {
+      auto_readahead_size_ =
+          std::min(2 * auto_readahead_size_, kMaxAutoReadaheadSize);
     }
   }
 
-  Iterator* iter;
-  if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
-    if (cache_handle == nullptr) {
-      iter->RegisterCleanup(&DeleteBlock, block, nullptr);
-    } else {
-      iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  // Serves the reads that the buffer holds, and passes the others on to
+  // the table file.
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    if (offset < buffer_offset_ ||
+        offset + n > buffer_offset_ + buffer_.size()) {
+      return table_->rep_->file->Read(offset, n, result, scratch);
+    }
+    std::memcpy(scratch, buffer_.data() + (offset - buffer_offset_), n);
+    *result = Slice(scratch, n);
+    return Status::OK();
+  }
+
+ private:
+  // Reads [start, end) of the table file into buffer_.
+  void FillBuffer(uint64_t start, uint64_t end) {
+    // The data blocks all come before the index block, and some files do
+    // not allow reads past their end.
+    end = std::min(end, table_->rep_->index_handle.offset());
+    if (end <= start) {
+      return;
     }
+    buffer_.resize(end - start);
+    Slice contents;
+    Status s = table_->rep_->file->Read(start, buffer_.size(), &contents,
+                                        &buffer_[0]);
+    if (!s.ok()) {
+      buffer_.clear();  // A failure shows up when the block is read
+      return;
+    }
+    if (contents.data() != buffer_.data()) {
+      std::memcpy(&buffer_[0], contents.data(), contents.size());
+    }
+    buffer_.resize(contents.size());
+    buffer_offset_ = start;
+  }
+
+  const Table* const table_;
+  const uint64_t readahead_size_;
+  uint64_t prev_end_;  // End of the previous block loaded
+  int sequential_loads_;
+  uint64_t auto_readahead_size_;  // Amount of the next automatic read ahead
+  // Range that the file was asked to read ahead
+  uint64_t prefetch_start_;
+  uint64_t prefetch_end_;
+  // With direct reads, the bytes read ahead, starting at buffer_offset_
+  std::string buffer_;
+  uint64_t buffer_offset_;
+};
+
+Iterator* Table::PrefetchingBlockReader(void* arg, const ReadOptions& options,
+                                        const Slice& index_value) {
+  BlockPrefetcher* prefetcher = reinterpret_cast<BlockPrefetcher*>(arg);
+  BlockHandle handle;
+  Slice input = index_value;
+  Status s = handle.DecodeFrom(&input);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  prefetcher->Prefetch(handle);
+  return prefetcher->table()->NewBlockIterator(
+      options, prefetcher->file(), handle, Cache::Priority::kLow, false);
+}
+
+Iterator* Table::IndexPartitionReader(void* arg, const ReadOptions& options,
+                                      const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  BlockHandle handle;
+  Slice input = index_value;
+  Status s = handle.DecodeFrom(&input);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  return table->NewBlockIterator(options, table->rep_->file, handle,
+                                 table->MetaBlockPriority(), false);
+}
+
+Status Table::GetBlock(const ReadOptions& options, RandomAccessFile* file,
+                       const BlockHandle& handle, Cache::Priority priority,
+                       Block** block, Cache::Handle** cache_handle) const {
+  if (LookupBlock(handle, block, cache_handle)) {
+    return Status::OK();
+  }
+  BlockContents contents;
+  Status s = ReadBlockContents(options, file, handle, &contents);
+  if (s.ok()) {
+    AddBlock(options, handle, priority, contents, block, cache_handle);
+  }
+  return s;
+}
+
+void Table::GetBlocks(const ReadOptions& options, int n,
+                      const BlockHandle* handles, Cache::Priority priority,
+                      Block** blocks, Cache::Handle** cache_handles,
+                      Status* statuses) const {
+  // Blocks that are in none of the caches are read with one MultiRead().
+  std::vector<int> misses;
+  for (int i = 0; i < n; i++) {
+    statuses[i] = Status::OK();
+    if (LookupBlock(handles[i], &blocks[i], &cache_handles[i])) {
+      continue;
+    }
+    BlockContents contents;
+    if (LookupBlockContents(options, handles[i], &contents, &statuses[i])) {
+      if (statuses[i].ok()) {
+        AddBlock(options, handles[i], priority, contents, &blocks[i],
+                 &cache_handles[i]);
+      }
+      continue;
+    }
+    misses.push_back(i);
+  }
+  if (misses.empty()) {
+    return;
+  }
+
+  const int m = static_cast<int>(misses.size());
+  std::vector<BlockHandle> miss_handles(m);
+  for (int j = 0; j < m; j++) {
+    miss_handles[j] = handles[misses[j]];
+  }
+  std::vector<BlockContents> raws(m);
+  std::vector<Status> read_statuses(m);
+  ReadRawBlocks(rep_->file, options, m, miss_handles.data(), raws.data(),
+                read_statuses.data());
+  for (int j = 0; j < m; j++) {
+    const int i = misses[j];
+    statuses[i] = read_statuses[j];
+    if (!statuses[i].ok()) {
+      continue;
+    }
+    BlockContents contents;
+    statuses[i] =
+        FinishBlockContents(options, handles[i], raws[j], true, &contents);
+    if (statuses[i].ok()) {
+      AddBlock(options, handles[i], priority, contents, &blocks[i],
+               &cache_handles[i]);
+    }
+  }
+}
+
+bool Table::LookupBlock(const BlockHandle& handle, Block** block,
+                        Cache::Handle** cache_handle) const {
+  Cache* block_cache = rep_->options.block_cache;
+  *block = nullptr;
+  *cache_handle = nullptr;
+  if (block_cache == nullptr) {
+    return false;
+  }
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  *cache_handle = block_cache->Lookup(key);
+  if (*cache_handle == nullptr) {
+    return false;
+  }
+  *block = reinterpret_cast<Block*>(block_cache->Value(*cache_handle));
+  return true;
+}
+
+void Table::AddBlock(const ReadOptions& options, const BlockHandle& handle,
+                     Cache::Priority priority, const BlockContents& contents,
+                     Block** block, Cache::Handle** cache_handle) const {
+  Cache* block_cache = rep_->options.block_cache;
+  *block = new Block(contents);
+  *cache_handle = nullptr;
+  if (block_cache != nullptr && contents.cachable && options.fill_cache) {
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, rep_->cache_id);
+    EncodeFixed64(cache_key_buffer + 8, handle.offset());
+    Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+    *cache_handle = block_cache->Insert(key, *block, (*block)->size(),
+                                        &DeleteCachedBlock, priority);
+  }
+}
+
+Iterator* Table::NewBlockIterator(const ReadOptions& options,
+                                  RandomAccessFile* file,
+                                  const BlockHandle& handle,
+                                  Cache::Priority priority,
+                                  bool point_lookup) const {
+  Block* block;
+  Cache::Handle* cache_handle;
+  Status s = GetBlock(options, file, handle, priority, &block, &cache_handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  Iterator* iter = block->NewIterator(rep_->options.comparator, point_lookup);
+  if (cache_handle == nullptr) {
+    iter->RegisterCleanup(&DeleteBlock, block, nullptr);
   } else {
-    iter = NewErrorIterator(s);
+    iter->RegisterCleanup(&ReleaseBlock, rep_->options.block_cache,
+                          cache_handle);
   }
   return iter;
 }
 
+Status Table::GetFilterBlock(const ReadOptions& options,
+                             const BlockHandle& handle,
+                             Cache::Priority priority,
+                             BlockContents** contents,
+                             Cache::Handle** cache_handle) const {
+  Cache* block_cache = rep_->options.block_cache;
+  *contents = nullptr;
+  *cache_handle = nullptr;
+  char cache_key_buffer[16];
+  Slice key;
+  if (block_cache != nullptr) {
+    EncodeFixed64(cache_key_buffer, rep_->cache_id);
+    EncodeFixed64(cache_key_buffer + 8, handle.offset());
+    key = Slice(cache_key_buffer, sizeof(cache_key_buffer));
+    *cache_handle = block_cache->Lookup(key);
+    if (*cache_handle != nullptr) {
+      *contents =
+          reinterpret_cast<BlockContents*>(block_cache->Value(*cache_handle));
+      return Status::OK();
+    }
+  }
+
+  BlockContents* result = new BlockContents;
+  Status s = ReadBlockContents(options, rep_->file, handle, result);
+  if (!s.ok()) {
+    delete result;
+    return s;
+  }
+  *contents = result;
+  if (block_cache != nullptr && result->cachable && options.fill_cache) {
+    *cache_handle = block_cache->Insert(key, result, result->data.size(),
+                                        &DeleteCachedFilterBlock, priority);
+  }
+  return s;
+}
+
+void Table::ReleaseFilterBlock(BlockContents* contents,
+                               Cache::Handle* cache_handle) const {
+  if (cache_handle != nullptr) {
+    rep_->options.block_cache->Release(cache_handle);
+  } else {
+    DeleteFilterBlock(contents);
+  }
+}
+
+Cache::Priority Table::MetaBlockPriority() const {
+  return rep_->cache_meta_blocks ? Cache::Priority::kHigh
+                                 : Cache::Priority::kLow;
+}
+
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* index_iter;
+  if (rep_->index_block != nullptr) {
+    index_iter = rep_->index_block->NewIterator(rep_->options.comparator);
+  } else {
+    index_iter = NewBlockIterator(options, rep_->file, rep_->index_handle,
+                                  Cache::Priority::kHigh, false);
+  }
+  if (!rep_->partitioned_index) {
+    return index_iter;
+  }
+  // Index partitions are stored like data blocks whose values are data
+  // block handles, so they are loaded through the block cache too.
+  return NewTwoLevelIterator(index_iter, &Table::IndexPartitionReader,
+                             const_cast<Table*>(this), options);
+}
+
+bool Table::FilterRef::KeyMayMatch(const ReadOptions& options,
+                                   const Slice& k) const {
+  const FilterPolicy* policy = table_->rep_->options.filter_policy;
+  if (!full.empty()) {
+    return policy->KeyMayMatch(k, full);
+  }
+  if (partition_index == nullptr) {
+    return true;
+  }
+
+  // Filter partitions are keyed like the index partitions, so the first
+  // entry >= k names the only partition that may contain k.
+  Iterator* iter =
+      partition_index->NewIterator(table_->rep_->options.comparator);
+  iter->Seek(k);
+  if (!iter->Valid()) {
+    // Past the last key of the table, unless the filter index is corrupt.
+    bool may_match = !iter->status().ok();
+    delete iter;
+    return may_match;
+  }
+  BlockHandle handle;
+  Slice input = iter->value();
+  Status s = handle.DecodeFrom(&input);
+  delete iter;
+  if (!s.ok()) {
+    return true;
+  }
+
+  BlockContents* contents;
+  Cache::Handle* cache_handle;
+  if (!table_->GetFilterBlock(options, handle, table_->MetaBlockPriority(),
+                              &contents, &cache_handle)
+           .ok()) {
+    return true;
+  }
+  bool may_match = policy->KeyMayMatch(k, contents->data);
+  table_->ReleaseFilterBlock(contents, cache_handle);
+  return may_match;
+}
+
+namespace {
+
+// Wraps a table iterator so that Seek() first checks the prefix of its
+// target against the table's full filter, and leaves the iterator empty
+// (without reading the index or any data block) if the table holds no
+// key with that prefix.  Other positioning calls are passed through.
+class PrefixFilterIterator : public Iterator {
+ public:
+  PrefixFilterIterator(Iterator* iter, const FilterPolicy* policy,
+                       const SliceTransform* prefix_extractor,
+                       const Slice& filter)
+      : iter_(iter),
+        policy_(policy),
+        prefix_extractor_(prefix_extractor),
+        filter_(filter),
+        filtered_(false) {}
+
+  ~PrefixFilterIterator() override { delete iter_; }
+
+  bool Valid() const override { return !filtered_ && iter_->Valid(); }
+  void Seek(const Slice& target) override {
+    filtered_ = prefix_extractor_->InDomain(target) &&
+                !policy_->KeyMayMatch(prefix_extractor_->Transform(target),
+                                      filter_);
+    if (!filtered_) {
+      iter_->Seek(target);
+    }
+  }
+  void SeekToFirst() override {
+    filtered_ = false;
+    iter_->SeekToFirst();
+  }
+  void SeekToLast() override {
+    filtered_ = false;
+    iter_->SeekToLast();
+  }
+  void Next() override { iter_->Next(); }
+  void Prev() override { iter_->Prev(); }
+  Slice key() const override { return iter_->key(); }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override {
+    return filtered_ ? Status::OK() : iter_->status();
+  }
+
+ private:
+  Iterator* const iter_;
+  const FilterPolicy* const policy_;
+  const SliceTransform* const prefix_extractor_;
+  const Slice filter_;
+  bool filtered_;  // The last Seek() was ruled out by the filter
+};
+
+}  // namespace
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  BlockPrefetcher* prefetcher =
+      new BlockPrefetcher(this, options.readahead_size);
+  Iterator* iter =
+      NewTwoLevelIterator(NewIndexIterator(options),
+                          &Table::PrefetchingBlockReader, prefetcher, options);
+  iter->RegisterCleanup(
+      [](void* arg, void*) { delete reinterpret_cast<BlockPrefetcher*>(arg); },
+      prefetcher, nullptr);
+  if (options.prefix_same_as_start && rep_->prefix_filtering) {
+    FilterRef* filter = new FilterRef(this, options);
+    if (filter->full.empty()) {
+      delete filter;
+    } else {
+      iter = new PrefixFilterIterator(iter, rep_->options.filter_policy,
+                                      rep_->options.prefix_extractor,
+                                      filter->full);
+      iter->RegisterCleanup(
+          [](void* arg, void*) { delete reinterpret_cast<FilterRef*>(arg); },
+          filter, nullptr);
+    }
+  }
+  return iter;
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  FilterRef filter_ref(this, options);
+  if (!filter_ref.KeyMayMatch(options, k)) {
+    // Not found, without touching the index
+    return s;
+  }
+  Iterator* iiter = NewIndexIterator(options);
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
+    FilterBlockReader* filter = filter_ref.block_based;
     BlockHandle handle;
     if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
         !filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
+      Iterator* block_iter = BlockReader(this, options, iiter->value(), true);
       block_iter->Seek(k);
       if (block_iter->Valid()) {
         (*handle_result)(arg, block_iter->key(), block_iter->value());
@@ -241,9 +995,118 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
   return s;
 }
 
+void Table::InternalMultiGet(const ReadOptions& options, int n,
+                             const Slice* keys, void** args, Status* statuses,
+                             void (*handle_result)(void*, const Slice&,
+                                                   const Slice&)) {
+  const Comparator* cmp = rep_->options.comparator;
+  FilterRef filter_ref(this, options);
+  FilterBlockReader* filter = filter_ref.block_based;
+  Iterator* iiter = NewIndexIterator(options);
+  bool index_positioned = false;
+  std::vector<BlockHandle> handles;
+  std::vector<int> key_blocks;  // Index in handles, or -1, by key
+  std::vector<Block*> blocks;
+  std::vector<Cache::Handle*> cache_handles;
+  std::vector<Status> block_statuses;
+  int i = 0;
+  while (i < n) {
+    // Map the next keys to the data blocks that may hold them, up to
+    // kMultiGetBlocks distinct blocks.
+    const int begin = i;
+    handles.clear();
+    key_blocks.clear();
+    std::string last_handle_value;  // Index entry of handles.back()
+    for (; i < n; i++) {
+      const Slice& k = keys[i];
+      if (!filter_ref.KeyMayMatch(options, k)) {
+        // Not found
+        statuses[i] = Status::OK();
+        key_blocks.push_back(-1);
+        continue;
+      }
+      // Keys are sorted, so the index entry found for the previous key is
+      // still the right one as long as its separator is >= k.
+      if (!index_positioned || cmp->Compare(k, iiter->key()) > 0) {
+        iiter->Seek(k);
+        index_positioned = iiter->Valid();
+      }
+      if (!iiter->Valid()) {
+        // k, and hence every remaining key, is past the end of the table.
+        for (; i < n; i++) {
+          statuses[i] = iiter->status();
+          key_blocks.push_back(-1);
+        }
+        break;
+      }
+
+      Slice handle_value = iiter->value();
+      BlockHandle handle;
+      Status s = handle.DecodeFrom(&handle_value);
+      if (!s.ok()) {
+        statuses[i] = s;
+        key_blocks.push_back(-1);
+        continue;
+      }
+      if (filter != nullptr && !filter->KeyMayMatch(handle.offset(), k)) {
+        // Not found
+        statuses[i] = Status::OK();
+        key_blocks.push_back(-1);
+        continue;
+      }
+      if (handles.empty() || iiter->value() != Slice(last_handle_value)) {
+        if (handles.size() == kMultiGetBlocks) {
+          break;
+        }
+        last_handle_value = iiter->value().ToString();
+        handles.push_back(handle);
+      }
+      key_blocks.push_back(static_cast<int>(handles.size()) - 1);
+    }
+
+    // Fetch the blocks together, and look the keys up in them.
+    const int num_blocks = static_cast<int>(handles.size());
+    blocks.resize(num_blocks);
+    cache_handles.resize(num_blocks);
+    block_statuses.resize(num_blocks);
+    GetBlocks(options, num_blocks, handles.data(), Cache::Priority::kLow,
+              blocks.data(), cache_handles.data(), block_statuses.data());
+    Iterator* block_iter = nullptr;
+    int iter_block = -1;  // Block of *block_iter
+    for (int j = begin; j < i; j++) {
+      const int b = key_blocks[j - begin];
+      if (b < 0) {
+        continue;
+      }
+      if (!block_statuses[b].ok()) {
+        statuses[j] = block_statuses[b];
+        continue;
+      }
+      if (b != iter_block) {
+        delete block_iter;
+        block_iter = blocks[b]->NewIterator(cmp, true);
+        iter_block = b;
+      }
+      block_iter->Seek(keys[j]);
+      if (block_iter->Valid()) {
+        (*handle_result)(args[j], block_iter->key(), block_iter->value());
+      }
+      statuses[j] = block_iter->status();
+    }
+    delete block_iter;
+    for (int b = 0; b < num_blocks; b++) {
+      if (cache_handles[b] != nullptr) {
+        rep_->options.block_cache->Release(cache_handles[b]);
+      } else {
+        delete blocks[b];
+      }
+    }
+  }
+  delete iiter;
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
@@ -10,6 +10,7 @@
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -24,15 +25,27 @@ struct TableBuilder::Rep {
         index_block_options(opt),
         file(f),
         offset(0),
-        data_block(&options),
+        data_block(&options, opt.data_block_hash_index),
         index_block(&index_block_options),
+        top_level_index_block(&index_block_options),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == nullptr
-                         ? nullptr
-                         : new FilterBlockBuilder(opt.filter_policy)),
+        filter_type(opt.filter_block_type),
+        filter_block(nullptr),
+        full_filter_block(nullptr),
+        filter_index_block(&index_block_options),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
+    if (filter_type == kPartitionedFilter && opt.index_partition_size == 0) {
+      filter_type = kFullFilter;
+    }
+    if (opt.filter_policy == nullptr) {
+      // No filters
+    } else if (filter_type == kBlockBasedFilter) {
+      filter_block = new FilterBlockBuilder(opt.filter_policy);
+    } else {
+      full_filter_block = new FullFilterBlockBuilder(opt.filter_policy);
+    }
   }
 
   Options options;
@@ -42,10 +55,20 @@ struct TableBuilder::Rep {
   Status status;
   BlockBuilder data_block;   // 存储 kv
   BlockBuilder index_block;  // 存储 meta
+  // With options.index_partition_size, index_block holds the current index
+  // partition and top_level_index_block maps the last key of each written
+  // partition to its handle.
+  BlockBuilder top_level_index_block;
+  std::string last_index_key;  // Last key added to index_block
   std::string last_key;  // 上次Add的key
   int64_t num_entries;
   bool closed;  // Either Finish() or Abandon() has been called.
-  FilterBlockBuilder* filter_block;
+  FilterBlockType filter_type;
+  FilterBlockBuilder* filter_block;          // kBlockBasedFilter
+  FullFilterBlockBuilder* full_filter_block;  // kFullFilter, kPartitionedFilter
+  // kPartitionedFilter: maps the last key of each index partition to the
+  // filter partition for its keys.
+  BlockBuilder filter_index_block;
 
   // 在看到下一个数据块的第一个key之前，不会发出块的索引条目，从而允许在索引块中使用较短的key
   // eg. 考虑在键“the quick brown fox”和“the who”之间的块边界，可以用“the r”作为索引条目的键
@@ -66,6 +89,7 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->full_filter_block;
   delete rep_;
 }
 
@@ -76,6 +100,23 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if ((options.index_partition_size > 0) !=
+      (rep_->options.index_partition_size > 0)) {
+    return Status::InvalidArgument(
+        "changing index partitioning while building table");
+  }
+  if (options.filter_block_type != rep_->options.filter_block_type) {
+    return Status::InvalidArgument(
+        "changing filter block type while building table");
+  }
+  if (options.prefix_extractor != rep_->options.prefix_extractor) {
+    return Status::InvalidArgument(
+        "changing prefix extractor while building table");
+  }
+  if (options.data_block_hash_index != rep_->options.data_block_hash_index) {
+    return Status::InvalidArgument(
+        "changing data block hash index while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
@@ -99,16 +140,20 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     // 在上一个块的lastkey和新块1stkey之间插值一个key，用于二分
     // 若lastkey为1stkey子串，直接用lastkey
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    
-    std::string handle_encoding;
-    r->pending_handle.EncodeTo(&handle_encoding);
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
+    AddIndexEntry(r->last_key, r->pending_handle);
     r->pending_index_entry = false;
   }
 
   // 向filter_block添加key
   if (r->filter_block != nullptr) {
     r->filter_block->AddKey(key);
+  } else if (r->full_filter_block != nullptr) {
+    r->full_filter_block->AddKey(key);
+    const SliceTransform* prefix_extractor = r->options.prefix_extractor;
+    if (r->filter_type == kFullFilter && prefix_extractor != nullptr &&
+        prefix_extractor->InDomain(key)) {
+      r->full_filter_block->AddPrefix(prefix_extractor->Transform(key));
+    }
   }
 
   r->last_key.assign(key.data(), key.size());
@@ -141,6 +186,50 @@ void TableBuilder::Flush() {
   }
 }
 
+void TableBuilder::AddIndexEntry(const Slice& key, const BlockHandle& handle) {
+  Rep* r = rep_;
+  std::string handle_encoding;
+  handle.EncodeTo(&handle_encoding);
+  r->index_block.Add(key, Slice(handle_encoding));
+  if (r->options.index_partition_size > 0) {
+    r->last_index_key.assign(key.data(), key.size());
+    if (r->index_block.CurrentSizeEstimate() >=
+        r->options.index_partition_size) {
+      FlushIndexPartition();
+    }
+  }
+}
+
+void TableBuilder::FlushIndexPartition() {
+  Rep* r = rep_;
+  if (!ok() || r->index_block.empty()) return;
+  BlockHandle handle;
+  WriteBlock(&r->index_block, &handle);
+  if (ok()) {
+    // Every key in the partition is <= its last key, so the top-level
+    // index can use that key as the separator.
+    std::string handle_encoding;
+    handle.EncodeTo(&handle_encoding);
+    r->top_level_index_block.Add(r->last_index_key, Slice(handle_encoding));
+  }
+  // The filter partition holds the keys of the data blocks indexed by the
+  // index partition, and is found through the same key.
+  if (ok() && r->filter_type == kPartitionedFilter &&
+      r->full_filter_block != nullptr) {
+    WriteRawBlock(r->full_filter_block->Finish(), kNoCompression, &handle);
+    if (ok()) {
+      std::string handle_encoding;
+      handle.EncodeTo(&handle_encoding);
+      r->filter_index_block.Add(r->last_index_key, Slice(handle_encoding));
+    }
+  }
+  // The partition moved the start of the next data block, and the filter
+  // for a data block is located by the block's offset.
+  if (r->filter_block != nullptr && !r->closed) {
+    r->filter_block->StartBlock(r->offset);
+  }
+}
+
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
@@ -227,23 +316,52 @@ Status TableBuilder::Finish() {
 
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
 
+  // Add the index entry for the last data block.  Writing the last index
+  // partition also writes the last filter partition.
+  if (ok() && r->pending_index_entry) {
+    r->options.comparator->FindShortSuccessor(&r->last_key);
+    AddIndexEntry(r->last_key, r->pending_handle);
+    r->pending_index_entry = false;
+  }
+  if (r->options.index_partition_size > 0) {
+    FlushIndexPartition();
+  }
+
   // Write filter block
+  const bool has_filter =
+      (r->filter_block != nullptr || r->full_filter_block != nullptr);
   if (ok() && r->filter_block != nullptr) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
+  } else if (ok() && r->filter_type == kFullFilter && has_filter) {
+    WriteRawBlock(r->full_filter_block->Finish(), kNoCompression,
+                  &filter_block_handle);
+  } else if (ok() && r->filter_type == kPartitionedFilter && has_filter) {
+    WriteBlock(&r->filter_index_block, &filter_block_handle);
   }
 
   // Write metaindex block
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
+    if (has_filter) {
+      // Add mapping from "filter.Name" to location of filter data, with
+      // the prefix telling the filter layout apart.
+      std::string key = (r->filter_type == kBlockBasedFilter) ? "filter."
+                        : (r->filter_type == kFullFilter) ? "fullfilter."
+                                                          : "partitionedfilter.";
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (has_filter && r->filter_type == kFullFilter &&
+        r->options.prefix_extractor != nullptr) {
+      // Record that the filter also holds the key prefixes computed by
+      // this extractor.  Sorts after "fullfilter.".
+      std::string key = "prefix.";
+      key.append(r->options.prefix_extractor->Name());
+      meta_index_block.Add(key, Slice());
+    }
 
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
@@ -251,14 +369,11 @@ Status TableBuilder::Finish() {
 
   // Write index block
   if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
+    if (r->options.index_partition_size > 0) {
+      WriteBlock(&r->top_level_index_block, &index_block_handle);
+    } else {
+      WriteBlock(&r->index_block, &index_block_handle);
     }
-    WriteBlock(&r->index_block, &index_block_handle);
   }
 
   // Write footer
@@ -266,6 +381,7 @@ Status TableBuilder::Finish() {
     Footer footer;
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
+    footer.set_partitioned_index(r->options.index_partition_size > 0);
     std::string footer_encoding;
     footer.EncodeTo(&footer_encoding);
     r->status = r->file->Append(footer_encoding);
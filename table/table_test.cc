@@ -6,11 +6,14 @@
 
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
@@ -110,14 +113,20 @@ class StringSink : public WritableFile {
 class StringSource : public RandomAccessFile {
  public:
   StringSource(const Slice& contents)
-      : contents_(contents.data(), contents.size()) {}
+      : contents_(contents.data(), contents.size()), reads_(0) {}
 
   ~StringSource() override = default;
 
   uint64_t Size() const { return contents_.size(); }
+  int reads() const { return reads_; }
+  // The (offset, n) ranges passed to Prefetch() so far.
+  const std::vector<std::pair<uint64_t, size_t>>& prefetches() const {
+    return prefetches_;
+  }
 
   Status Read(uint64_t offset, size_t n, Slice* result,
               char* scratch) const override {
+    reads_++;
     if (offset >= contents_.size()) {
       return Status::InvalidArgument("invalid Read offset");
     }
@@ -129,8 +138,15 @@ class StringSource : public RandomAccessFile {
     return Status::OK();
   }
 
+  Status Prefetch(uint64_t offset, size_t n) const override {
+    prefetches_.emplace_back(offset, n);
+    return Status::OK();
+  }
+
  private:
   std::string contents_;
+  mutable int reads_;
+  mutable std::vector<std::pair<uint64_t, size_t>> prefetches_;
 };
 
 typedef std::map<std::string, std::string, STLLessThan> KVMap;
@@ -182,7 +198,7 @@ class BlockConstructor : public Constructor {
   Status FinishImpl(const Options& options, const KVMap& data) override {
     delete block_;
     block_ = nullptr;
-    BlockBuilder builder(&options);
+    BlockBuilder builder(&options, options.data_block_hash_index);
 
     for (const auto& kvp : data) {
       builder.Add(kvp.first, kvp.second);
@@ -231,6 +247,9 @@ class TableConstructor : public Constructor {
     source_ = new StringSource(sink.contents());
     Options table_options;
     table_options.comparator = options.comparator;
+    table_options.block_cache = options.block_cache;
+    table_options.block_cache_compressed = options.block_cache_compressed;
+    table_options.use_direct_reads = options.use_direct_reads;
     return Table::Open(table_options, source_, sink.contents().size(), &table_);
   }
 
@@ -238,10 +257,21 @@ class TableConstructor : public Constructor {
     return table_->NewIterator(ReadOptions());
   }
 
+  Iterator* NewIterator(const ReadOptions& options) const {
+    return table_->NewIterator(options);
+  }
+
   uint64_t ApproximateOffsetOf(const Slice& key) const {
     return table_->ApproximateOffsetOf(key);
   }
 
+  // Number of reads issued to the table file so far.
+  int reads() const { return source_->reads(); }
+
+  const std::vector<std::pair<uint64_t, size_t>>& prefetches() const {
+    return source_->prefetches();
+  }
+
  private:
   void Reset() {
     delete table_;
@@ -377,6 +407,8 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  size_t index_partition_size;  // Zero (unpartitioned) if omitted
+  bool data_block_hash_index;   // False if omitted
 };
 
 static const TestArgs kTestArgList[] = {
@@ -387,12 +419,23 @@ static const TestArgs kTestArgList[] = {
     {TABLE_TEST, true, 1},
     {TABLE_TEST, true, 1024},
 
+    // Partitioned index, down to one index entry per partition
+    {TABLE_TEST, false, 16, 64},
+    {TABLE_TEST, false, 16, 1},
+    {TABLE_TEST, true, 16, 64},
+
+    // Data block hash index
+    {TABLE_TEST, false, 16, 0, true},
+    {TABLE_TEST, true, 16, 0, true},
+
     {BLOCK_TEST, false, 16},
     {BLOCK_TEST, false, 1},
     {BLOCK_TEST, false, 1024},
     {BLOCK_TEST, true, 16},
     {BLOCK_TEST, true, 1},
     {BLOCK_TEST, true, 1024},
+    {BLOCK_TEST, false, 16, 0, true},
+    {BLOCK_TEST, false, 1024, 0, true},
 
     // Restart interval does not matter for memtables
     {MEMTABLE_TEST, false, 16},
@@ -417,6 +460,8 @@ class Harness : public testing::Test {
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
+    options_.index_partition_size = args.index_partition_size;
+    options_.data_block_hash_index = args.data_block_hash_index;
     if (args.reverse_compare) {
       options_.comparator = &reverse_key_comparator;
     }
@@ -722,6 +767,66 @@ TEST_F(Harness, RandomizedLongDB) {
   ASSERT_GT(files, 0);
 }
 
+TEST(BlockTest, HashIndexPointLookups) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options;
+  options.comparator = &icmp;
+  options.block_restart_interval = 4;
+  BlockBuilder builder(&options, true);
+  // Even-numbered user keys, every third one with an older second version.
+  char user_key[20];
+  for (int i = 0; i < 200; i += 2) {
+    std::snprintf(user_key, sizeof(user_key), "k%04d", i);
+    builder.Add(InternalKey(user_key, 100 + i, kTypeValue).Encode(), "new");
+    if (i % 3 == 0) {
+      builder.Add(InternalKey(user_key, 50, kTypeValue).Encode(), "old");
+    }
+  }
+  BlockContents contents;
+  contents.data = builder.Finish();
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+
+  Iterator* iter = block.NewIterator(&icmp, true);
+  int absent_rejected = 0;
+  for (int i = 0; i < 200; i++) {
+    std::snprintf(user_key, sizeof(user_key), "k%04d", i);
+    iter->Seek(InternalKey(user_key, kMaxSequenceNumber, kTypeValue).Encode());
+    ASSERT_LEVELDB_OK(iter->status());
+    if (i % 2 == 0) {
+      ASSERT_TRUE(iter->Valid()) << user_key;
+      ASSERT_EQ(user_key, ExtractUserKey(iter->key()).ToString());
+      ASSERT_EQ("new", iter->value().ToString());
+      // A snapshot older than the newest version.
+      iter->Seek(InternalKey(user_key, 99, kTypeValue).Encode());
+      if (i % 3 == 0) {
+        ASSERT_TRUE(iter->Valid()) << user_key;
+        ASSERT_EQ(user_key, ExtractUserKey(iter->key()).ToString());
+        ASSERT_EQ("old", iter->value().ToString());
+      } else {
+        ASSERT_TRUE(!iter->Valid() ||
+                    ExtractUserKey(iter->key()) != Slice(user_key));
+      }
+    } else if (!iter->Valid()) {
+      absent_rejected++;
+    } else {
+      ASSERT_NE(user_key, ExtractUserKey(iter->key()).ToString());
+    }
+  }
+  // About half of the buckets are empty, so many absent keys are rejected
+  // without comparing any keys.
+  ASSERT_GT(absent_rejected, 40);
+
+  // Without point_lookup, Seek() ignores the hash index.
+  delete iter;
+  iter = block.NewIterator(&icmp);
+  iter->Seek(InternalKey("k0001", kMaxSequenceNumber, kTypeValue).Encode());
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("k0002", ExtractUserKey(iter->key()).ToString());
+  delete iter;
+}
+
 TEST(MemTableTest, Simple) {
   InternalKeyComparator cmp(BytewiseComparator());
   MemTable* memtable = new MemTable(cmp);
@@ -756,6 +861,41 @@ static bool Between(uint64_t val, uint64_t low, uint64_t high) {
   return result;
 }
 
+TEST(TableTest, PartitionedIndex) {
+  TableConstructor c(BytewiseComparator());
+  Random rnd(301);
+  std::string tmp;
+  for (int i = 0; i < 1000; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "k%06d", i);
+    c.Add(key, test::RandomString(&rnd, 100, &tmp).ToString());
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 256;
+  options.compression = kNoCompression;
+  options.index_partition_size = 128;
+  c.Finish(options, &keys, &kvmap);
+
+  // Seek to every key, and past the end of the table.
+  Iterator* iter = c.NewIterator();
+  for (const auto& kvp : kvmap) {
+    iter->Seek(kvp.first);
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(kvp.first, iter->key().ToString());
+    ASSERT_EQ(kvp.second, iter->value().ToString());
+  }
+  iter->Seek("k999999");
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+
+  // About 100 data blocks of 256 bytes each.
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k000500"), 50000, 60000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k999999"), 100000, 120000));
+}
+
 TEST(TableTest, ApproximateOffsetOfPlain) {
   TableConstructor c(BytewiseComparator());
   c.Add("k01", "hello");
@@ -785,6 +925,155 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
 }
 
+TEST(TableTest, Readahead) {
+  Random rnd(301);
+  TableConstructor c(BytewiseComparator());
+  for (int i = 0; i < 200; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "k%06d", i);
+    std::string value;
+    test::RandomString(&rnd, 1000, &value);
+    c.Add(key, value);
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  c.Finish(options, &keys, &kvmap);
+  const uint64_t data_size = c.ApproximateOffsetOf("z");
+
+  // A full scan reads ahead in a few contiguous ranges that cover the
+  // data blocks.
+  Iterator* iter = c.NewIterator();
+  iter->SeekToFirst();
+  int count = 0;
+  for (; iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  ASSERT_EQ(200, count);
+  delete iter;
+  const auto& prefetches = c.prefetches();
+  ASSERT_GE(prefetches.size(), 3);
+  ASSERT_LE(prefetches.size(), 10);
+  for (size_t i = 1; i < prefetches.size(); i++) {
+    ASSERT_EQ(prefetches[i - 1].first + prefetches[i - 1].second,
+              prefetches[i].first);
+  }
+  ASSERT_GE(prefetches.back().first + prefetches.back().second, data_size);
+
+  // Seeks to scattered keys do not read ahead.
+  const size_t scan_prefetches = prefetches.size();
+  iter = c.NewIterator();
+  for (int i = 0; i < 200; i += 20) {
+    iter->Seek(keys[i]);
+    ASSERT_TRUE(iter->Valid());
+  }
+  delete iter;
+  ASSERT_EQ(scan_prefetches, prefetches.size());
+
+  // Unless the read ahead is set.
+  ReadOptions read_options;
+  read_options.readahead_size = 64 * 1024;
+  iter = c.NewIterator(read_options);
+  iter->Seek(keys[100]);
+  ASSERT_TRUE(iter->Valid());
+  delete iter;
+  ASSERT_EQ(scan_prefetches + 1, prefetches.size());
+  ASSERT_TRUE(Between(prefetches.back().first, c.ApproximateOffsetOf(keys[99]),
+                      c.ApproximateOffsetOf(keys[100])));
+  ASSERT_GE(prefetches.back().second, 64 * 1024);
+}
+
+TEST(TableTest, ReadaheadWithDirectReads) {
+  Random rnd(301);
+  TableConstructor c(BytewiseComparator());
+  for (int i = 0; i < 200; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "k%06d", i);
+    std::string value;
+    test::RandomString(&rnd, 1000, &value);
+    c.Add(key, value);
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.use_direct_reads = true;
+  c.Finish(options, &keys, &kvmap);
+
+  // The iterator reads the 200 data blocks of a full scan in a few large
+  // chunks itself, rather than asking the file to read ahead.
+  const int reads = c.reads();
+  Iterator* iter = c.NewIterator();
+  KVMap::const_iterator model = kvmap.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++model) {
+    ASSERT_TRUE(model != kvmap.end());
+    ASSERT_EQ(model->first, iter->key().ToString());
+    ASSERT_EQ(model->second, iter->value().ToString());
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  ASSERT_TRUE(model == kvmap.end());
+  delete iter;
+  ASSERT_LE(c.reads() - reads, 10);
+  ASSERT_TRUE(c.prefetches().empty());
+}
+
+// Scans a table twice, reading through a block_cache that never hits and
+// through "compressed_cache", and returns the number of file reads issued
+// by the second scan.
+static int ScanTwiceThroughCompressedCache(CompressionType type,
+                                           Cache* compressed_cache) {
+  Random rnd(301);
+  TableConstructor c(BytewiseComparator());
+  std::string tmp;
+  for (int i = 0; i < 100; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "k%06d", i);
+    c.Add(key, test::CompressibleString(&rnd, 0.25, 1000, &tmp).ToString());
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = type;
+  Cache* block_cache = NewLRUCache(0);
+  options.block_cache = block_cache;
+  options.block_cache_compressed = compressed_cache;
+  c.Finish(options, &keys, &kvmap);
+
+  int reads = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    reads = c.reads();
+    Iterator* iter = c.NewIterator();
+    iter->SeekToFirst();
+    for (const auto& kvp : kvmap) {
+      EXPECT_TRUE(iter->Valid());
+      if (!iter->Valid()) break;
+      EXPECT_EQ(kvp.first, iter->key().ToString());
+      EXPECT_EQ(kvp.second, iter->value().ToString());
+      iter->Next();
+    }
+    EXPECT_TRUE(!iter->Valid());
+    EXPECT_LEVELDB_OK(iter->status());
+    delete iter;
+    reads = c.reads() - reads;
+  }
+  delete block_cache;
+  return reads;
+}
+
+TEST(TableTest, CompressedBlockCacheSkipsUncompressedBlocks) {
+  // One read per data block of two values.
+  Cache* compressed_cache = NewLRUCache(1 << 20);
+  ASSERT_EQ(50, ScanTwiceThroughCompressedCache(kNoCompression,
+                                                compressed_cache));
+  ASSERT_EQ(0, compressed_cache->TotalCharge());
+  delete compressed_cache;
+}
+
 static bool CompressionSupported(CompressionType type) {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
@@ -839,4 +1128,18 @@ TEST_P(CompressionTableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+TEST_P(CompressionTableTest, CompressedBlockCache) {
+  CompressionType type = ::testing::get<0>(GetParam());
+  if (!CompressionSupported(type)) {
+    GTEST_SKIP() << "skipping compression test: " << type;
+  }
+
+  // The second scan is served from the compressed blocks in memory.
+  Cache* compressed_cache = NewLRUCache(1 << 20);
+  ASSERT_EQ(0, ScanTwiceThroughCompressedCache(type, compressed_cache));
+  ASSERT_GT(compressed_cache->TotalCharge(), 0);
+  ASSERT_LT(compressed_cache->TotalCharge(), 100 * 1000 / 2);
+  delete compressed_cache;
+}
+
 }  // namespace leveldb
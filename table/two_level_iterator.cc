@@ -18,7 +18,7 @@ typedef Iterator* (*BlockFunction)(void*, const ReadOptions&, const Slice&);
 class TwoLevelIterator : public Iterator {
  public:
   TwoLevelIterator(Iterator* index_iter, BlockFunction block_function,
-                   void* arg, const ReadOptions& options);
+                   void* arg, const ReadOptions& options, bool exact_index);
 
   ~TwoLevelIterator() override;
 
@@ -60,6 +60,7 @@ class TwoLevelIterator : public Iterator {
   BlockFunction block_function_;
   void* arg_;
   const ReadOptions options_;
+  const bool exact_index_;
   Status status_;
   IteratorWrapper index_iter_;
   IteratorWrapper data_iter_;  // May be nullptr
@@ -70,10 +71,12 @@ class TwoLevelIterator : public Iterator {
 
 TwoLevelIterator::TwoLevelIterator(Iterator* index_iter,
                                    BlockFunction block_function, void* arg,
-                                   const ReadOptions& options)
+                                   const ReadOptions& options,
+                                   bool exact_index)
     : block_function_(block_function),
       arg_(arg),
       options_(options),
+      exact_index_(exact_index),
       index_iter_(index_iter),
       data_iter_(nullptr) {}
 
@@ -83,6 +86,12 @@ void TwoLevelIterator::Seek(const Slice& target) {
   index_iter_.Seek(target);
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.Seek(target);
+  if (exact_index_ && options_.prefix_same_as_start &&
+      data_iter_.iter() != nullptr && !data_iter_.Valid() &&
+      data_iter_.status().ok()) {
+    // No entry of a later block can share the prefix of target.
+    return;
+  }
   SkipEmptyDataBlocksForward();
 }
 
@@ -164,8 +173,9 @@ void TwoLevelIterator::InitDataBlock() {
 
 Iterator* NewTwoLevelIterator(Iterator* index_iter,
                               BlockFunction block_function, void* arg,
-                              const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+                              const ReadOptions& options, bool exact_index) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              exact_index);
 }
 
 }  // namespace leveldb
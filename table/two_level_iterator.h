@@ -20,11 +20,18 @@ struct ReadOptions;
 //
 // Uses a supplied function to convert an index_iter value into
 // an iterator over the contents of the corresponding block.
+//
+// "exact_index" says that each index key is the largest key of its block
+// rather than just an upper bound for it, so that the block a Seek(target)
+// lands on holds the first entry >= target, if any.  With
+// ReadOptions::prefix_same_as_start, a Seek() that finds nothing in that
+// block (e.g. because a prefix filter ruled it out) then stops there
+// instead of moving on to the following blocks.
 Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     Iterator* (*block_function)(void* arg, const ReadOptions& options,
                                 const Slice& index_value),
-    void* arg, const ReadOptions& options);
+    void* arg, const ReadOptions& options, bool exact_index = false);
 
 }  // namespace leveldb
 
@@ -4,12 +4,28 @@
 
 #include "util/arena.h"
 
+#include <new>
+
+#include "util/mutexlock.h"
+
 namespace leveldb {
 
 static const int kBlockSize = 4096;
 
+// Alignment of AllocateAligned() and of the *Concurrently() allocations.
+static const size_t kAlign = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+static_assert((kAlign & (kAlign - 1)) == 0,
+              "Pointer size should be a power of 2");
+
+static size_t AlignUp(size_t bytes) {
+  return (bytes + kAlign - 1) & ~(kAlign - 1);
+}
+
 Arena::Arena()
-    : alloc_ptr_(nullptr), alloc_bytes_remaining_(0), memory_usage_(0) {}
+    : concurrent_block_(nullptr),
+      alloc_ptr_(nullptr),
+      alloc_bytes_remaining_(0),
+      memory_usage_(0) {}
 
 Arena::~Arena() {
   for (size_t i = 0; i < blocks_.size(); i++) {
@@ -34,9 +50,7 @@ char* Arena::AllocateFallback(size_t bytes) {
 }
 
 char* Arena::AllocateAligned(size_t bytes) {
-  const int align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
-  static_assert((align & (align - 1)) == 0,
-                "Pointer size should be a power of 2");
+  const int align = kAlign;
   size_t current_mod = reinterpret_cast<uintptr_t>(alloc_ptr_) & (align - 1);
   size_t slop = (current_mod == 0 ? 0 : align - current_mod);
   size_t needed = bytes + slop;
@@ -53,6 +67,51 @@ char* Arena::AllocateAligned(size_t bytes) {
   return result;
 }
 
+char* Arena::AllocateConcurrently(size_t bytes) {
+  // Allocations of both variants share the block, so all are aligned.
+  return AllocateAlignedConcurrently(bytes);
+}
+
+char* Arena::AllocateAlignedConcurrently(size_t bytes) {
+  assert(bytes > 0);
+  bytes = AlignUp(bytes);
+  ConcurrentBlock* block = concurrent_block_.load(std::memory_order_acquire);
+  if (block != nullptr) {
+    const size_t offset =
+        block->used.fetch_add(bytes, std::memory_order_relaxed);
+    if (offset + bytes <= kBlockSize) {
+      return reinterpret_cast<char*>(block) + offset;
+    }
+  }
+  return AllocateConcurrentlyFallback(bytes);
+}
+
+char* Arena::AllocateConcurrentlyFallback(size_t bytes) {
+  MutexLock l(&mu_);
+  if (bytes > kBlockSize / 4) {
+    // Large allocations get their own block, as in AllocateFallback().
+    return AllocateNewBlock(bytes);
+  }
+
+  // Another thread may have started a new block while this one waited.
+  ConcurrentBlock* block = concurrent_block_.load(std::memory_order_relaxed);
+  if (block != nullptr) {
+    const size_t offset =
+        block->used.fetch_add(bytes, std::memory_order_relaxed);
+    if (offset + bytes <= kBlockSize) {
+      return reinterpret_cast<char*>(block) + offset;
+    }
+  }
+
+  // The rest of the full block is left unused.
+  char* memory = AllocateNewBlock(kBlockSize);
+  const size_t header = AlignUp(sizeof(ConcurrentBlock));
+  block = new (memory) ConcurrentBlock;
+  block->used.store(header + bytes, std::memory_order_relaxed);
+  concurrent_block_.store(block, std::memory_order_release);
+  return memory + header;
+}
+
 char* Arena::AllocateNewBlock(size_t block_bytes) {
   char* result = new char[block_bytes];
   blocks_.push_back(result);
@@ -11,6 +11,9 @@
 #include <cstdint>
 #include <vector>
 
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
 namespace leveldb {
 
 // 只分配，不在运行时回收（仅在析构时回收）
@@ -29,6 +32,14 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc.
   char* AllocateAligned(size_t bytes);
 
+  // Variants of Allocate() and AllocateAligned() that may be called from
+  // several threads at once.  They must not be mixed with concurrent calls
+  // to the unsynchronized variants.  Both return aligned memory, carved
+  // out of a shared block with an atomic increment; only starting a new
+  // block takes a lock.
+  char* AllocateConcurrently(size_t bytes) LOCKS_EXCLUDED(mu_);
+  char* AllocateAlignedConcurrently(size_t bytes) LOCKS_EXCLUDED(mu_);
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena.
   size_t MemoryUsage() const {
@@ -36,9 +47,23 @@ class Arena {
   }
 
  private:
+  // Header of the block that the *Concurrently() allocations are carved
+  // out of, at the start of the block.
+  struct ConcurrentBlock {
+    std::atomic<size_t> used;  // Bytes handed out; may run past the end
+  };
+
   char* AllocateFallback(size_t bytes);
+  char* AllocateConcurrentlyFallback(size_t bytes) LOCKS_EXCLUDED(mu_);
   char* AllocateNewBlock(size_t block_bytes);
 
+  // Serializes the *Concurrently() allocations that start a new block
+  port::Mutex mu_;
+
+  // Block of the *Concurrently() allocations, or null before the first.
+  // Only replaced under mu_.
+  std::atomic<ConcurrentBlock*> concurrent_block_;
+
   // Allocation state
   char* alloc_ptr_;
   size_t alloc_bytes_remaining_;
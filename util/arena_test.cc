@@ -4,6 +4,8 @@
 
 #include "util/arena.h"
 
+#include <thread>
+
 #include "gtest/gtest.h"
 #include "util/random.h"
 
@@ -58,4 +60,45 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+TEST(ArenaTest, Concurrent) {
+  Arena arena;
+  const int kThreads = 4;
+  const int N = 20000;
+  std::vector<std::vector<std::pair<size_t, char*>>> allocated(kThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&arena, &allocated, t]() {
+      Random rnd(301 + t);
+      for (int i = 0; i < N; i++) {
+        const size_t s = rnd.OneIn(1000) ? 1 + rnd.Uniform(6000)
+                                         : 1 + rnd.Uniform(100);
+        char* r = rnd.OneIn(2) ? arena.AllocateAlignedConcurrently(s)
+                               : arena.AllocateConcurrently(s);
+        ASSERT_EQ(0, reinterpret_cast<uintptr_t>(r) % sizeof(void*));
+        for (size_t b = 0; b < s; b++) {
+          r[b] = (t * N + i) % 256;
+        }
+        allocated[t].push_back(std::make_pair(s, r));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  // No allocation was handed out twice.
+  size_t bytes = 0;
+  for (int t = 0; t < kThreads; t++) {
+    for (int i = 0; i < N; i++) {
+      const size_t num_bytes = allocated[t][i].first;
+      const char* p = allocated[t][i].second;
+      for (size_t b = 0; b < num_bytes; b++) {
+        ASSERT_EQ(int(p[b]) & 0xff, (t * N + i) % 256);
+      }
+      bytes += num_bytes;
+    }
+  }
+  ASSERT_GE(arena.MemoryUsage(), bytes);
+}
+
 }  // namespace leveldb
@@ -3,10 +3,19 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "leveldb/filter_policy.h"
-#include "leveldb/slice.h"
 
+#include <cstdint>
+
+#include "leveldb/slice.h"
 #include "util/hash.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define LEVELDB_BLOOM_HAVE_AVX2 1
+#else
+#define LEVELDB_BLOOM_HAVE_AVX2 0
+#endif
+
 namespace leveldb {
 
 namespace {
@@ -14,10 +23,87 @@ static uint32_t BloomHash(const Slice& key) {
   return Hash(key.data(), key.size(), 0xbc9f1d34);
 }
 
+// Blocked filters confine the probes of a key to one 64-byte line of the
+// bit array, so a lookup touches a single cache line instead of k of them.
+// The line is picked from the high bits of the key's hash; each probe then
+// takes the top 9 bits (one of the 512 bits of the line) of the hash
+// remultiplied by the golden ratio.
+//
+// Layout: lines * 64 bytes of bits, then k, then kBlockedBloomMarker.
+// Readers of the original format see a k above 30 in the last byte and
+// treat the filter as matching everything.
+static const size_t kCacheLineBytes = 64;
+static const char kBlockedBloomMarker = static_cast<char>(0xff);
+static const uint32_t kGoldenRatio = 0x9e3779b9;
+
+static inline const char* BlockedBloomLine(const char* array, size_t lines,
+                                           uint32_t h) {
+  return array + ((static_cast<uint64_t>(h) * lines) >> 32) * kCacheLineBytes;
+}
+
+static bool BlockedProbesMatch(const char* line, uint32_t h, size_t k) {
+  for (size_t j = 0; j < k; j++) {
+    h *= kGoldenRatio;
+    const uint32_t bitpos = h >> 23;
+    if ((line[bitpos / 8] & (1 << (bitpos % 8))) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#if LEVELDB_BLOOM_HAVE_AVX2
+// Same probes as BlockedProbesMatch(), eight at a time: each lane gathers
+// the 32-bit little-endian word holding its bit.
+__attribute__((target("avx2"))) static bool BlockedProbesMatchAVX2(
+    const char* line, uint32_t h, size_t k) {
+  // Lane i holds the hash of probe i, h * kGoldenRatio^(i+1).
+  const __m256i powers = _mm256_setr_epi32(
+      0x9e3779b9, 0xe35e67b1, 0x734297e9, 0x35fbe861, 0xdeb7c719, 0x0448b211,
+      0x3459b749, 0xab25f4c1);
+  const __m256i next_powers = _mm256_set1_epi32(0xab25f4c1);
+  const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i low5 = _mm256_set1_epi32(31);
+  __m256i hashes = _mm256_mullo_epi32(_mm256_set1_epi32(h), powers);
+  for (size_t done = 0; done < k; done += 8) {
+    const __m256i bitpos = _mm256_srli_epi32(hashes, 23);
+    const __m256i words = _mm256_i32gather_epi32(
+        reinterpret_cast<const int*>(line), _mm256_srli_epi32(bitpos, 5), 4);
+    __m256i bits = _mm256_sllv_epi32(one, _mm256_and_si256(bitpos, low5));
+    if (k - done < 8) {
+      // Ignore the lanes past the last probe.
+      bits = _mm256_and_si256(
+          bits, _mm256_cmpgt_epi32(
+                    _mm256_set1_epi32(static_cast<int>(k - done)), lane));
+    }
+    if (!_mm256_testc_si256(words, bits)) {
+      return false;
+    }
+    hashes = _mm256_mullo_epi32(hashes, next_powers);
+  }
+  return true;
+}
+#endif  // LEVELDB_BLOOM_HAVE_AVX2
+
+typedef bool (*BlockedProbeFunction)(const char* line, uint32_t h, size_t k);
+
+static BlockedProbeFunction ChooseBlockedProbe() {
+#if LEVELDB_BLOOM_HAVE_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    return &BlockedProbesMatchAVX2;
+  }
+#endif  // LEVELDB_BLOOM_HAVE_AVX2
+  return &BlockedProbesMatch;
+}
+
 class BloomFilterPolicy : public FilterPolicy {
  public:
   // bits_per_key 即 m/n，其中 m=位组长度，n=key数量
-  explicit BloomFilterPolicy(int bits_per_key) : bits_per_key_(bits_per_key) {
+  BloomFilterPolicy(int bits_per_key, bool blocked)
+      : bits_per_key_(bits_per_key),
+        blocked_(blocked),
+        blocked_probe_(ChooseBlockedProbe()) {
     // 算出最小误判率时的 k，等于 ln(2) * m/n，也就是 0.69 * bits_per_key
     // 故意舍入，以减少探测开销
     k_ = static_cast<size_t>(bits_per_key * 0.69);  // 0.69 ≈ ln(2)
@@ -27,9 +113,16 @@ class BloomFilterPolicy : public FilterPolicy {
     if (k_ > 30) k_ = 30;
   }
 
+  // Both layouts share a name: KeyMayMatch() reads either of them, so a
+  // database can switch between them without losing its existing filters.
   const char* Name() const override { return "leveldb.BuiltinBloomFilter2"; }
 
   void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    if (blocked_) {
+      CreateBlockedFilter(keys, n, dst);
+      return;
+    }
+
     // 1. 计算位图长度
     // 1.1 计算位图长度m
     size_t bits = n * bits_per_key_;  // n * m / n -> m
@@ -74,6 +167,9 @@ class BloomFilterPolicy : public FilterPolicy {
     if (len < 2) return false;  // 这里应该是9字节
 
     const char* array = bloom_filter.data();
+    if (array[len - 1] == kBlockedBloomMarker) {
+      return BlockedKeyMayMatch(key, bloom_filter);
+    }
     const size_t bits = (len - 1) * 8;  // -1表示去掉尾部的k
 
     // 读出k
@@ -95,13 +191,55 @@ class BloomFilterPolicy : public FilterPolicy {
   }
 
  private:
+  void CreateBlockedFilter(const Slice* keys, int n, std::string* dst) const {
+    const size_t bits = n * bits_per_key_;
+    size_t lines = (bits + kCacheLineBytes * 8 - 1) / (kCacheLineBytes * 8);
+    if (lines < 1) lines = 1;
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + lines * kCacheLineBytes, 0);
+    dst->push_back(static_cast<char>(k_));
+    dst->push_back(kBlockedBloomMarker);
+    char* array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      uint32_t h = BloomHash(keys[i]);
+      char* line = const_cast<char*>(BlockedBloomLine(array, lines, h));
+      for (size_t j = 0; j < k_; j++) {
+        h *= kGoldenRatio;
+        const uint32_t bitpos = h >> 23;
+        line[bitpos / 8] |= (1 << (bitpos % 8));
+      }
+    }
+  }
+
+  bool BlockedKeyMayMatch(const Slice& key, const Slice& bloom_filter) const {
+    const size_t len = bloom_filter.size();
+    if (len < kCacheLineBytes + 2 || (len - 2) % kCacheLineBytes != 0) {
+      return true;  // Not a filter we know how to read
+    }
+    const char* array = bloom_filter.data();
+    const size_t k = static_cast<unsigned char>(array[len - 2]);
+    if (k > 30) {
+      return true;
+    }
+    const size_t lines = (len - 2) / kCacheLineBytes;
+    const uint32_t h = BloomHash(key);
+    return (*blocked_probe_)(BlockedBloomLine(array, lines, h), h, k);
+  }
+
   size_t bits_per_key_;
   size_t k_;
+  bool blocked_;
+  BlockedProbeFunction blocked_probe_;
 };
 }  // namespace
 
 const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
-  return new BloomFilterPolicy(bits_per_key);
+  return new BloomFilterPolicy(bits_per_key, false);
+}
+
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key) {
+  return new BloomFilterPolicy(bits_per_key, true);
 }
 
 }  // namespace leveldb
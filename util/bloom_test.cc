@@ -20,6 +20,7 @@ static Slice Key(int i, char* buffer) {
 class BloomTest : public testing::Test {
  public:
   BloomTest() : policy_(NewBloomFilterPolicy(10)) {}
+  explicit BloomTest(const FilterPolicy* policy) : policy_(policy) {}
 
   ~BloomTest() { delete policy_; }
 
@@ -44,6 +45,8 @@ class BloomTest : public testing::Test {
 
   size_t FilterSize() const { return filter_.size(); }
 
+  const std::string& filter() const { return filter_; }
+
   void DumpFilter() {
     std::fprintf(stderr, "F(");
     for (size_t i = 0; i + 1 < filter_.size(); i++) {
@@ -151,4 +154,92 @@ TEST_F(BloomTest, VaryingLengths) {
 
 // Different bits-per-byte
 
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) {}
+};
+
+TEST_F(BlockedBloomTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(BlockedBloomTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(BlockedBloomTest, VaryingLengths) {
+  char buffer[sizeof(int)];
+
+  int mediocre_filters = 0;
+  int good_filters = 0;
+
+  for (int length = 1; length <= 10000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // Rounded up to whole 64-byte lines, plus the two trailer bytes
+    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 64 + 2))
+        << length;
+
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      std::fprintf(stderr,
+                   "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                   rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.02);
+    if (rate > 0.0125)
+      mediocre_filters++;
+    else
+      good_filters++;
+  }
+  if (kVerbose >= 1) {
+    std::fprintf(stderr, "Filters: %d good, %d mediocre\n", good_filters,
+                 mediocre_filters);
+  }
+  ASSERT_LE(mediocre_filters, good_filters / 5);
+}
+
+TEST(BloomFormatTest, PoliciesReadEachOther) {
+  const FilterPolicy* policies[2] = {NewBloomFilterPolicy(10),
+                                     NewBlockedBloomFilterPolicy(10)};
+  char buffer[sizeof(int)];
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1000; i++) {
+    keys.push_back(Key(i, buffer).ToString());
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  for (const FilterPolicy* writer : policies) {
+    std::string filter;
+    writer->CreateFilter(&key_slices[0], static_cast<int>(key_slices.size()),
+                         &filter);
+    for (const FilterPolicy* reader : policies) {
+      int false_positives = 0;
+      for (int i = 0; i < 1000; i++) {
+        ASSERT_TRUE(reader->KeyMayMatch(key_slices[i], filter));
+        if (reader->KeyMayMatch(Key(i + 1000000000, buffer), filter)) {
+          false_positives++;
+        }
+      }
+      ASSERT_LE(false_positives, 30);
+    }
+  }
+  delete policies[0];
+  delete policies[1];
+}
+
 }  // namespace leveldb
@@ -4,9 +4,14 @@
 
 #include "leveldb/cache.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
+#include <unordered_map>
+#include <utility>
 
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -17,6 +22,12 @@ namespace leveldb {
 
 Cache::~Cache() {}
 
+Cache::Handle* Cache::Insert(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) {
+  return Insert(key, value, charge, deleter);
+}
+
 namespace {
 
 // LRU cache implementation
@@ -57,6 +68,9 @@ struct LRUHandle {
   size_t charge;  // TODO(opt): Only allow uint32_t?
   size_t key_length;
   bool in_cache;     // Whether entry is in the cache.
+  bool hot;          // TwoQCache: whether entry belongs to the am list.
+                     // LRUCache: whether entry is in the high-pri pool.
+  bool high_priority;  // Inserted with Cache::Priority::kHigh.
   uint32_t refs;     // References, including cache reference, if present.
   uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
   char key_data[1];  // Beginning of key
@@ -163,6 +177,19 @@ class HandleTable {
   }
 };
 
+static void LRU_Remove(LRUHandle* e) {
+  e->next->prev = e->prev;
+  e->prev->next = e->next;
+}
+
+static void LRU_Append(LRUHandle* list, LRUHandle* e) {
+  // Make "e" newest entry by inserting just before *list
+  e->next = list;
+  e->prev = list->prev;
+  e->prev->next = e;
+  e->next->prev = e;
+}
+
 // A single shard of sharded cache.
 class LRUCache {
  public:
@@ -170,12 +197,17 @@ class LRUCache {
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, double high_pri_pool_ratio) {
+    capacity_ = capacity;
+    high_pri_pool_capacity_ =
+        static_cast<size_t>(capacity * high_pri_pool_ratio);
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
                         size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
@@ -186,25 +218,35 @@ class LRUCache {
   }
 
  private:
-  void LRU_Remove(LRUHandle* e);
-  void LRU_Append(LRUHandle* list, LRUHandle* e);
   void Ref(LRUHandle* e);
   void Unref(LRUHandle* e);
   bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Adds unused entry e as the newest entry of its list, and demotes the
+  // oldest entries of the high-pri pool if it grew over its capacity.
+  void LRUInsert(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Removes unused entry e from its list.
+  void LRURemove(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   // Initialized before use.
   // 0表示关闭缓存
   size_t capacity_;
+  size_t high_pri_pool_capacity_;
 
   // mutex_ protects the following state.
   mutable port::Mutex mutex_;
   size_t usage_ GUARDED_BY(mutex_);
+  size_t high_pri_pool_usage_ GUARDED_BY(mutex_);  // Charge of lru_high_
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
   // Entries have refs==1 and in_cache==true.
   LRUHandle lru_ GUARDED_BY(mutex_);
 
+  // Dummy head of the LRU list of the high-pri pool: unused entries that
+  // were inserted with Cache::Priority::kHigh, evicted only when lru_ is
+  // empty.
+  LRUHandle lru_high_ GUARDED_BY(mutex_);
+
   // Dummy head of in-use list.
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
@@ -212,29 +254,63 @@ class LRUCache {
   HandleTable table_ GUARDED_BY(mutex_);
 };
 
-LRUCache::LRUCache() : capacity_(0), usage_(0) {
+LRUCache::LRUCache()
+    : capacity_(0),
+      high_pri_pool_capacity_(0),
+      usage_(0),
+      high_pri_pool_usage_(0) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  lru_high_.next = &lru_high_;
+  lru_high_.prev = &lru_high_;
   in_use_.next = &in_use_;
   in_use_.prev = &in_use_;
 }
 
 LRUCache::~LRUCache() {
   assert(in_use_.next == &in_use_);  // Error if caller has an unreleased handle
-  for (LRUHandle* e = lru_.next; e != &lru_;) {
-    LRUHandle* next = e->next;
-    assert(e->in_cache);
-    e->in_cache = false;
-    assert(e->refs == 1);  // Invariant of lru_ list.
-    Unref(e);
-    e = next;
+  for (LRUHandle* list : {&lru_, &lru_high_}) {
+    for (LRUHandle* e = list->next; e != list;) {
+      LRUHandle* next = e->next;
+      assert(e->in_cache);
+      e->in_cache = false;
+      assert(e->refs == 1);  // Invariant of lru_ list.
+      Unref(e);
+      e = next;
+    }
+  }
+}
+
+void LRUCache::LRUInsert(LRUHandle* e) {
+  if (e->high_priority && high_pri_pool_capacity_ > 0) {
+    e->hot = true;
+    LRU_Append(&lru_high_, e);
+    high_pri_pool_usage_ += e->charge;
+    while (high_pri_pool_usage_ > high_pri_pool_capacity_) {
+      // Demote the oldest entry of the pool to the newest low-pri entry.
+      LRUHandle* old = lru_high_.next;
+      LRU_Remove(old);
+      old->hot = false;
+      high_pri_pool_usage_ -= old->charge;
+      LRU_Append(&lru_, old);
+    }
+  } else {
+    LRU_Append(&lru_, e);
+  }
+}
+
+void LRUCache::LRURemove(LRUHandle* e) {
+  LRU_Remove(e);
+  if (e->hot) {
+    e->hot = false;
+    high_pri_pool_usage_ -= e->charge;
   }
 }
 
 void LRUCache::Ref(LRUHandle* e) {
   if (e->refs == 1 && e->in_cache) {  // If on lru_ list, move to in_use_ list.
-    LRU_Remove(e);  // 从原链表删除
+    LRURemove(e);  // 从原链表删除
     LRU_Append(&in_use_, e);  // 加入in_use链表
   }
   e->refs++;
@@ -250,23 +326,10 @@ void LRUCache::Unref(LRUHandle* e) {
   } else if (e->in_cache && e->refs == 1) {
     // No longer in use; move to lru_ list.
     LRU_Remove(e);
-    LRU_Append(&lru_, e);
+    LRUInsert(e);
   }
 }
 
-void LRUCache::LRU_Remove(LRUHandle* e) {
-  e->next->prev = e->prev;
-  e->prev->next = e->next;
-}
-
-void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
-  // Make "e" newest entry by inserting just before *list
-  e->next = list;
-  e->prev = list->prev;
-  e->prev->next = e;
-  e->next->prev = e;
-}
-
 Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
   MutexLock l(&mutex_);
   LRUHandle* e = table_.Lookup(key, hash);
@@ -287,7 +350,8 @@ void LRUCache::Release(Cache::Handle* handle) {
 Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
                                 size_t charge,
                                 void (*deleter)(const Slice& key,
-                                                void* value)) {
+                                                void* value),
+                                Cache::Priority priority) {
   MutexLock l(&mutex_);
 
   LRUHandle* e =
@@ -298,6 +362,8 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->hot = false;
+  e->high_priority = (priority == Cache::Priority::kHigh);
   e->refs = 1;  // for the returned handle.
   std::memcpy(e->key_data, key.data(), key.size());
 
@@ -311,8 +377,9 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
     // next is read by key() in an assert, so it must be initialized
     e->next = nullptr;
   }
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
+  while (usage_ > capacity_ &&
+         (lru_.next != &lru_ || lru_high_.next != &lru_high_)) {
+    LRUHandle* old = lru_.next != &lru_ ? lru_.next : lru_high_.next;
     assert(old->refs == 1);
     bool erased = FinishErase(table_.Remove(old->key(), old->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
@@ -328,7 +395,7 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
 bool LRUCache::FinishErase(LRUHandle* e) {
   if (e != nullptr) {
     assert(e->in_cache);
-    LRU_Remove(e);
+    LRURemove(e);
     e->in_cache = false;
     usage_ -= e->charge;
     Unref(e);
@@ -344,22 +411,650 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
 // 将lru中的所有元素删除
 void LRUCache::Prune() {
   MutexLock l(&mutex_);
-  while (lru_.next != &lru_) {
-    LRUHandle* e = lru_.next;
-    assert(e->refs == 1);
-    bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+  for (LRUHandle* list : {&lru_, &lru_high_}) {
+    while (list->next != list) {
+      LRUHandle* e = list->next;
+      assert(e->refs == 1);
+      bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
+    }
+  }
+}
+
+// A single shard of a 2Q cache [Johnson, Shasha 1994].
+//
+// Like LRUCache, entries referenced by clients are kept on an in-use list.
+// The others are on one of two lists:
+// - a1in: FIFO of entries that were inserted but not looked up since.
+//   When more than a quarter of the capacity is charged to such entries,
+//   evictions come from here.
+// - am: LRU list of entries that were looked up again while in the cache,
+//   or that were inserted again shortly after being evicted from a1in.
+// The hashes of entries evicted from a1in are remembered in the ghost FIFO
+// a1out, whose entries add up to at most half of the capacity.
+//
+// A scan through entries that are used once only churns a1in and a1out,
+// and leaves the entries that are used over and over on am alone.
+class TwoQCache {
+ public:
+  TwoQCache();
+  ~TwoQCache();
+
+  // Separate from constructor so caller can easily make an array of shards
+  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const {
+    MutexLock l(&mutex_);
+    return usage_;
+  }
+
+ private:
+  void Ref(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void Unref(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void RememberEvicted(uint32_t hash, size_t charge)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Initialized before use.
+  size_t capacity_;
+
+  // mutex_ protects the following state.
+  mutable port::Mutex mutex_;
+  size_t usage_ GUARDED_BY(mutex_);
+  size_t a1in_usage_ GUARDED_BY(mutex_);  // Charge of entries not hot
+
+  // Dummy heads of the a1in and am lists.  prev is the newest entry, next
+  // the oldest.  Entries have refs==1 and in_cache==true.
+  LRUHandle a1in_ GUARDED_BY(mutex_);
+  LRUHandle am_ GUARDED_BY(mutex_);
+
+  // Dummy head of in-use list.
+  // Entries are in use by clients, and have refs >= 2 and in_cache==true.
+  LRUHandle in_use_ GUARDED_BY(mutex_);
+
+  HandleTable table_ GUARDED_BY(mutex_);
+
+  // Ghost entries: hash and charge, oldest first, and count by hash.
+  std::deque<std::pair<uint32_t, size_t>> a1out_ GUARDED_BY(mutex_);
+  std::unordered_map<uint32_t, int> a1out_count_ GUARDED_BY(mutex_);
+  size_t a1out_usage_ GUARDED_BY(mutex_);
+};
+
+TwoQCache::TwoQCache()
+    : capacity_(0), usage_(0), a1in_usage_(0), a1out_usage_(0) {
+  // Make empty circular linked lists.
+  a1in_.next = &a1in_;
+  a1in_.prev = &a1in_;
+  am_.next = &am_;
+  am_.prev = &am_;
+  in_use_.next = &in_use_;
+  in_use_.prev = &in_use_;
+}
+
+TwoQCache::~TwoQCache() {
+  assert(in_use_.next == &in_use_);  // Error if caller has an unreleased handle
+  for (LRUHandle* list : {&a1in_, &am_}) {
+    for (LRUHandle* e = list->next; e != list;) {
+      LRUHandle* next = e->next;
+      assert(e->in_cache);
+      e->in_cache = false;
+      assert(e->refs == 1);  // Invariant of a1in_ and am_ lists.
+      Unref(e);
+      e = next;
+    }
+  }
+}
+
+void TwoQCache::Ref(LRUHandle* e) {
+  if (e->refs == 1 && e->in_cache) {  // If on a1in_ or am_, move to in_use_.
+    LRU_Remove(e);
+    LRU_Append(&in_use_, e);
+  }
+  e->refs++;
+}
+
+void TwoQCache::Unref(LRUHandle* e) {
+  assert(e->refs > 0);
+  e->refs--;
+  if (e->refs == 0) {  // Deallocate.
+    assert(!e->in_cache);
+    (*e->deleter)(e->key(), e->value);
+    free(e);
+  } else if (e->in_cache && e->refs == 1) {
+    // No longer in use; move to the list the entry belongs to.
+    LRU_Remove(e);
+    LRU_Append(e->hot ? &am_ : &a1in_, e);
+  }
+}
+
+void TwoQCache::RememberEvicted(uint32_t hash, size_t charge) {
+  a1out_.emplace_back(hash, charge);
+  a1out_count_[hash]++;
+  a1out_usage_ += charge;
+  while (a1out_usage_ > capacity_ / 2) {
+    const std::pair<uint32_t, size_t> oldest = a1out_.front();
+    a1out_.pop_front();
+    auto it = a1out_count_.find(oldest.first);
+    if (--it->second == 0) {
+      a1out_count_.erase(it);
+    }
+    a1out_usage_ -= oldest.second;
+  }
+}
+
+Cache::Handle* TwoQCache::Lookup(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  LRUHandle* e = table_.Lookup(key, hash);
+  if (e != nullptr) {
+    Ref(e);
+    if (!e->hot) {
+      // Used again: moves to am_ once released.
+      e->hot = true;
+      a1in_usage_ -= e->charge;
+    }
+  }
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void TwoQCache::Release(Cache::Handle* handle) {
+  MutexLock l(&mutex_);
+  Unref(reinterpret_cast<LRUHandle*>(handle));
+}
+
+Cache::Handle* TwoQCache::Insert(const Slice& key, uint32_t hash, void* value,
+                                 size_t charge,
+                                 void (*deleter)(const Slice& key,
+                                                 void* value),
+                                 Cache::Priority priority) {
+  MutexLock l(&mutex_);
+
+  LRUHandle* e =
+      reinterpret_cast<LRUHandle*>(malloc(sizeof(LRUHandle) - 1 + key.size()));
+  e->value = value;
+  e->deleter = deleter;
+  e->charge = charge;
+  e->key_length = key.size();
+  e->hash = hash;
+  e->in_cache = false;
+  // High priority entries, and keys evicted from a1in not long ago, go
+  // straight to am.
+  e->hot = priority == Cache::Priority::kHigh ||
+           a1out_count_.count(hash) != 0;
+  e->high_priority = (priority == Cache::Priority::kHigh);
+  e->refs = 1;  // for the returned handle.
+  std::memcpy(e->key_data, key.data(), key.size());
+
+  if (capacity_ > 0) {
+    e->refs++;  // for the cache's reference.
+    e->in_cache = true;
+    LRU_Append(&in_use_, e);
+    usage_ += charge;
+    if (!e->hot) {
+      a1in_usage_ += charge;
+    }
+    FinishErase(table_.Insert(e));
+  } else {  // don't cache. (capacity_==0 is supported and turns off caching.)
+    // next is read by key() in an assert, so it must be initialized
+    e->next = nullptr;
+  }
+  while (usage_ > capacity_) {
+    LRUHandle* old;
+    if (a1in_.next != &a1in_ &&
+        (a1in_usage_ > capacity_ / 4 || am_.next == &am_)) {
+      old = a1in_.next;
+      RememberEvicted(old->hash, old->charge);
+    } else if (am_.next != &am_) {
+      old = am_.next;
+    } else {
+      break;  // Everything else is in use
+    }
+    assert(old->refs == 1);
+    bool erased = FinishErase(table_.Remove(old->key(), old->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
       assert(erased);
     }
   }
+
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+// If e != nullptr, finish removing *e from the cache; it has already been
+// removed from the hash table.  Return whether e != nullptr.
+bool TwoQCache::FinishErase(LRUHandle* e) {
+  if (e != nullptr) {
+    assert(e->in_cache);
+    LRU_Remove(e);
+    e->in_cache = false;
+    usage_ -= e->charge;
+    if (!e->hot) {
+      a1in_usage_ -= e->charge;
+    }
+    Unref(e);
+  }
+  return e != nullptr;
+}
+
+void TwoQCache::Erase(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  FinishErase(table_.Remove(key, hash));
+}
+
+void TwoQCache::Prune() {
+  MutexLock l(&mutex_);
+  for (LRUHandle* list : {&a1in_, &am_}) {
+    while (list->next != list) {
+      LRUHandle* e = list->next;
+      assert(e->refs == 1);
+      bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
+    }
+  }
+  a1out_.clear();
+  a1out_count_.clear();
+  a1out_usage_ = 0;
 }
 
-static const int kNumShardBits = 4;
-static const int kNumShards = 1 << kNumShardBits;
+// A single shard of a CLOCK cache whose Lookup() and Release() take no
+// locks.
+//
+// Entries live in a fixed-size open-addressing table, sized for the
+// capacity and the expected charge of an entry.  Each slot has an atomic
+// "meta" word that combines
+// - the number of references held by clients,
+// - a CLOCK countdown, set to its maximum by every hit and decremented by
+//   the CLOCK hand, which evicts unreferenced entries at zero, and
+// - the state of the slot:
+//   - empty;
+//   - under construction: owned by a single thread, which is filling in or
+//     freeing the entry;
+//   - visible: holds an entry that Lookup() may return;
+//   - invisible: holds an erased entry that is still referenced, and is
+//     freed by whoever drops the last reference.
+// Lookup() optimistically adds a reference to each slot it probes, and
+// only keeps it if the slot turns out to be visible with a matching key.
+// A slot leaves the visible and invisible states only through a
+// compare-and-swap that expects no references, so an entry cannot be freed
+// while referenced.  Threads never overwrite the reference count of a slot
+// they do not hold a reference on; at worst they see transient references
+// that are undone right away.
+//
+// Probing uses double hashing.  Every slot counts the entries whose probe
+// sequence passes over it, so lookups for absent keys stop at the first
+// slot with a count of zero.
+//
+// Entries that do not fit (a full table, or capacity 0) are returned as
+// handles that are not in the cache, and are freed on Release().
+struct ClockHandle {
+  std::atomic<uint64_t> meta;
+  std::atomic<uint32_t> displacements;
+  uint32_t hash;
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  size_t charge;
+  size_t key_length;
+  char* key_data;  // Points to key_inline for short keys
+  char key_inline[16];
+  bool detached;  // Not in a cache table
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+class ClockCache {
+ public:
+  ClockCache();
+  ~ClockCache();
+
+  // Separate from constructor so caller can easily make an array of shards
+  void SetCapacity(size_t capacity, size_t estimated_entry_charge);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const { return usage_.load(std::memory_order_relaxed); }
 
-class ShardedLRUCache : public Cache {
  private:
-  LRUCache shard_[kNumShards];
+  // Layout of ClockHandle::meta
+  static const uint64_t kOneRef = 1;
+  static const uint64_t kRefsMask = (uint64_t{1} << 32) - 1;
+  static const int kCountdownShift = 32;
+  static const uint64_t kOneCountdown = uint64_t{1} << kCountdownShift;
+  static const uint64_t kMaxCountdown = 3;
+  static const int kStateShift = 62;
+  static const uint64_t kStateEmpty = 0;
+  static const uint64_t kStateConstruction = 1;
+  static const uint64_t kStateVisible = 2;
+  static const uint64_t kStateInvisible = 3;
+
+  static uint64_t Refs(uint64_t meta) { return meta & kRefsMask; }
+  static uint64_t Countdown(uint64_t meta) {
+    return (meta >> kCountdownShift) & kMaxCountdown;
+  }
+  static uint64_t State(uint64_t meta) { return meta >> kStateShift; }
+  // Added to meta to move a slot from state "from" to state "to"
+  static uint64_t StateDelta(uint64_t from, uint64_t to) {
+    return (to - from) << kStateShift;
+  }
+
+  uint32_t ProbeStart(uint32_t hash) const { return hash & mask_; }
+  uint32_t ProbeIncrement(uint32_t hash) const {
+    // Odd, hence coprime with the power of two table size.
+    return (hash >> 16) | 1;
+  }
+
+  // Returns a referenced visible entry for key, other than *exclude, or
+  // nullptr.
+  ClockHandle* Find(const Slice& key, uint32_t hash,
+                    const ClockHandle* exclude);
+  // Drops a reference, and frees the entry if that made it unreferenced
+  // and invisible.
+  void Unref(ClockHandle* h);
+  // Turns visible entry *h, which the caller references, invisible.
+  void MakeInvisible(ClockHandle* h);
+  // Frees the entry in *h, which the caller owns in the construction
+  // state, and empties the slot.
+  void FreeEntry(ClockHandle* h);
+  // Moves the CLOCK hand until the cache has room for "charge" more and a
+  // new table entry, or until it has gone around a few times.
+  void Evict(size_t charge);
+  // Tries to take ownership of an unreferenced slot in state "state", as
+  // last read in *meta.
+  bool TryOwn(ClockHandle* h, uint64_t meta, uint64_t state);
+  bool NeedsEviction(size_t charge) const {
+    return usage_.load(std::memory_order_relaxed) + charge > capacity_ ||
+           occupancy_.load(std::memory_order_relaxed) >= max_occupancy_;
+  }
+
+  size_t capacity_;
+  size_t max_occupancy_;
+  uint32_t mask_;
+  ClockHandle* table_;  // mask_ + 1 slots
+  std::atomic<size_t> usage_;
+  std::atomic<size_t> occupancy_;
+  std::atomic<uint32_t> clock_hand_;
+};
+
+ClockCache::ClockCache()
+    : capacity_(0),
+      max_occupancy_(0),
+      mask_(0),
+      table_(nullptr),
+      usage_(0),
+      occupancy_(0),
+      clock_hand_(0) {}
+
+ClockCache::~ClockCache() {
+  for (uint32_t i = 0; i <= mask_; i++) {
+    ClockHandle* h = &table_[i];
+    const uint64_t meta = h->meta.load(std::memory_order_relaxed);
+    if (State(meta) != kStateEmpty) {
+      // Error if caller has an unreleased handle
+      assert(State(meta) == kStateVisible && Refs(meta) == 0);
+      (*h->deleter)(h->key(), h->value);
+      if (h->key_data != h->key_inline) {
+        delete[] h->key_data;
+      }
+    }
+  }
+  delete[] table_;
+}
+
+void ClockCache::SetCapacity(size_t capacity, size_t estimated_entry_charge) {
+  assert(table_ == nullptr);
+  capacity_ = capacity;
+  // Aim for a load factor of about 0.7 when the cache is full.
+  const size_t entries =
+      capacity / std::max<size_t>(estimated_entry_charge, 1) + 1;
+  uint32_t slots = 16;
+  while (slots < entries + entries / 2 && slots < (uint32_t{1} << 30)) {
+    slots *= 2;
+  }
+  mask_ = slots - 1;
+  max_occupancy_ = slots - slots / 8;
+  table_ = new ClockHandle[slots]();
+}
+
+ClockHandle* ClockCache::Find(const Slice& key, uint32_t hash,
+                              const ClockHandle* exclude) {
+  uint32_t index = ProbeStart(hash);
+  const uint32_t increment = ProbeIncrement(hash);
+  for (uint32_t probes = 0; probes <= mask_; probes++) {
+    ClockHandle* h = &table_[index];
+    if (State(h->meta.load(std::memory_order_acquire)) == kStateVisible &&
+        h != exclude) {
+      const uint64_t meta =
+          h->meta.fetch_add(kOneRef, std::memory_order_acq_rel);
+      if (State(meta) == kStateVisible && h->hash == hash && h->key() == key) {
+        return h;
+      }
+      Unref(h);
+    }
+    if (h->displacements.load(std::memory_order_acquire) == 0) {
+      break;
+    }
+    index = (index + increment) & mask_;
+  }
+  return nullptr;
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key, uint32_t hash) {
+  ClockHandle* h = Find(key, hash, nullptr);
+  if (h != nullptr) {
+    if (Countdown(h->meta.load(std::memory_order_relaxed)) != kMaxCountdown) {
+      h->meta.fetch_or(kMaxCountdown << kCountdownShift,
+                       std::memory_order_relaxed);
+    }
+  }
+  return reinterpret_cast<Cache::Handle*>(h);
+}
+
+void ClockCache::Unref(ClockHandle* h) {
+  const uint64_t meta = h->meta.fetch_sub(kOneRef, std::memory_order_acq_rel);
+  assert(Refs(meta) > 0);
+  if (Refs(meta) != 1) {
+    return;
+  }
+  if (h->detached) {
+    (*h->deleter)(h->key(), h->value);
+    if (h->key_data != h->key_inline) {
+      delete[] h->key_data;
+    }
+    delete h;
+  } else if (State(meta) == kStateInvisible &&
+             TryOwn(h, meta - kOneRef, kStateInvisible)) {
+    FreeEntry(h);
+  }
+}
+
+void ClockCache::Release(Cache::Handle* handle) {
+  Unref(reinterpret_cast<ClockHandle*>(handle));
+}
+
+bool ClockCache::TryOwn(ClockHandle* h, uint64_t meta, uint64_t state) {
+  if (State(meta) != state || Refs(meta) != 0) {
+    return false;
+  }
+  return h->meta.compare_exchange_strong(
+      meta, meta + StateDelta(state, kStateConstruction),
+      std::memory_order_acq_rel);
+}
+
+void ClockCache::MakeInvisible(ClockHandle* h) {
+  uint64_t meta = h->meta.load(std::memory_order_relaxed);
+  while (State(meta) == kStateVisible &&
+         !h->meta.compare_exchange_weak(
+             meta, meta + StateDelta(kStateVisible, kStateInvisible),
+             std::memory_order_acq_rel)) {
+  }
+}
+
+void ClockCache::FreeEntry(ClockHandle* h) {
+  (*h->deleter)(h->key(), h->value);
+  if (h->key_data != h->key_inline) {
+    delete[] h->key_data;
+  }
+  usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+
+  // Entries further along the probe sequence no longer pass over the slots
+  // before this one.
+  const uint32_t target = static_cast<uint32_t>(h - table_);
+  const uint32_t increment = ProbeIncrement(h->hash);
+  for (uint32_t index = ProbeStart(h->hash); index != target;
+       index = (index + increment) & mask_) {
+    table_[index].displacements.fetch_sub(1, std::memory_order_release);
+  }
+
+  // Only this thread changes the countdown of a slot under construction.
+  const uint64_t meta = h->meta.load(std::memory_order_relaxed);
+  h->meta.fetch_sub(StateDelta(kStateEmpty, kStateConstruction) +
+                        Countdown(meta) * kOneCountdown,
+                    std::memory_order_release);
+  occupancy_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void ClockCache::Evict(size_t charge) {
+  const uint64_t max_steps = (uint64_t{mask_} + 1) * (kMaxCountdown + 2);
+  for (uint64_t step = 0; step < max_steps && NeedsEviction(charge); step++) {
+    ClockHandle* h =
+        &table_[clock_hand_.fetch_add(1, std::memory_order_relaxed) & mask_];
+    uint64_t meta = h->meta.load(std::memory_order_relaxed);
+    if (Refs(meta) != 0) {
+      continue;
+    }
+    if (State(meta) == kStateVisible) {
+      if (Countdown(meta) > 0) {
+        h->meta.compare_exchange_strong(meta, meta - kOneCountdown,
+                                        std::memory_order_relaxed);
+      } else if (TryOwn(h, meta, kStateVisible)) {
+        FreeEntry(h);
+      }
+    } else if (State(meta) == kStateInvisible &&
+               TryOwn(h, meta, kStateInvisible)) {
+      // Its last reference was dropped while we raced with its owner.
+      FreeEntry(h);
+    }
+  }
+}
+
+Cache::Handle* ClockCache::Insert(const Slice& key, uint32_t hash,
+                                  void* value, size_t charge,
+                                  void (*deleter)(const Slice& key,
+                                                  void* value),
+                                  Cache::Priority priority) {
+  ClockHandle* h = nullptr;
+  if (capacity_ > 0) {
+    if (NeedsEviction(charge)) {
+      Evict(charge);
+    }
+    // Claim the first empty slot in the probe sequence, recording in the
+    // slots passed over that this entry lies beyond them.
+    uint32_t index = ProbeStart(hash);
+    const uint32_t increment = ProbeIncrement(hash);
+    uint32_t probes = 0;
+    for (; probes <= mask_; probes++) {
+      ClockHandle* slot = &table_[index];
+      if (TryOwn(slot, slot->meta.load(std::memory_order_relaxed),
+                 kStateEmpty)) {
+        h = slot;
+        break;
+      }
+      slot->displacements.fetch_add(1, std::memory_order_acq_rel);
+      index = (index + increment) & mask_;
+    }
+    if (h == nullptr) {
+      // The table is full of entries in use.
+      index = ProbeStart(hash);
+      for (uint32_t i = 0; i < probes; i++) {
+        table_[index].displacements.fetch_sub(1, std::memory_order_release);
+        index = (index + increment) & mask_;
+      }
+    }
+  }
+  if (h == nullptr) {
+    h = new ClockHandle();
+    h->detached = true;
+  } else {
+    occupancy_.fetch_add(1, std::memory_order_relaxed);
+    usage_.fetch_add(charge, std::memory_order_relaxed);
+  }
+
+  h->hash = hash;
+  h->value = value;
+  h->deleter = deleter;
+  h->charge = charge;
+  h->key_length = key.size();
+  h->key_data = key.size() <= sizeof(h->key_inline) ? h->key_inline
+                                                    : new char[key.size()];
+  std::memcpy(h->key_data, key.data(), key.size());
+
+  // Publish the entry, with a reference for the returned handle.
+  if (h->detached) {
+    h->meta.store((kStateVisible << kStateShift) | kOneRef,
+                  std::memory_order_relaxed);
+    return reinterpret_cast<Cache::Handle*>(h);
+  }
+  // High priority entries start out as if they had been hit.
+  const uint64_t countdown =
+      priority == Cache::Priority::kHigh ? kMaxCountdown : 1;
+  h->meta.fetch_add(StateDelta(kStateConstruction, kStateVisible) +
+                        countdown * kOneCountdown + kOneRef,
+                    std::memory_order_release);
+
+  // Replace any older entry for the key.
+  ClockHandle* old = Find(key, hash, h);
+  if (old != nullptr) {
+    MakeInvisible(old);
+    Unref(old);
+  }
+  return reinterpret_cast<Cache::Handle*>(h);
+}
+
+void ClockCache::Erase(const Slice& key, uint32_t hash) {
+  ClockHandle* h = Find(key, hash, nullptr);
+  if (h != nullptr) {
+    MakeInvisible(h);
+    Unref(h);
+  }
+}
+
+void ClockCache::Prune() {
+  for (uint32_t i = 0; i <= mask_; i++) {
+    ClockHandle* h = &table_[i];
+    if (TryOwn(h, h->meta.load(std::memory_order_relaxed), kStateVisible)) {
+      FreeEntry(h);
+    }
+  }
+}
+
+static const int kDefaultNumShardBits = 4;
+static const int kMaxNumShardBits = 12;
+
+// Spreads the keys over 2^num_shard_bits shards of type CacheShard, whose
+// handles are Entry objects.
+template <typename CacheShard, typename Entry>
+class ShardedCache : public Cache {
+ private:
+  const int num_shard_bits_;
+  const int num_shards_;
+  CacheShard* const shards_;
   port::Mutex id_mutex_;
   uint64_t last_id_;
 
@@ -367,49 +1062,68 @@ class ShardedLRUCache : public Cache {
     return Hash(s.data(), s.size(), 0);
   }
 
-  static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+  static int SanitizeShardBits(int num_shard_bits) {
+    if (num_shard_bits < 0) return kDefaultNumShardBits;
+    return std::min(num_shard_bits, kMaxNumShardBits);
+  }
+
+  CacheShard& Shard(uint32_t hash) {
+    return shards_[num_shard_bits_ == 0 ? 0
+                                        : hash >> (32 - num_shard_bits_)];
+  }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
-    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
-    for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+  // Extra arguments are passed on to CacheShard::SetCapacity().
+  template <typename... Args>
+  ShardedCache(size_t capacity, int num_shard_bits, Args... args)
+      : num_shard_bits_(SanitizeShardBits(num_shard_bits)),
+        num_shards_(1 << num_shard_bits_),
+        shards_(new CacheShard[num_shards_]),
+        last_id_(0) {
+    const size_t per_shard = (capacity + (num_shards_ - 1)) / num_shards_;
+    for (int s = 0; s < num_shards_; s++) {
+      shards_[s].SetCapacity(per_shard, args...);
     }
   }
-  ~ShardedLRUCache() override {}
+  ~ShardedCache() override { delete[] shards_; }
   Handle* Insert(const Slice& key, void* value, size_t charge,
                  void (*deleter)(const Slice& key, void* value)) override {
+    return Insert(key, value, charge, deleter, Priority::kLow);
+  }
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value),
+                 Priority priority) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return Shard(hash).Insert(key, hash, value, charge, deleter, priority);
   }
   Handle* Lookup(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Lookup(key, hash);
+    return Shard(hash).Lookup(key, hash);
   }
   void Release(Handle* handle) override {
-    LRUHandle* h = reinterpret_cast<LRUHandle*>(handle);
-    shard_[Shard(h->hash)].Release(handle);
+    Entry* h = reinterpret_cast<Entry*>(handle);
+    Shard(h->hash).Release(handle);
   }
   void Erase(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
-    shard_[Shard(hash)].Erase(key, hash);
+    Shard(hash).Erase(key, hash);
   }
   void* Value(Handle* handle) override {
-    return reinterpret_cast<LRUHandle*>(handle)->value;
+    return reinterpret_cast<Entry*>(handle)->value;
   }
   uint64_t NewId() override {
     MutexLock l(&id_mutex_);
     return ++(last_id_);
   }
   void Prune() override {
-    for (int s = 0; s < kNumShards; s++) {
-      shard_[s].Prune();
+    for (int s = 0; s < num_shards_; s++) {
+      shards_[s].Prune();
     }
   }
   size_t TotalCharge() const override {
     size_t total = 0;
-    for (int s = 0; s < kNumShards; s++) {
-      total += shard_[s].TotalCharge();
+    for (int s = 0; s < num_shards_; s++) {
+      total += shards_[s].TotalCharge();
     }
     return total;
   }
@@ -417,6 +1131,22 @@ class ShardedLRUCache : public Cache {
 
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+Cache* NewLRUCache(size_t capacity) { return NewLRUCache(capacity, -1, 0.5); }
+
+Cache* NewLRUCache(size_t capacity, int num_shard_bits,
+                   double high_pri_pool_ratio) {
+  return new ShardedCache<LRUCache, LRUHandle>(capacity, num_shard_bits,
+                                               high_pri_pool_ratio);
+}
+
+Cache* New2QCache(size_t capacity, int num_shard_bits) {
+  return new ShardedCache<TwoQCache, LRUHandle>(capacity, num_shard_bits);
+}
+
+Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge,
+                     int num_shard_bits) {
+  return new ShardedCache<ClockCache, ClockHandle>(capacity, num_shard_bits,
+                                                   estimated_entry_charge);
+}
 
 }  // namespace leveldb
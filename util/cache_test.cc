@@ -4,10 +4,13 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
 #include "util/coding.h"
+#include "util/random.h"
 
 namespace leveldb {
 
@@ -24,7 +27,21 @@ static int DecodeKey(const Slice& k) {
 static void* EncodeValue(uintptr_t v) { return reinterpret_cast<void*>(v); }
 static int DecodeValue(void* v) { return reinterpret_cast<uintptr_t>(v); }
 
-class CacheTest : public testing::Test {
+enum CacheType { kLRU, k2Q, kClock };
+
+static Cache* NewCache(CacheType type, size_t capacity) {
+  switch (type) {
+    case kLRU:
+      return NewLRUCache(capacity);
+    case k2Q:
+      return New2QCache(capacity);
+    case kClock:
+      return NewClockCache(capacity, 1);
+  }
+  return nullptr;
+}
+
+class CacheTest : public testing::TestWithParam<CacheType> {
  public:
   static void Deleter(const Slice& key, void* v) {
     current_->deleted_keys_.push_back(DecodeKey(key));
@@ -36,7 +53,7 @@ class CacheTest : public testing::Test {
   std::vector<int> deleted_values_;
   Cache* cache_;
 
-  CacheTest() : cache_(NewLRUCache(kCacheSize)) { current_ = this; }
+  CacheTest() : cache_(NewCache(GetParam(), kCacheSize)) { current_ = this; }
 
   ~CacheTest() { delete cache_; }
 
@@ -49,9 +66,10 @@ class CacheTest : public testing::Test {
     return r;
   }
 
-  void Insert(int key, int value, int charge = 1) {
+  void Insert(int key, int value, int charge = 1,
+              Cache::Priority priority = Cache::Priority::kLow) {
     cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
-                                   &CacheTest::Deleter));
+                                   &CacheTest::Deleter, priority));
   }
 
   Cache::Handle* InsertAndReturnHandle(int key, int value, int charge = 1) {
@@ -64,7 +82,7 @@ class CacheTest : public testing::Test {
 };
 CacheTest* CacheTest::current_;
 
-TEST_F(CacheTest, HitAndMiss) {
+TEST_P(CacheTest, HitAndMiss) {
   ASSERT_EQ(-1, Lookup(100));
 
   Insert(100, 101);
@@ -87,7 +105,7 @@ TEST_F(CacheTest, HitAndMiss) {
   ASSERT_EQ(101, deleted_values_[0]);
 }
 
-TEST_F(CacheTest, Erase) {
+TEST_P(CacheTest, Erase) {
   Erase(200);
   ASSERT_EQ(0, deleted_keys_.size());
 
@@ -106,7 +124,7 @@ TEST_F(CacheTest, Erase) {
   ASSERT_EQ(1, deleted_keys_.size());
 }
 
-TEST_F(CacheTest, EntriesArePinned) {
+TEST_P(CacheTest, EntriesArePinned) {
   Insert(100, 101);
   Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
   ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
@@ -131,7 +149,7 @@ TEST_F(CacheTest, EntriesArePinned) {
   ASSERT_EQ(102, deleted_values_[1]);
 }
 
-TEST_F(CacheTest, EvictionPolicy) {
+TEST_P(CacheTest, EvictionPolicy) {
   Insert(100, 101);
   Insert(200, 201);
   Insert(300, 301);
@@ -145,12 +163,15 @@ TEST_F(CacheTest, EvictionPolicy) {
     ASSERT_EQ(101, Lookup(100));
   }
   ASSERT_EQ(101, Lookup(100));
-  ASSERT_EQ(-1, Lookup(200));
+  if (GetParam() != k2Q) {
+    // 2Q keeps an entry used once until other such entries need the room.
+    ASSERT_EQ(-1, Lookup(200));
+  }
   ASSERT_EQ(301, Lookup(300));
   cache_->Release(h);
 }
 
-TEST_F(CacheTest, UseExceedsCacheSize) {
+TEST_P(CacheTest, UseExceedsCacheSize) {
   // Overfill the cache, keeping handles on all inserted entries.
   std::vector<Cache::Handle*> h;
   for (int i = 0; i < kCacheSize + 100; i++) {
@@ -167,7 +188,7 @@ TEST_F(CacheTest, UseExceedsCacheSize) {
   }
 }
 
-TEST_F(CacheTest, HeavyEntries) {
+TEST_P(CacheTest, HeavyEntries) {
   // Add a bunch of light and heavy entries and then count the combined
   // size of items still in the cache, which must be approximately the
   // same as the total capacity.
@@ -194,13 +215,13 @@ TEST_F(CacheTest, HeavyEntries) {
   ASSERT_LE(cached_weight, kCacheSize + kCacheSize / 10);
 }
 
-TEST_F(CacheTest, NewId) {
+TEST_P(CacheTest, NewId) {
   uint64_t a = cache_->NewId();
   uint64_t b = cache_->NewId();
   ASSERT_NE(a, b);
 }
 
-TEST_F(CacheTest, Prune) {
+TEST_P(CacheTest, Prune) {
   Insert(1, 100);
   Insert(2, 200);
 
@@ -213,12 +234,142 @@ TEST_F(CacheTest, Prune) {
   ASSERT_EQ(-1, Lookup(2));
 }
 
-TEST_F(CacheTest, ZeroSizeCache) {
+TEST_P(CacheTest, ZeroSizeCache) {
   delete cache_;
-  cache_ = NewLRUCache(0);
+  cache_ = NewCache(GetParam(), 0);
 
   Insert(1, 100);
   ASSERT_EQ(-1, Lookup(1));
 }
 
+TEST_P(CacheTest, ScanResistance) {
+  // A working set that is used over and over...
+  const int kHot = kCacheSize / 2;
+  for (int i = 0; i < kHot; i++) {
+    Insert(i, 1000 + i);
+  }
+  for (int i = 0; i < kHot; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+
+  // ...and a scan through twice the cache size of entries used once.
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(100000 + i, i);
+  }
+
+  int hot_kept = 0;
+  for (int i = 0; i < kHot; i++) {
+    if (Lookup(i) == 1000 + i) {
+      hot_kept++;
+    }
+  }
+  if (GetParam() == kLRU) {
+    ASSERT_EQ(0, hot_kept);
+  } else if (GetParam() == k2Q) {
+    ASSERT_EQ(kHot, hot_kept);
+  }
+}
+
+TEST_P(CacheTest, HighPriority) {
+  // Fill the cache with high and low priority entries...
+  for (int i = 0; i < kCacheSize; i++) {
+    Insert(i, 1000 + i, 1,
+           (i & 1) ? Cache::Priority::kHigh : Cache::Priority::kLow);
+  }
+  // ...and then make room for new low priority entries.
+  for (int i = 0; i < kCacheSize / 4; i++) {
+    Insert(100000 + i, i);
+  }
+
+  int high_kept = 0, low_kept = 0;
+  for (int i = 0; i < kCacheSize; i++) {
+    if (Lookup(i) == 1000 + i) {
+      ((i & 1) ? high_kept : low_kept)++;
+    }
+  }
+  ASSERT_EQ(kCacheSize / 2, high_kept);
+  ASSERT_LT(low_kept, kCacheSize / 2);
+}
+
+TEST_P(CacheTest, HighPriorityPoolIsBounded) {
+  // The LRU cache keeps high priority entries apart from the others only
+  // up to half of its capacity.
+  if (GetParam() != kLRU) {
+    return;
+  }
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0, 0.5);  // A single shard, for exact counts
+  for (int i = 0; i < kCacheSize; i++) {
+    Insert(i, 1000 + i, 1, Cache::Priority::kHigh);
+  }
+  for (int i = 0; i < kCacheSize; i++) {
+    Insert(100000 + i, i);
+  }
+
+  int high_kept = 0;
+  for (int i = 0; i < kCacheSize; i++) {
+    if (Lookup(i) == 1000 + i) {
+      ASSERT_GE(i, kCacheSize / 2);  // The newest ones
+      high_kept++;
+    }
+  }
+  ASSERT_EQ(kCacheSize / 2, high_kept);
+}
+
+static std::atomic<int> concurrent_deletes(0);
+
+static void CountingDeleter(const Slice& key, void* v) {
+  // Every value is its key, so lookups can check what they got.
+  ASSERT_EQ(DecodeKey(key), DecodeValue(v));
+  concurrent_deletes.fetch_add(1);
+}
+
+TEST_P(CacheTest, Concurrent) {
+  const int kThreads = 4;
+  const int kOpsPerThread = 20000;
+  std::atomic<int> inserts(0);
+  concurrent_deletes.store(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([this, t, &inserts]() {
+      Random rnd(301 + t);
+      for (int i = 0; i < kOpsPerThread; i++) {
+        const int k = rnd.Uniform(2 * kCacheSize);
+        const std::string key = EncodeKey(k);
+        switch (rnd.Uniform(10)) {
+          case 0:
+            cache_->Erase(key);
+            break;
+          case 1:
+          case 2:
+            cache_->Release(
+                cache_->Insert(key, EncodeValue(k), 1, &CountingDeleter));
+            inserts.fetch_add(1);
+            break;
+          default: {
+            Cache::Handle* h = cache_->Lookup(key);
+            if (h != nullptr) {
+              ASSERT_EQ(k, DecodeValue(cache_->Value(h)));
+              cache_->Release(h);
+            }
+            break;
+          }
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize + kCacheSize / 10);
+
+  // Every entry is deleted exactly once.
+  delete cache_;
+  cache_ = nullptr;
+  ASSERT_EQ(inserts.load(), concurrent_deletes.load());
+}
+
+INSTANTIATE_TEST_SUITE_P(Caches, CacheTest,
+                         testing::Values(kLRU, k2Q, kClock));
+
 }  // namespace leveldb
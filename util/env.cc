@@ -22,16 +22,54 @@ Status Env::NewAppendableFile(const std::string& fname, WritableFile** result) {
   return Status::NotSupported("NewAppendableFile", fname);
 }
 
+Status Env::NewDirectRandomAccessFile(const std::string& fname,
+                                      RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
+Status Env::NewDirectWritableFile(const std::string& fname,
+                                  WritableFile** result) {
+  return NewWritableFile(fname, result);
+}
+
 Status Env::RemoveDir(const std::string& dirname) { return DeleteDir(dirname); }
 Status Env::DeleteDir(const std::string& dirname) { return RemoveDir(dirname); }
 
 Status Env::RemoveFile(const std::string& fname) { return DeleteFile(fname); }
 Status Env::DeleteFile(const std::string& fname) { return RemoveFile(fname); }
 
+void Env::Schedule(void (*function)(void* arg), void* arg, Priority pri) {
+  Schedule(function, arg);
+}
+
+void Env::SetBackgroundThreads(int number, Priority pri) {}
+
+int Env::GetBackgroundThreads(Priority pri) { return 1; }
+
+void Env::GetBackgroundStats(Priority pri, BackgroundStats* stats) {
+  *stats = BackgroundStats();
+}
+
 SequentialFile::~SequentialFile() = default;
 
 RandomAccessFile::~RandomAccessFile() = default;
 
+Status RandomAccessFile::MultiRead(ReadRequest* reqs, size_t n) const {
+  Status result;
+  for (size_t i = 0; i < n; i++) {
+    ReadRequest* req = &reqs[i];
+    req->status = Read(req->offset, req->n, &req->result, req->scratch);
+    if (result.ok()) {
+      result = req->status;
+    }
+  }
+  return result;
+}
+
+Status RandomAccessFile::Prefetch(uint64_t offset, size_t n) const {
+  return Status::OK();
+}
+
 WritableFile::~WritableFile() = default;
 
 Logger::~Logger() = default;
@@ -13,6 +13,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cstddef>
@@ -20,7 +21,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <limits>
+#include <memory>
 #include <queue>
 #include <set>
 #include <string>
@@ -36,6 +39,12 @@
 #include "util/env_posix_test_helper.h"
 #include "util/posix_logger.h"
 
+// Included after port/port.h, which defines HAVE_IO_URING.
+#if HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif  // HAVE_IO_URING
+
 namespace leveldb {
 
 namespace {
@@ -58,6 +67,24 @@ constexpr const int kOpenBaseFlags = 0;
 
 constexpr const size_t kWritableFileBufferSize = 65536;
 
+// Number of threads that issue the reads of MultiRead() batches when
+// io_uring is not available.
+constexpr const int kMultiReadThreads = 4;
+
+// Number of reads that an io_uring holds at once.  Larger batches are
+// split up.
+constexpr const unsigned kIoUringEntries = 64;
+
+// Can be set using EnvPosixTestHelper::SetUseIoUring().
+std::atomic<bool> g_use_io_uring(true);
+
+// Alignment of the offsets, sizes and buffers of direct I/O.  4KB covers
+// the logical block size of common devices.
+constexpr const size_t kDirectIOAlignment = 4096;
+
+// Size of the buffer of files written with direct I/O.
+constexpr const size_t kDirectWritableFileBufferSize = 1 << 20;
+
 Status PosixError(const std::string& context, int error_number) {
   if (error_number == ENOENT) {
     return Status::NotFound(context, std::strerror(error_number));
@@ -129,6 +156,330 @@ class Limiter {
   std::atomic<int> acquires_allowed_;
 };
 
+// Reads *req from fd with pread().
+void PosixRead(int fd, const std::string& filename, ReadRequest* req) {
+  ssize_t read_size =
+      ::pread(fd, req->scratch, req->n, static_cast<off_t>(req->offset));
+  req->result = Slice(req->scratch, (read_size < 0) ? 0 : read_size);
+  req->status = (read_size < 0) ? PosixError(filename, errno) : Status::OK();
+}
+
+uint64_t AlignDown(uint64_t x) { return x - x % kDirectIOAlignment; }
+
+uint64_t AlignUp(uint64_t x) { return AlignDown(x + kDirectIOAlignment - 1); }
+
+// A buffer aligned to kDirectIOAlignment, for direct I/O.
+class AlignedBuffer {
+ public:
+  AlignedBuffer() : base_(nullptr), data_(nullptr), capacity_(0) {}
+
+  AlignedBuffer(const AlignedBuffer&) = delete;
+  AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+  ~AlignedBuffer() { delete[] base_; }
+
+  char* data() const { return data_; }
+  size_t capacity() const { return capacity_; }
+
+  // Makes room for at least "n" bytes.  The contents are lost if the
+  // buffer has to grow.
+  void Reserve(size_t n) {
+    if (n <= capacity_) {
+      return;
+    }
+    delete[] base_;
+    base_ = new char[n + kDirectIOAlignment];
+    const size_t misalignment =
+        reinterpret_cast<uintptr_t>(base_) % kDirectIOAlignment;
+    data_ = base_ + (misalignment == 0 ? 0 : kDirectIOAlignment - misalignment);
+    capacity_ = n;
+  }
+
+  // Frees the memory of the buffer.
+  void Clear() {
+    delete[] base_;
+    base_ = data_ = nullptr;
+    capacity_ = 0;
+  }
+
+ private:
+  char* base_;  // Allocated memory, which data_ points into
+  char* data_;
+  size_t capacity_;
+};
+
+#if HAVE_IO_URING
+// A minimal io_uring, set up with the raw system calls so as not to depend
+// on liburing.  Only used by the thread that created it.
+class IoUring {
+ public:
+  // Returns nullptr if the kernel does not support io_uring, or lacks
+  // IORING_OP_READ (which came with IORING_FEAT_FAST_POLL).
+  static IoUring* Create(unsigned entries) {
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      return nullptr;
+    }
+    IoUring* ring = new IoUring(fd);
+    if ((params.features & IORING_FEAT_FAST_POLL) == 0 || !ring->Map(params)) {
+      delete ring;
+      return nullptr;
+    }
+    return ring;
+  }
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  ~IoUring() {
+    if (sqes_ != nullptr) {
+      ::munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+      ::munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != nullptr) {
+      ::munmap(sq_ring_, sq_ring_size_);
+    }
+    ::close(ring_fd_);
+  }
+
+  // Reads reqs[0..n-1] from fd, up to entries_ reads at a time.  Returns
+  // false if the ring itself failed, in which case it must not be used
+  // again and the reads must be retried some other way.
+  bool Read(int fd, const std::string& filename, ReadRequest* reqs,
+            size_t n) {
+    for (size_t done = 0; done < n;) {
+      const unsigned batch =
+          static_cast<unsigned>(std::min<size_t>(n - done, entries_));
+      unsigned tail = *sq_tail_;  // Only written by this thread
+      for (unsigned i = 0; i < batch; i++) {
+        const ReadRequest& req = reqs[done + i];
+        const unsigned index = tail & sq_mask_;
+        struct io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->off = req.offset;
+        sqe->addr = reinterpret_cast<uint64_t>(req.scratch);
+        sqe->len = static_cast<uint32_t>(req.n);
+        sqe->user_data = done + i;
+        sq_array_[index] = index;
+        tail++;
+      }
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+      unsigned to_submit = batch;
+      unsigned reaped = 0;
+      while (reaped < batch) {
+        int ret = static_cast<int>(
+            ::syscall(__NR_io_uring_enter, ring_fd_, to_submit,
+                      batch - reaped, IORING_ENTER_GETEVENTS, nullptr, 0));
+        if (ret < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          return false;
+        }
+        to_submit -= std::min<unsigned>(to_submit, ret);
+
+        unsigned head = *cq_head_;  // Only written by this thread
+        const unsigned cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != cq_tail; head++) {
+          const struct io_uring_cqe& cqe = cqes_[head & cq_mask_];
+          ReadRequest* req = &reqs[cqe.user_data];
+          if (cqe.res < 0) {
+            req->result = Slice();
+            req->status = PosixError(filename, -cqe.res);
+          } else {
+            req->result = Slice(req->scratch, cqe.res);
+            req->status = Status::OK();
+          }
+          reaped++;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+      }
+      done += batch;
+    }
+    return true;
+  }
+
+ private:
+  explicit IoUring(int ring_fd)
+      : ring_fd_(ring_fd),
+        sq_ring_(nullptr),
+        cq_ring_(nullptr),
+        sqes_(nullptr) {}
+
+  // Maps the rings shared with the kernel.
+  bool Map(const struct io_uring_params& params) {
+    entries_ = params.sq_entries;
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = MapRegion(sq_ring_size_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == nullptr) {
+      return false;
+    }
+    cq_ring_ = single_mmap ? sq_ring_
+                           : MapRegion(cq_ring_size_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == nullptr) {
+      return false;
+    }
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<struct io_uring_sqe*>(
+        MapRegion(sqes_size_, IORING_OFF_SQES));
+    if (sqes_ == nullptr) {
+      return false;
+    }
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  void* MapRegion(size_t size, off_t offset) {
+    void* region = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+    return region == MAP_FAILED ? nullptr : region;
+  }
+
+  const int ring_fd_;
+  unsigned entries_;
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  struct io_uring_sqe* sqes_;
+  size_t sqes_size_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  struct io_uring_cqe* cqes_;
+};
+#endif  // HAVE_IO_URING
+
+// Issues the reads of RandomAccessFile::MultiRead() batches concurrently:
+// through an io_uring of the calling thread where the kernel supports it,
+// and otherwise on a pool of kMultiReadThreads threads that the calling
+// thread helps with.
+//
+// Instances of this class are thread-safe.
+class PosixMultiReader {
+ public:
+  PosixMultiReader()
+      : work_cv_(&mu_), done_cv_(&mu_), started_threads_(0) {}
+
+  PosixMultiReader(const PosixMultiReader&) = delete;
+  PosixMultiReader& operator=(const PosixMultiReader&) = delete;
+
+  // Reads reqs[0..n-1] from fd, which was opened from filename.
+  void Read(int fd, const std::string& filename, ReadRequest* reqs,
+            size_t n) {
+#if HAVE_IO_URING
+    if (g_use_io_uring.load(std::memory_order_relaxed)) {
+      thread_local std::unique_ptr<IoUring> ring;
+      thread_local bool ring_failed = false;
+      if (ring == nullptr && !ring_failed) {
+        ring.reset(IoUring::Create(kIoUringEntries));
+        ring_failed = (ring == nullptr);
+      }
+      if (ring != nullptr) {
+        if (ring->Read(fd, filename, reqs, n)) {
+          return;
+        }
+        ring.reset();
+        ring_failed = true;
+      }
+    }
+#endif  // HAVE_IO_URING
+    ReadOnThreads(fd, filename, reqs, n);
+  }
+
+ private:
+  struct Work {
+    int fd;
+    const std::string* filename;
+    ReadRequest* req;
+    size_t* remaining;  // Reads of the batch that have not completed
+  };
+
+  void ReadOnThreads(int fd, const std::string& filename, ReadRequest* reqs,
+                     size_t n) {
+    size_t remaining = n - 1;
+    mu_.Lock();
+    for (size_t i = 1; i < n; i++) {
+      queue_.push_back(Work{fd, &filename, &reqs[i], &remaining});
+    }
+    while (started_threads_ < kMultiReadThreads &&
+           static_cast<size_t>(started_threads_) < n - 1) {
+      started_threads_++;
+      std::thread reader_thread(&PosixMultiReader::ReaderThreadMain, this);
+      reader_thread.detach();
+    }
+    work_cv_.SignalAll();
+    mu_.Unlock();
+
+    PosixRead(fd, filename, &reqs[0]);
+
+    // Help with the queued reads, which may belong to other batches,
+    // until those of this batch are done.
+    mu_.Lock();
+    while (remaining > 0) {
+      if (queue_.empty()) {
+        done_cv_.Wait();
+      } else {
+        RunQueuedRead();
+      }
+    }
+    mu_.Unlock();
+  }
+
+  void ReaderThreadMain() {
+    mu_.Lock();
+    while (true) {
+      while (queue_.empty()) {
+        work_cv_.Wait();
+      }
+      RunQueuedRead();
+    }
+  }
+
+  // Pops a read from the queue and runs it without holding mu_.
+  void RunQueuedRead() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    Work work = queue_.front();
+    queue_.pop_front();
+    mu_.Unlock();
+    PosixRead(work.fd, *work.filename, work.req);
+    mu_.Lock();
+    if (--*work.remaining == 0) {
+      done_cv_.SignalAll();
+    }
+  }
+
+  port::Mutex mu_;
+  port::CondVar work_cv_ GUARDED_BY(mu_);  // Signalled when work is queued
+  port::CondVar done_cv_ GUARDED_BY(mu_);  // Signalled when a batch is done
+  std::deque<Work> queue_ GUARDED_BY(mu_);
+  int started_threads_ GUARDED_BY(mu_);
+};
+
 // Implements sequential read access in a file using read().
 //
 // Instances of this class are thread-friendly but not thread-safe, as required
@@ -176,11 +527,14 @@ class PosixSequentialFile final : public SequentialFile {
 class PosixRandomAccessFile final : public RandomAccessFile {
  public:
   // The new instance takes ownership of |fd|. |fd_limiter| must outlive this
-  // instance, and will be used to determine if .
-  PosixRandomAccessFile(std::string filename, int fd, Limiter* fd_limiter)
+  // instance, and will be used to determine if . |multi_reader| must
+  // outlive this instance, and runs the reads of MultiRead().
+  PosixRandomAccessFile(std::string filename, int fd, Limiter* fd_limiter,
+                        PosixMultiReader* multi_reader)
       : has_permanent_fd_(fd_limiter->Acquire()),
         fd_(has_permanent_fd_ ? fd : -1),
         fd_limiter_(fd_limiter),
+        multi_reader_(multi_reader),
         filename_(std::move(filename)) {
     if (!has_permanent_fd_) {
       assert(fd_ == -1);
@@ -223,10 +577,71 @@ class PosixRandomAccessFile final : public RandomAccessFile {
     return status;
   }
 
+  Status Prefetch(uint64_t offset, size_t n) const override {
+#if HAVE_POSIX_FADVISE
+    int fd = fd_;
+    if (!has_permanent_fd_) {
+      fd = ::open(filename_.c_str(), O_RDONLY | kOpenBaseFlags);
+      if (fd < 0) {
+        return PosixError(filename_, errno);
+      }
+    }
+
+    // The pages are read into the page cache, which all the descriptors of
+    // the file share.
+    int error_number = ::posix_fadvise(fd, static_cast<off_t>(offset),
+                                       static_cast<off_t>(n),
+                                       POSIX_FADV_WILLNEED);
+
+    if (!has_permanent_fd_) {
+      // Close the temporary file descriptor opened earlier.
+      assert(fd != fd_);
+      ::close(fd);
+    }
+    if (error_number != 0) {
+      return PosixError(filename_, error_number);
+    }
+#endif  // HAVE_POSIX_FADVISE
+    return Status::OK();
+  }
+
+  Status MultiRead(ReadRequest* reqs, size_t n) const override {
+    if (n <= 1) {
+      return RandomAccessFile::MultiRead(reqs, n);
+    }
+    int fd = fd_;
+    if (!has_permanent_fd_) {
+      fd = ::open(filename_.c_str(), O_RDONLY | kOpenBaseFlags);
+      if (fd < 0) {
+        Status status = PosixError(filename_, errno);
+        for (size_t i = 0; i < n; i++) {
+          reqs[i].result = Slice();
+          reqs[i].status = status;
+        }
+        return status;
+      }
+    }
+
+    multi_reader_->Read(fd, filename_, reqs, n);
+
+    if (!has_permanent_fd_) {
+      // Close the temporary file descriptor opened earlier.
+      assert(fd != fd_);
+      ::close(fd);
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (!reqs[i].status.ok()) {
+        return reqs[i].status;
+      }
+    }
+    return Status::OK();
+  }
+
  private:
   const bool has_permanent_fd_;  // If false, the file is opened on every read.
   const int fd_;                 // -1 if has_permanent_fd_ is false.
   Limiter* const fd_limiter_;
+  PosixMultiReader* const multi_reader_;
   const std::string filename_;
 };
 
@@ -267,6 +682,24 @@ class PosixMmapReadableFile final : public RandomAccessFile {
     return Status::OK();
   }
 
+  Status Prefetch(uint64_t offset, size_t n) const override {
+    if (offset >= length_) {
+      return Status::OK();
+    }
+    n = std::min<uint64_t>(n, length_ - offset);
+
+    // posix_madvise() takes a page-aligned address, and mmap_base_ is one.
+    static const uint64_t page_size = ::sysconf(_SC_PAGESIZE);
+    const uint64_t start = offset - offset % page_size;
+    int error_number =
+        ::posix_madvise(mmap_base_ + start, offset + n - start,
+                        POSIX_MADV_WILLNEED);
+    if (error_number != 0) {
+      return PosixError(filename_, error_number);
+    }
+    return Status::OK();
+  }
+
  private:
   char* const mmap_base_;
   const size_t length_;
@@ -274,6 +707,71 @@ class PosixMmapReadableFile final : public RandomAccessFile {
   const std::string filename_;
 };
 
+// Implements random read access in a file opened with O_DIRECT, so that
+// reads bypass the page cache.  Reads are widened to kDirectIOAlignment
+// boundaries and copied out of an aligned buffer.  Nothing is read ahead:
+// callers that read sequentially keep a buffer of their own.
+//
+// Instances of this class are thread-safe, as required by the
+// RandomAccessFile API. Instances are immutable and Read() only calls
+// thread-safe library functions.
+class PosixDirectRandomAccessFile final : public RandomAccessFile {
+ public:
+  // The new instance takes ownership of |fd|. The caller must have acquired
+  // a file descriptor from |fd_limiter|, which must outlive this instance,
+  // and which is released when this instance is destroyed.
+  PosixDirectRandomAccessFile(std::string filename, int fd,
+                              Limiter* fd_limiter)
+      : fd_(fd), fd_limiter_(fd_limiter), filename_(std::move(filename)) {}
+
+  ~PosixDirectRandomAccessFile() override {
+    ::close(fd_);
+    fd_limiter_->Release();
+  }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    const uint64_t buffer_offset = AlignDown(offset);
+    const size_t size =
+        static_cast<size_t>(AlignUp(offset + n) - buffer_offset);
+    AlignedBuffer buffer;
+    buffer.Reserve(size);
+    size_t buffer_size = 0;
+    while (buffer_size < size) {
+      ssize_t read_size =
+          ::pread(fd_, buffer.data() + buffer_size, size - buffer_size,
+                  static_cast<off_t>(buffer_offset + buffer_size));
+      if (read_size < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        *result = Slice();
+        return PosixError(filename_, errno);
+      }
+      if (read_size == 0) {
+        break;  // Read past the end of the file
+      }
+      buffer_size += read_size;
+    }
+
+    if (offset >= buffer_offset + buffer_size) {
+      *result = Slice();
+      return Status::OK();
+    }
+    n = std::min<uint64_t>(n, buffer_offset + buffer_size - offset);
+    std::memcpy(scratch, buffer.data() + (offset - buffer_offset), n);
+    *result = Slice(scratch, n);
+    return Status::OK();
+  }
+
+ private:
+  const int fd_;
+  Limiter* const fd_limiter_;
+  const std::string filename_;
+};
+
+class PosixDirectWritableFile;
+
 class PosixWritableFile final : public WritableFile {
  public:
   PosixWritableFile(std::string filename, int fd)
@@ -465,6 +963,121 @@ class PosixWritableFile final : public WritableFile {
   const bool is_manifest_;  // True if the file's name starts with MANIFEST.
   const std::string filename_;
   const std::string dirname_;  // The directory of filename_.
+
+  friend class PosixDirectWritableFile;  // Uses SyncFd().
+};
+
+// Implements sequential write access in a file opened with O_DIRECT, so
+// that writes bypass the page cache.  Appended data is buffered until a
+// full buffer can be written out.  Sync() and Close() also write out the
+// partial block at the end of the buffer, padded to kDirectIOAlignment; the
+// block is written again once it fills up, and Close() truncates the file
+// to the data appended.
+//
+// Instances of this class are thread-friendly but not thread-safe, as
+// required by the WritableFile API.
+class PosixDirectWritableFile final : public WritableFile {
+ public:
+  PosixDirectWritableFile(std::string filename, int fd)
+      : pos_(0), file_offset_(0), fd_(fd), filename_(std::move(filename)) {
+    buf_.Reserve(kDirectWritableFileBufferSize);
+  }
+
+  ~PosixDirectWritableFile() override {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      Close();
+    }
+  }
+
+  Status Append(const Slice& data) override {
+    const char* write_data = data.data();
+    size_t write_size = data.size();
+    while (write_size > 0) {
+      const size_t copy_size = std::min(write_size, buf_.capacity() - pos_);
+      std::memcpy(buf_.data() + pos_, write_data, copy_size);
+      write_data += copy_size;
+      write_size -= copy_size;
+      pos_ += copy_size;
+      if (pos_ == buf_.capacity()) {
+        Status status = WriteBuffer();
+        if (!status.ok()) {
+          return status;
+        }
+      }
+    }
+    return Status::OK();
+  }
+
+  Status Close() override {
+    Status status = WriteBuffer();
+    if (status.ok() && ::ftruncate(fd_, file_offset_ + pos_) != 0) {
+      status = PosixError(filename_, errno);
+    }
+    const int close_result = ::close(fd_);
+    if (close_result < 0 && status.ok()) {
+      status = PosixError(filename_, errno);
+    }
+    fd_ = -1;
+    return status;
+  }
+
+  // The data is only written out in aligned chunks, by Append() once the
+  // buffer is full, and by Sync() and Close().
+  Status Flush() override { return Status::OK(); }
+
+  Status Sync() override {
+    Status status = WriteBuffer();
+    if (!status.ok()) {
+      return status;
+    }
+    return PosixWritableFile::SyncFd(fd_, filename_);
+  }
+
+ private:
+  // Writes buf_[0, pos_ - 1] out at file_offset_, padded with zeroes to
+  // kDirectIOAlignment.  A partial block at the end stays in the buffer.
+  // Partial writes are continued only if they end on an aligned offset.
+  Status WriteBuffer() {
+    const size_t size = static_cast<size_t>(AlignUp(pos_));
+    std::memset(buf_.data() + pos_, 0, size - pos_);
+    const char* write_data = buf_.data();
+    size_t write_size = size;
+    uint64_t offset = file_offset_;
+    while (write_size > 0) {
+      ssize_t write_result = ::pwrite(fd_, write_data, write_size,
+                                      static_cast<off_t>(offset));
+      if (write_result < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        return PosixError(filename_, errno);
+      }
+      if (write_result % kDirectIOAlignment != 0) {
+        // The rest could only be written at an unaligned offset.  The
+        // buffer is left as is, so that it is all written again if the
+        // caller retries.
+        return Status::IOError(filename_, "unaligned partial direct write");
+      }
+      write_data += write_result;
+      write_size -= write_result;
+      offset += write_result;
+    }
+
+    const size_t full_size = static_cast<size_t>(AlignDown(pos_));
+    std::memmove(buf_.data(), buf_.data() + full_size, pos_ - full_size);
+    file_offset_ += full_size;
+    pos_ -= full_size;
+    return Status::OK();
+  }
+
+  // buf_[0, pos_ - 1] contains data to be written to fd_ at file_offset_,
+  // which is aligned.
+  AlignedBuffer buf_;
+  size_t pos_;
+  uint64_t file_offset_;
+  int fd_;
+  const std::string filename_;
 };
 
 int LockOrUnlock(int fd, bool lock) {
@@ -549,7 +1162,8 @@ class PosixEnv : public Env {
     }
 
     if (!mmap_limiter_.Acquire()) {
-      *result = new PosixRandomAccessFile(filename, fd, &fd_limiter_);
+      *result = new PosixRandomAccessFile(filename, fd, &fd_limiter_,
+                                          &multi_reader_);
       return Status::OK();
     }
 
@@ -573,6 +1187,47 @@ class PosixEnv : public Env {
     return status;
   }
 
+  Status NewDirectRandomAccessFile(const std::string& filename,
+                                   RandomAccessFile** result) override {
+#if HAVE_O_DIRECT
+    // Direct I/O files keep their file descriptor open.
+    if (fd_limiter_.Acquire()) {
+      int fd = ::open(filename.c_str(), O_RDONLY | O_DIRECT | kOpenBaseFlags);
+      if (fd >= 0) {
+        *result = new PosixDirectRandomAccessFile(filename, fd, &fd_limiter_);
+        return Status::OK();
+      }
+      const int open_errno = errno;
+      fd_limiter_.Release();
+      if (open_errno != EINVAL) {
+        *result = nullptr;
+        return PosixError(filename, open_errno);
+      }
+      // EINVAL: the file system does not support direct I/O.
+    }
+#endif  // HAVE_O_DIRECT
+    return NewRandomAccessFile(filename, result);
+  }
+
+  Status NewDirectWritableFile(const std::string& filename,
+                               WritableFile** result) override {
+#if HAVE_O_DIRECT
+    int fd = ::open(filename.c_str(),
+                    O_TRUNC | O_WRONLY | O_CREAT | O_DIRECT | kOpenBaseFlags,
+                    0644);
+    if (fd >= 0) {
+      *result = new PosixDirectWritableFile(filename, fd);
+      return Status::OK();
+    }
+    if (errno != EINVAL) {
+      *result = nullptr;
+      return PosixError(filename, errno);
+    }
+    // EINVAL: the file system does not support direct I/O.
+#endif  // HAVE_O_DIRECT
+    return NewWritableFile(filename, result);
+  }
+
   Status NewWritableFile(const std::string& filename,
                          WritableFile** result) override {
     int fd = ::open(filename.c_str(),
@@ -694,6 +1349,15 @@ class PosixEnv : public Env {
   void Schedule(void (*background_work_function)(void* background_work_arg),
                 void* background_work_arg) override;
 
+  void Schedule(void (*background_work_function)(void* background_work_arg),
+                void* background_work_arg, Priority pri) override;
+
+  void SetBackgroundThreads(int number, Priority pri) override;
+
+  int GetBackgroundThreads(Priority pri) override;
+
+  void GetBackgroundStats(Priority pri, BackgroundStats* stats) override;
+
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override {
     std::thread new_thread(thread_main, thread_main_arg);
@@ -748,12 +1412,6 @@ class PosixEnv : public Env {
   }
 
  private:
-  void BackgroundThreadMain();
-
-  static void BackgroundThreadEntryPoint(PosixEnv* env) {
-    env->BackgroundThreadMain();
-  }
-
   // Stores the work item data in a Schedule() call.
   //
   // Instances are constructed on the thread calling Schedule() and used on the
@@ -761,23 +1419,48 @@ class PosixEnv : public Env {
   //
   // This structure is thread-safe because it is immutable.
   struct BackgroundWorkItem {
-    explicit BackgroundWorkItem(void (*function)(void* arg), void* arg)
-        : function(function), arg(arg) {}
+    explicit BackgroundWorkItem(void (*function)(void* arg), void* arg,
+                                uint64_t schedule_micros)
+        : function(function), arg(arg), schedule_micros(schedule_micros) {}
 
     void (*const function)(void*);
     void* const arg;
+    const uint64_t schedule_micros;  // NowMicros() when scheduled
   };
 
-  port::Mutex background_work_mutex_;
-  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
+  // The queue and the threads that run work of one priority.  All fields
+  // are guarded by background_work_mutex_.
+  struct BackgroundPool {
+    explicit BackgroundPool(port::Mutex* mu)
+        : cv(mu), threads_limit(1), started_threads(0), idle_threads(0) {}
+
+    // Signalled when work is added to the queue, or threads_limit lowered.
+    port::CondVar cv;
+    int threads_limit;
+    int started_threads;
+    int idle_threads;
+    std::queue<BackgroundWorkItem> queue;
+    BackgroundStats stats;  // All but the thread and queue counts
+  };
 
-  std::queue<BackgroundWorkItem> background_work_queue_
-      GUARDED_BY(background_work_mutex_);
+  BackgroundPool* GetBackgroundPool(Priority pri) {
+    return pri == HIGH ? &high_priority_pool_ : &low_priority_pool_;
+  }
+
+  void BackgroundThreadMain(BackgroundPool* pool);
+
+  static void BackgroundThreadEntryPoint(PosixEnv* env, BackgroundPool* pool) {
+    env->BackgroundThreadMain(pool);
+  }
+
+  port::Mutex background_work_mutex_;
+  BackgroundPool low_priority_pool_ GUARDED_BY(background_work_mutex_);
+  BackgroundPool high_priority_pool_ GUARDED_BY(background_work_mutex_);
 
   PosixLockTable locks_;  // Thread-safe.
   Limiter mmap_limiter_;  // Thread-safe.
   Limiter fd_limiter_;    // Thread-safe.
+  PosixMultiReader multi_reader_;  // Thread-safe.
 };
 
 // Return the maximum number of concurrent mmaps.
@@ -809,49 +1492,114 @@ int MaxOpenFiles() {
 }  // namespace
 
 PosixEnv::PosixEnv()
-    : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
+    : low_priority_pool_(&background_work_mutex_),
+      high_priority_pool_(&background_work_mutex_),
       mmap_limiter_(MaxMmaps()),
       fd_limiter_(MaxOpenFiles()) {}
 
 void PosixEnv::Schedule(
     void (*background_work_function)(void* background_work_arg),
     void* background_work_arg) {
+  Schedule(background_work_function, background_work_arg, LOW);
+}
+
+void PosixEnv::Schedule(
+    void (*background_work_function)(void* background_work_arg),
+    void* background_work_arg, Priority pri) {
   background_work_mutex_.Lock();
 
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
-    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
+  BackgroundPool* pool = GetBackgroundPool(pri);
+  pool->queue.emplace(background_work_function, background_work_arg,
+                      NowMicros());
+  pool->stats.scheduled++;
+
+  // Start another background thread if the idle ones cannot pick up all of
+  // the queued work.
+  if (pool->queue.size() > static_cast<size_t>(pool->idle_threads) &&
+      pool->started_threads < pool->threads_limit) {
+    pool->started_threads++;
+    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this,
+                                  pool);
     background_thread.detach();
   }
 
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
+  // Idle background threads are waiting for work.
+  if (pool->idle_threads > 0) {
+    pool->cv.Signal();
   }
 
-  background_work_queue_.emplace(background_work_function, background_work_arg);
   background_work_mutex_.Unlock();
 }
 
-void PosixEnv::BackgroundThreadMain() {
-  while (true) {
-    background_work_mutex_.Lock();
+void PosixEnv::SetBackgroundThreads(int number, Priority pri) {
+  background_work_mutex_.Lock();
+  // New threads are started by later Schedule() calls.  Threads beyond a
+  // lowered limit exit once they are done with their current work.
+  BackgroundPool* pool = GetBackgroundPool(pri);
+  pool->threads_limit = std::max(number, 1);
+  if (pool->started_threads > pool->threads_limit) {
+    pool->cv.SignalAll();
+  }
+  background_work_mutex_.Unlock();
+}
+
+int PosixEnv::GetBackgroundThreads(Priority pri) {
+  background_work_mutex_.Lock();
+  int result = GetBackgroundPool(pri)->threads_limit;
+  background_work_mutex_.Unlock();
+  return result;
+}
 
-    // Wait until there is work to be done.
-    while (background_work_queue_.empty()) {
-      background_work_cv_.Wait();
+void PosixEnv::GetBackgroundStats(Priority pri, BackgroundStats* stats) {
+  background_work_mutex_.Lock();
+  BackgroundPool* pool = GetBackgroundPool(pri);
+  *stats = pool->stats;
+  stats->threads = pool->started_threads;
+  stats->busy_threads = pool->started_threads - pool->idle_threads;
+  stats->queue_length = static_cast<int>(pool->queue.size());
+  background_work_mutex_.Unlock();
+}
+
+void PosixEnv::BackgroundThreadMain(BackgroundPool* pool) {
+  background_work_mutex_.Lock();
+  while (true) {
+    // Wait until there is work to be done, unless this thread is beyond a
+    // lowered limit.
+    while (pool->queue.empty() &&
+           pool->started_threads <= pool->threads_limit) {
+      pool->idle_threads++;
+      pool->cv.Wait();
+      pool->idle_threads--;
+    }
+    if (pool->started_threads > pool->threads_limit) {
+      pool->started_threads--;
+      break;
     }
 
-    assert(!background_work_queue_.empty());
-    auto background_work_function = background_work_queue_.front().function;
-    void* background_work_arg = background_work_queue_.front().arg;
-    background_work_queue_.pop();
+    assert(!pool->queue.empty());
+    auto background_work_function = pool->queue.front().function;
+    void* background_work_arg = pool->queue.front().arg;
+    // NowMicros() is the wall clock, which may step backwards.
+    const uint64_t schedule_micros = pool->queue.front().schedule_micros;
+    const uint64_t start_micros = NowMicros();
+    const uint64_t queue_micros =
+        start_micros > schedule_micros ? start_micros - schedule_micros : 0;
+    pool->queue.pop();
+    pool->stats.total_queue_micros += queue_micros;
+    pool->stats.max_queue_micros =
+        std::max(pool->stats.max_queue_micros, queue_micros);
 
     background_work_mutex_.Unlock();
     background_work_function(background_work_arg);
+    const uint64_t end_micros = NowMicros();
+    background_work_mutex_.Lock();
+
+    pool->stats.completed++;
+    if (end_micros > start_micros) {
+      pool->stats.total_run_micros += end_micros - start_micros;
+    }
   }
+  background_work_mutex_.Unlock();
 }
 
 namespace {
@@ -921,6 +1669,10 @@ void EnvPosixTestHelper::SetReadOnlyMMapLimit(int limit) {
   g_mmap_limit = limit;
 }
 
+void EnvPosixTestHelper::SetUseIoUring(bool use_io_uring) {
+  g_use_io_uring.store(use_io_uring, std::memory_order_relaxed);
+}
+
 Env* Env::Default() {
   static PosixDefaultEnv env_container;
   return env_container.env();
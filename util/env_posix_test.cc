@@ -10,6 +10,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <string>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -176,6 +177,10 @@ class EnvPosixTest : public testing::Test {
     EnvPosixTestHelper::SetReadOnlyMMapLimit(mmap_limit);
   }
 
+  static void SetUseIoUring(bool use_io_uring) {
+    EnvPosixTestHelper::SetUseIoUring(use_io_uring);
+  }
+
   EnvPosixTest() : env_(Env::Default()) {}
 
   Env* env_;
@@ -212,6 +217,231 @@ TEST_F(EnvPosixTest, TestOpenOnRead) {
   ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
 }
 
+TEST_F(EnvPosixTest, MultiRead) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/multi_read.txt";
+  Random rnd(test::RandomSeed());
+  std::string data;
+  test::RandomString(&rnd, 1 << 20, &data);
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file));
+
+  // Past the limits, so that the files are read through mmap, through a
+  // permanent file descriptor, and by opening the file on every read.
+  const int kNumFiles = kReadOnlyFileLimit + kMMapLimit + 2;
+  std::vector<RandomAccessFile*> files(kNumFiles);
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &files[i]));
+  }
+
+  // More reads than fit in an io_uring at once, including reads that end
+  // past the end of the file.
+  const int kNumReads = 200;
+  std::vector<ReadRequest> reqs(kNumReads);
+  std::vector<std::string> scratch(kNumReads);
+  for (bool use_io_uring : {true, false}) {
+    SetUseIoUring(use_io_uring);
+    for (int f = 0; f < kNumFiles; f++) {
+      for (int i = 0; i < kNumReads; i++) {
+        size_t n = 1 + rnd.Uniform(8192);
+        uint64_t offset = rnd.Uniform(data.size() - n);
+        if (i == kNumReads - 1) {
+          offset = data.size() - 100;
+          n = 200;
+        }
+        scratch[i].assign(n, '\0');
+        reqs[i] = ReadRequest();
+        reqs[i].offset = offset;
+        reqs[i].n = n;
+        reqs[i].scratch = &scratch[i][0];
+      }
+      Status s = files[f]->MultiRead(reqs.data(), reqs.size());
+      if (f < kMMapLimit) {
+        // Reads from mmap-ed files must stay within the file.
+        ASSERT_TRUE(!s.ok());
+        ASSERT_TRUE(!reqs.back().status.ok());
+        reqs.pop_back();
+      } else {
+        ASSERT_LEVELDB_OK(s);
+        ASSERT_EQ(data.substr(data.size() - 100), reqs.back().result);
+      }
+      for (const ReadRequest& req : reqs) {
+        ASSERT_LEVELDB_OK(req.status);
+        ASSERT_EQ(Slice(data.data() + req.offset,
+                        std::min<size_t>(req.n, data.size() - req.offset)),
+                  req.result);
+      }
+      reqs.resize(kNumReads);
+    }
+  }
+  SetUseIoUring(true);
+
+  for (RandomAccessFile* file : files) {
+    delete file;
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+TEST_F(EnvPosixTest, Prefetch) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/prefetch.txt";
+  Random rnd(test::RandomSeed());
+  std::string data;
+  test::RandomString(&rnd, 100000, &data);
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file));
+
+  // Past the limits, so that the files are read through mmap, through a
+  // permanent file descriptor, and by opening the file on every read.
+  const int kNumFiles = kReadOnlyFileLimit + kMMapLimit + 2;
+  std::vector<RandomAccessFile*> files(kNumFiles);
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &files[i]));
+  }
+  for (RandomAccessFile* file : files) {
+    ASSERT_LEVELDB_OK(file->Prefetch(0, 4096));
+    ASSERT_LEVELDB_OK(file->Prefetch(5000, 20000));
+    // Past the end of the file.
+    ASSERT_LEVELDB_OK(file->Prefetch(90000, 1 << 20));
+    ASSERT_LEVELDB_OK(file->Prefetch(200000, 4096));
+
+    char scratch[100];
+    Slice result;
+    ASSERT_LEVELDB_OK(file->Read(5000, sizeof(scratch), &result, scratch));
+    ASSERT_EQ(Slice(data.data() + 5000, sizeof(scratch)), result);
+  }
+
+  for (RandomAccessFile* file : files) {
+    delete file;
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+TEST_F(EnvPosixTest, DirectWritableFile) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/direct_write.txt";
+  Random rnd(test::RandomSeed());
+
+  // Appends of all sizes, some of them past the end of the buffer, with a
+  // Sync() that writes out a partial block in between.
+  WritableFile* file;
+  ASSERT_LEVELDB_OK(env_->NewDirectWritableFile(test_file, &file));
+  std::string data;
+  for (int i = 0; i < 150; i++) {
+    std::string piece;
+    test::RandomString(&rnd, rnd.Skewed(18), &piece);
+    ASSERT_LEVELDB_OK(file->Append(piece));
+    data += piece;
+    if (i == 50) {
+      ASSERT_LEVELDB_OK(file->Sync());
+    }
+  }
+  ASSERT_LEVELDB_OK(file->Flush());
+  ASSERT_LEVELDB_OK(file->Sync());
+  ASSERT_LEVELDB_OK(file->Close());
+  delete file;
+
+  uint64_t file_size;
+  ASSERT_LEVELDB_OK(env_->GetFileSize(test_file, &file_size));
+  ASSERT_EQ(data.size(), file_size);
+  std::string contents;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, test_file, &contents));
+  ASSERT_TRUE(data == contents);
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+TEST_F(EnvPosixTest, DirectRandomAccessFile) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/direct_read.txt";
+  Random rnd(test::RandomSeed());
+  std::string data;
+  test::RandomString(&rnd, 1000000, &data);
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file));
+
+  RandomAccessFile* file;
+  ASSERT_LEVELDB_OK(env_->NewDirectRandomAccessFile(test_file, &file));
+  std::string scratch(20000, '\0');
+  Slice result;
+
+  // Unaligned reads, and reads that end past the end of the file.
+  for (int i = 0; i < 100; i++) {
+    const uint64_t offset = rnd.Uniform(data.size());
+    const size_t n = 1 + rnd.Uniform(scratch.size());
+    ASSERT_LEVELDB_OK(file->Read(offset, n, &result, &scratch[0]));
+    ASSERT_EQ(Slice(data.data() + offset,
+                    std::min<size_t>(n, data.size() - offset)),
+              result);
+  }
+  ASSERT_LEVELDB_OK(file->Read(data.size(), 100, &result, &scratch[0]));
+  ASSERT_TRUE(result.empty());
+
+  // Sequential reads, which run past the end of the file.
+  uint64_t offset = 1234;
+  while (offset < data.size()) {
+    const size_t n = 1 + rnd.Uniform(5000);
+    ASSERT_LEVELDB_OK(file->Read(offset, n, &result, &scratch[0]));
+    ASSERT_EQ(Slice(data.data() + offset,
+                    std::min<size_t>(n, data.size() - offset)),
+              result);
+    offset += n;
+  }
+
+  delete file;
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+TEST_F(EnvPosixTest, ConcurrentMultiRead) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/concurrent_multi_read.txt";
+  Random rnd(test::RandomSeed());
+  std::string data;
+  test::RandomString(&rnd, 1 << 20, &data);
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file));
+
+  // Use up the mmap regions, so that "file" is read with pread.
+  std::vector<RandomAccessFile*> mmap_files(kMMapLimit);
+  for (int i = 0; i < kMMapLimit; i++) {
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &mmap_files[i]));
+  }
+  RandomAccessFile* file;
+  ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &file));
+
+  // Batches of several threads share the thread pool.
+  SetUseIoUring(false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&data, file, t]() {
+      Random rnd(t + 1);
+      for (int iter = 0; iter < 50; iter++) {
+        ReadRequest reqs[10];
+        char scratch[10][1000];
+        for (int i = 0; i < 10; i++) {
+          reqs[i].offset = rnd.Uniform(data.size() - 1000);
+          reqs[i].n = 1 + rnd.Uniform(1000);
+          reqs[i].scratch = scratch[i];
+        }
+        EXPECT_LEVELDB_OK(file->MultiRead(reqs, 10));
+        for (const ReadRequest& req : reqs) {
+          EXPECT_EQ(Slice(data.data() + req.offset, req.n), req.result);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  SetUseIoUring(true);
+
+  delete file;
+  for (RandomAccessFile* mmap_file : mmap_files) {
+    delete mmap_file;
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
 #if HAVE_O_CLOEXEC
 
 TEST_F(EnvPosixTest, TestCloseOnExecSequentialFile) {
@@ -21,6 +21,11 @@ class EnvPosixTestHelper {
   // Set the maximum number of read-only files that will be mapped via mmap.
   // Must be called before creating an Env.
   static void SetReadOnlyMMapLimit(int limit);
+
+  // Set whether RandomAccessFile::MultiRead() may use io_uring, where the
+  // kernel supports it, rather than its thread pool.  May be called at
+  // any time.
+  static void SetUseIoUring(bool use_io_uring);
 };
 
 }  // namespace leveldb
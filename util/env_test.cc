@@ -92,6 +92,122 @@ TEST_F(EnvTest, RunImmediately) {
   }
 }
 
+TEST_F(EnvTest, HighPriorityDoesNotWaitForLow) {
+  struct RunState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    bool release_low = false;
+    bool low_done = false;
+    bool high_done = false;
+
+    static void BlockLow(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      while (!state->release_low) {
+        state->cvar.Wait();
+      }
+      state->low_done = true;
+      state->cvar.SignalAll();
+    }
+
+    static void RunHigh(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->high_done = true;
+      state->cvar.SignalAll();
+    }
+  };
+
+  RunState state;
+  env_->Schedule(&RunState::BlockLow, &state, Env::LOW);
+  env_->Schedule(&RunState::RunHigh, &state, Env::HIGH);
+
+  MutexLock l(&state.mu);
+  while (!state.high_done) {
+    state.cvar.Wait();
+  }
+  ASSERT_FALSE(state.low_done);
+  state.release_low = true;
+  state.cvar.SignalAll();
+  while (!state.low_done) {
+    state.cvar.Wait();
+  }
+}
+
+TEST_F(EnvTest, BackgroundStats) {
+  struct RunState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    int running = 0;
+    bool release = false;
+
+    static void Block(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->running++;
+      state->cvar.SignalAll();
+      while (!state->release) {
+        state->cvar.Wait();
+      }
+    }
+  };
+
+  const int saved_threads = env_->GetBackgroundThreads(Env::HIGH);
+  env_->SetBackgroundThreads(2, Env::HIGH);
+  Env::BackgroundStats before, stats;
+  env_->GetBackgroundStats(Env::HIGH, &before);
+
+  // Two threads run the first two work items; the third waits for them.
+  RunState state;
+  for (int i = 0; i < 3; i++) {
+    env_->Schedule(&RunState::Block, &state, Env::HIGH);
+  }
+  {
+    MutexLock l(&state.mu);
+    while (state.running < 2) {
+      state.cvar.Wait();
+    }
+  }
+  env_->GetBackgroundStats(Env::HIGH, &stats);
+  ASSERT_EQ(2, stats.threads);
+  ASSERT_EQ(2, stats.busy_threads);
+  ASSERT_EQ(1, stats.queue_length);
+  ASSERT_EQ(before.scheduled + 3, stats.scheduled);
+  // Work items of earlier tests may have finished since "before" was
+  // taken.  Both threads have moved on to the items above, so those are
+  // all counted by now.
+  before.completed = stats.completed;
+  before.total_queue_micros = stats.total_queue_micros;
+  before.total_run_micros = stats.total_run_micros;
+
+  env_->SleepForMicroseconds(10000);
+  {
+    MutexLock l(&state.mu);
+    state.release = true;
+    state.cvar.SignalAll();
+  }
+  do {
+    env_->SleepForMicroseconds(1000);
+    env_->GetBackgroundStats(Env::HIGH, &stats);
+  } while (stats.completed < before.completed + 3);
+  ASSERT_EQ(3, state.running);
+  ASSERT_EQ(0, stats.queue_length);
+  ASSERT_EQ(before.completed + 3, stats.completed);
+  ASSERT_GE(stats.total_queue_micros - before.total_queue_micros, 10000);
+  ASSERT_GE(stats.max_queue_micros, 10000);
+  ASSERT_GE(stats.total_run_micros - before.total_run_micros, 2 * 10000);
+
+  // Threads beyond a lowered limit exit.
+  env_->SetBackgroundThreads(1, Env::HIGH);
+  do {
+    env_->SleepForMicroseconds(1000);
+    env_->GetBackgroundStats(Env::HIGH, &stats);
+  } while (stats.threads > 1);
+  ASSERT_EQ(1, stats.threads);
+  ASSERT_EQ(0, stats.busy_threads);
+  env_->SetBackgroundThreads(saved_threads, Env::HIGH);
+}
+
 TEST_F(EnvTest, RunMany) {
   struct RunState {
     port::Mutex mu;
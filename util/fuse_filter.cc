@@ -0,0 +1,246 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Binary fuse filters [Graf, Lemire 2022] with 8-bit fingerprints.
+//
+// Every key maps to three slots h0, h1, h2 of a fingerprint array, one in
+// each of three consecutive segments, and to a fingerprint f.  The array is
+// filled in so that F[h0] ^ F[h1] ^ F[h2] == f for every key of the set;
+// any other key passes the same check with probability 1/256.  The array
+// has about 1.125 slots per key for large sets, i.e. ~9 bits per key for a
+// 0.39% false positive rate, where a bloom filter needs ~11.5 bits per key.
+//
+// Filter layout:
+//    uint8 fingerprints[(segment_count + 2) << segment_length_log]
+//    fixed32 seed
+//    fixed32 segment_count
+//    uint8 segment_length_log
+//
+// A segment_count of 0 marks a filter over no keys.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+static const size_t kTrailerSize = 9;
+static const int kMaxSegmentLengthLog = 18;
+static const int kMaxBuildAttempts = 100;
+
+static uint32_t FuseHash(const Slice& key) {
+  return Hash(key.data(), key.size(), 0x7a3b9c1d);
+}
+
+// Spreads the 32-bit key hash over 64 bits, differently for each seed, so
+// that a failed construction can be retried with fresh slots.
+static uint64_t SeededHash(uint32_t key_hash, uint32_t seed) {
+  uint64_t h = (static_cast<uint64_t>(seed) << 32) | key_hash;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+// Returns the high 64 bits of a * b, for b < 2^32.
+static inline uint64_t MulHi(uint64_t a, uint32_t b) {
+  return ((a >> 32) * b + (((a & 0xffffffffu) * b) >> 32)) >> 32;
+}
+
+static inline uint8_t Fingerprint(uint64_t h) {
+  return static_cast<uint8_t>(h ^ (h >> 32));
+}
+
+struct FuseGeometry {
+  uint32_t segment_length;
+  uint32_t segment_count;
+
+  uint32_t array_length() const {
+    return (segment_count + 2) * segment_length;
+  }
+
+  // The slot in the first segment comes from the high bits of h, and its
+  // two successors are moved within their segments by other bits of h.
+  void Slots(uint64_t h, uint32_t slots[3]) const {
+    const uint32_t mask = segment_length - 1;
+    slots[0] = static_cast<uint32_t>(MulHi(h, segment_count * segment_length));
+    slots[1] = (slots[0] + segment_length) ^
+               (static_cast<uint32_t>(h >> 18) & mask);
+    slots[2] = (slots[0] + 2 * segment_length) ^
+               (static_cast<uint32_t>(h) & mask);
+  }
+};
+
+static int SegmentLengthLog(size_t n) {
+  if (n == 0) return 2;
+  int log = static_cast<int>(std::floor(std::log(static_cast<double>(n)) /
+                                        std::log(3.33) +
+                                        2.25));
+  return std::min(log, kMaxSegmentLengthLog);
+}
+
+static FuseGeometry ComputeGeometry(size_t n) {
+  FuseGeometry g;
+  g.segment_length = 1u << SegmentLengthLog(n);
+  // Small sets need relatively more slots to be peelable.
+  size_t capacity = 0;
+  if (n > 1) {
+    const double size_factor =
+        std::max(1.125, 0.875 + 0.25 * std::log(1000000.0) /
+                                    std::log(static_cast<double>(n)));
+    capacity = static_cast<size_t>(std::round(n * size_factor));
+  }
+  const size_t segments = (capacity + g.segment_length - 1) / g.segment_length;
+  g.segment_count = segments > 2 ? static_cast<uint32_t>(segments - 2) : 1;
+  return g;
+}
+
+// Fills fingerprints[] for the distinct key hashes in "hashes", or returns
+// false if this seed leaves a cycle that cannot be peeled.
+static bool BuildFingerprints(const std::vector<uint32_t>& hashes,
+                              uint32_t seed, const FuseGeometry& g,
+                              uint8_t* fingerprints) {
+  const uint32_t length = g.array_length();
+  // For each slot: the number of keys mapped to it (count << 2), XOR-ed
+  // with which of the key's three slots it is, and the XOR of their hashes.
+  // When a single key is left, these identify it.
+  std::vector<uint32_t> count(length, 0);
+  std::vector<uint64_t> xor_hash(length, 0);
+  uint32_t slots[3];
+  for (uint32_t key_hash : hashes) {
+    const uint64_t h = SeededHash(key_hash, seed);
+    g.Slots(h, slots);
+    for (uint32_t i = 0; i < 3; i++) {
+      count[slots[i]] = (count[slots[i]] + 4) ^ i;
+      xor_hash[slots[i]] ^= h;
+    }
+  }
+
+  // Peel keys that are alone in one of their slots, until none are left.
+  struct Peeled {
+    uint32_t slot;
+    uint64_t h;
+  };
+  std::vector<Peeled> order;
+  order.reserve(hashes.size());
+  std::vector<uint32_t> queue;
+  for (uint32_t i = 0; i < length; i++) {
+    if ((count[i] >> 2) == 1) queue.push_back(i);
+  }
+  while (!queue.empty()) {
+    const uint32_t slot = queue.back();
+    queue.pop_back();
+    if ((count[slot] >> 2) != 1) continue;
+    const uint64_t h = xor_hash[slot];
+    const uint32_t found = count[slot] & 3;
+    order.push_back(Peeled{slot, h});
+    g.Slots(h, slots);
+    for (uint32_t i = 0; i < 3; i++) {
+      if (i == found) continue;
+      const uint32_t other = slots[i];
+      count[other] = (count[other] - 4) ^ i;
+      xor_hash[other] ^= h;
+      if ((count[other] >> 2) == 1) queue.push_back(other);
+    }
+  }
+  if (order.size() != hashes.size()) {
+    return false;
+  }
+
+  // Assign in reverse peeling order: each key's slot is the last of its
+  // three to be written.
+  std::fill(fingerprints, fingerprints + length, 0);
+  for (auto it = order.rbegin(); it != order.rend(); ++it) {
+    g.Slots(it->h, slots);
+    fingerprints[it->slot] = Fingerprint(it->h) ^ fingerprints[slots[0]] ^
+                             fingerprints[slots[1]] ^ fingerprints[slots[2]];
+  }
+  return true;
+}
+
+class BinaryFuseFilterPolicy : public FilterPolicy {
+ public:
+  const char* Name() const override { return "leveldb.BinaryFuseFilter8"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    std::vector<uint32_t> hashes(n);
+    for (int i = 0; i < n; i++) {
+      hashes[i] = FuseHash(keys[i]);
+    }
+    // Duplicate keys (or hashes) would never peel.
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+    const size_t init_size = dst->size();
+    if (hashes.empty()) {
+      PutFixed32(dst, 0);
+      PutFixed32(dst, 0);
+      dst->push_back(0);
+      return;
+    }
+
+    const FuseGeometry g = ComputeGeometry(hashes.size());
+    dst->resize(init_size + g.array_length());
+    uint8_t* fingerprints = reinterpret_cast<uint8_t*>(&(*dst)[init_size]);
+    for (uint32_t seed = 0; seed < kMaxBuildAttempts; seed++) {
+      if (BuildFingerprints(hashes, seed, g, fingerprints)) {
+        PutFixed32(dst, seed);
+        PutFixed32(dst, g.segment_count);
+        dst->push_back(static_cast<char>(SegmentLengthLog(hashes.size())));
+        return;
+      }
+    }
+    // Practically impossible: fall back to a filter that matches all keys.
+    dst->resize(init_size);
+    PutFixed32(dst, 0);
+    PutFixed32(dst, 1);
+    dst->push_back(static_cast<char>(0xff));
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    const size_t len = filter.size();
+    if (len < kTrailerSize) return true;  // Not a filter we know how to read
+    const char* trailer = filter.data() + len - kTrailerSize;
+    const uint32_t seed = DecodeFixed32(trailer);
+    FuseGeometry g;
+    g.segment_count = DecodeFixed32(trailer + 4);
+    const int segment_length_log = static_cast<unsigned char>(trailer[8]);
+    if (g.segment_count == 0) {
+      return false;  // No keys
+    }
+    if (segment_length_log > kMaxSegmentLengthLog) {
+      return true;
+    }
+    g.segment_length = 1u << segment_length_log;
+    if (len - kTrailerSize != g.array_length()) {
+      return true;
+    }
+
+    const uint8_t* fingerprints =
+        reinterpret_cast<const uint8_t*>(filter.data());
+    const uint64_t h = SeededHash(FuseHash(key), seed);
+    uint32_t slots[3];
+    g.Slots(h, slots);
+    return (Fingerprint(h) ^ fingerprints[slots[0]] ^ fingerprints[slots[1]] ^
+            fingerprints[slots[2]]) == 0;
+  }
+};
+
+}  // namespace
+
+const FilterPolicy* NewBinaryFuseFilterPolicy() {
+  return new BinaryFuseFilterPolicy();
+}
+
+}  // namespace leveldb
@@ -0,0 +1,185 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "util/coding.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+static const int kVerbose = 1;
+
+static Slice Key(int i, char* buffer) {
+  EncodeFixed32(buffer, i);
+  return Slice(buffer, sizeof(uint32_t));
+}
+
+class FuseFilterTest : public testing::Test {
+ public:
+  FuseFilterTest() : policy_(NewBinaryFuseFilterPolicy()) {}
+
+  ~FuseFilterTest() { delete policy_; }
+
+  void Reset() {
+    keys_.clear();
+    filter_.clear();
+  }
+
+  void Add(const Slice& s) { keys_.push_back(s.ToString()); }
+
+  void Build() {
+    std::vector<Slice> key_slices(keys_.begin(), keys_.end());
+    filter_.clear();
+    policy_->CreateFilter(key_slices.data(),
+                          static_cast<int>(key_slices.size()), &filter_);
+    keys_.clear();
+  }
+
+  size_t FilterSize() const { return filter_.size(); }
+
+  bool Matches(const Slice& s) {
+    if (!keys_.empty()) {
+      Build();
+    }
+    return policy_->KeyMayMatch(s, filter_);
+  }
+
+  double FalsePositiveRate() {
+    char buffer[sizeof(int)];
+    int result = 0;
+    for (int i = 0; i < 100000; i++) {
+      if (Matches(Key(i + 1000000000, buffer))) {
+        result++;
+      }
+    }
+    return result / 100000.0;
+  }
+
+ private:
+  const FilterPolicy* policy_;
+  std::string filter_;
+  std::vector<std::string> keys_;
+};
+
+TEST_F(FuseFilterTest, EmptyFilter) {
+  Build();
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(FuseFilterTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(FuseFilterTest, DuplicateKeys) {
+  for (int i = 0; i < 3; i++) {
+    Add("hello");
+    Add("world");
+  }
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+}
+
+static int NextLength(int length) {
+  if (length < 10) {
+    length += 1;
+  } else if (length < 100) {
+    length += 10;
+  } else if (length < 1000) {
+    length += 100;
+  } else if (length < 10000) {
+    length += 1000;
+  } else {
+    length *= 10;
+  }
+  return length;
+}
+
+TEST_F(FuseFilterTest, VaryingLengths) {
+  char buffer[sizeof(int)];
+
+  for (int length = 1; length <= 1000000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // Small sets get relatively larger filters; large ones ~9 bits per key.
+    if (length >= 100000) {
+      ASSERT_LE(FilterSize(), static_cast<size_t>(length * 9.6 / 8)) << length;
+    }
+
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    // Expect 1/256 = 0.39% false positives.
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      std::fprintf(stderr,
+                   "False positives: %5.2f%% @ length = %7d ; bytes = %7d\n",
+                   rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.006);
+  }
+}
+
+// Compares space, false positive rate, and build and query throughput with
+// bloom filters of about the same false positive rate.
+TEST(FuseFilterBenchmark, CompareWithBloom) {
+  const int kKeys = 1 << 20;
+  const int kLookups = 1 << 20;
+  char buffer[sizeof(int)];
+  std::vector<std::string> keys;
+  keys.reserve(kKeys);
+  for (int i = 0; i < kKeys; i++) {
+    keys.push_back(Key(i, buffer).ToString());
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+
+  const char* names[] = {"bloom(10)", "bloom(12)", "blocked bloom(12)",
+                         "binary fuse"};
+  const FilterPolicy* policies[] = {
+      NewBloomFilterPolicy(10), NewBloomFilterPolicy(12),
+      NewBlockedBloomFilterPolicy(12), NewBinaryFuseFilterPolicy()};
+  for (int p = 0; p < 4; p++) {
+    std::string filter;
+    uint64_t start = Env::Default()->NowMicros();
+    policies[p]->CreateFilter(key_slices.data(), kKeys, &filter);
+    const uint64_t build_micros = Env::Default()->NowMicros() - start;
+
+    int matches = 0;
+    start = Env::Default()->NowMicros();
+    for (int i = 0; i < kLookups; i++) {
+      if (policies[p]->KeyMayMatch(Key(i + 1000000000, buffer), filter)) {
+        matches++;
+      }
+    }
+    const uint64_t query_micros = Env::Default()->NowMicros() - start;
+    if (kVerbose >= 1) {
+      std::fprintf(stderr,
+                   "%-18s %5.2f bits/key, %5.2f%% false positives, "
+                   "build %6.1f ns/key, query %6.1f ns/key\n",
+                   names[p], filter.size() * 8.0 / kKeys,
+                   matches * 100.0 / kLookups, build_micros * 1000.0 / kKeys,
+                   query_micros * 1000.0 / kLookups);
+    }
+    delete policies[p];
+  }
+}
+
+}  // namespace leveldb
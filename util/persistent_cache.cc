@@ -0,0 +1,401 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A persistent cache stored as a log of segment files, named
+// "<number>.pcache", in its directory.  New entries are appended to an
+// in-memory buffer that is written out as a whole segment once it is
+// full, so the device only sees large sequential writes.  Each segment
+// file is a sequence of records:
+//    fixed32 masked crc32c of the rest of the record
+//    fixed32 key length
+//    fixed32 data length
+//    char key[key length]
+//    char data[data length]
+//
+// An in-memory index maps each key to its record.  A full segment is
+// written out by the Insert() that fills it, without holding the cache's
+// mutex, while a new segment takes its place.  Segments are evicted whole,
+// oldest first.  On open, the index is rebuilt by scanning the
+// segments left by earlier caches.
+
+#include "leveldb/persistent_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+PersistentCache::~PersistentCache() = default;
+
+namespace {
+
+static const size_t kHeaderSize = 12;
+static const uint64_t kMinSegmentSize = 64 << 10;
+static const uint64_t kMaxSegmentSize = 4 << 20;
+
+static void AppendRecord(std::string* dst, const Slice& key,
+                         const Slice& data) {
+  const size_t start = dst->size();
+  PutFixed32(dst, 0);  // Checksum, filled in below
+  PutFixed32(dst, static_cast<uint32_t>(key.size()));
+  PutFixed32(dst, static_cast<uint32_t>(data.size()));
+  dst->append(key.data(), key.size());
+  dst->append(data.data(), data.size());
+  const uint32_t crc =
+      crc32c::Value(dst->data() + start + 4, dst->size() - start - 4);
+  EncodeFixed32(&(*dst)[start], crc32c::Mask(crc));
+}
+
+// If "input" starts with a complete record that passes its checksum, store
+// its key and data in *key and *data and return the size of the record.
+// Otherwise return 0.
+static size_t ParseRecord(const Slice& input, Slice* key, Slice* data) {
+  if (input.size() < kHeaderSize) {
+    return 0;
+  }
+  const char* p = input.data();
+  const uint32_t key_size = DecodeFixed32(p + 4);
+  const uint32_t data_size = DecodeFixed32(p + 8);
+  const uint64_t size = kHeaderSize + static_cast<uint64_t>(key_size) +
+                        data_size;
+  if (size > input.size()) {
+    return 0;
+  }
+  const uint32_t crc = crc32c::Unmask(DecodeFixed32(p));
+  if (crc32c::Value(p + 4, size - 4) != crc) {
+    return 0;
+  }
+  *key = Slice(p + kHeaderSize, key_size);
+  *data = Slice(p + kHeaderSize + key_size, data_size);
+  return size;
+}
+
+struct Segment {
+  explicit Segment(uint64_t number)
+      : number(number), size(0), file(nullptr), refs(1), evicted(false) {}
+
+  const uint64_t number;
+  uint64_t size;
+  RandomAccessFile* file;  // nullptr until the segment is written out
+  // Until the segment is written out, its records, which do not change
+  // any more once the segment is full.
+  std::string records;
+  int refs;
+  bool evicted;                   // Remove the file once unused
+  std::vector<std::string> keys;  // Keys of the records, for eviction
+};
+
+class SegmentedPersistentCache : public PersistentCache {
+ public:
+  SegmentedPersistentCache(Env* env, const std::string& path,
+                           uint64_t capacity)
+      : env_(env),
+        path_(path),
+        capacity_(capacity),
+        segment_size_(std::min(kMaxSegmentSize,
+                               std::max(kMinSegmentSize, capacity / 8))),
+        lock_(nullptr),
+        total_size_(0),
+        active_(nullptr) {}
+
+  ~SegmentedPersistentCache() override {
+    if (active_ != nullptr) {  // Open() succeeded
+      Segment* last = active_;
+      active_ = nullptr;
+      if (last->records.empty()) {
+        MutexLock l(&mu_);
+        Unref(last);
+      } else {
+        {
+          MutexLock l(&mu_);
+          total_size_ += last->size;
+        }
+        WriteSegment(last);
+      }
+    }
+    MutexLock l(&mu_);
+    for (Segment* segment : segments_) {
+      Unref(segment);
+    }
+    if (lock_ != nullptr) {
+      env_->UnlockFile(lock_);
+    }
+  }
+
+  // Locks the directory and indexes the segments found in it.
+  Status Open() {
+    env_->CreateDir(path_);  // Ignore error from CreateDir
+    Status s = env_->LockFile(path_ + "/LOCK", &lock_);
+    if (!s.ok()) {
+      return s;
+    }
+
+    std::vector<std::string> filenames;
+    s = env_->GetChildren(path_, &filenames);
+    if (!s.ok()) {
+      return s;
+    }
+    std::vector<uint64_t> numbers;
+    for (const std::string& filename : filenames) {
+      Slice name(filename);
+      uint64_t number;
+      if (ConsumeDecimalNumber(&name, &number) && name == Slice(".pcache")) {
+        numbers.push_back(number);
+      }
+    }
+    std::sort(numbers.begin(), numbers.end());
+
+    MutexLock l(&mu_);
+    uint64_t next_number = 1;
+    for (uint64_t number : numbers) {
+      Recover(number);
+      next_number = number + 1;
+    }
+    while (total_size_ > capacity_ && !segments_.empty()) {
+      EvictOldestSegment();
+    }
+    active_ = new Segment(next_number);
+    return Status::OK();
+  }
+
+  void Insert(const Slice& key, const Slice& data) override {
+    const uint64_t record_size = kHeaderSize + key.size() + data.size();
+    if (record_size > segment_size_) {
+      return;
+    }
+    std::string key_string = key.ToString();
+    Segment* full = nullptr;
+    {
+      MutexLock l(&mu_);
+      if (index_.count(key_string) != 0) {
+        return;
+      }
+      if (active_->records.size() + record_size > segment_size_) {
+        full = active_;
+        total_size_ += full->size;
+        active_ = new Segment(full->number + 1);
+      }
+      Location& location = index_[key_string];
+      location.segment = active_;
+      location.offset = active_->records.size();
+      location.size = data.size();
+      AppendRecord(&active_->records, key, data);
+      active_->size = active_->records.size();
+      active_->keys.push_back(std::move(key_string));
+    }
+    if (full != nullptr) {
+      WriteSegment(full);
+    }
+  }
+
+  bool Lookup(const Slice& key, size_t n, char* scratch) override {
+    Location location;
+    {
+      MutexLock l(&mu_);
+      auto it = index_.find(key.ToString());
+      if (it == index_.end() || it->second.size != n) {
+        return false;
+      }
+      location = it->second;
+      if (location.segment->file == nullptr) {
+        // Still in memory, no need to check the record
+        std::memcpy(scratch,
+                    location.segment->records.data() + location.offset +
+                        kHeaderSize + key.size(),
+                    n);
+        return true;
+      }
+      location.segment->refs++;
+    }
+
+    // Read the record without holding the mutex.
+    const size_t record_size = kHeaderSize + key.size() + n;
+    char* buf = new char[record_size];
+    Slice record, record_key, data;
+    Status s = location.segment->file->Read(location.offset, record_size,
+                                            &record, buf);
+    const bool found = s.ok() &&
+                       ParseRecord(record, &record_key, &data) != 0 &&
+                       record_key == key && data.size() == n;
+    if (found) {
+      std::memcpy(scratch, data.data(), n);
+    }
+    delete[] buf;
+
+    MutexLock l(&mu_);
+    if (!found) {
+      // Do not read a corrupted record over and over.
+      auto it = index_.find(key.ToString());
+      if (it != index_.end() && it->second.segment == location.segment) {
+        index_.erase(it);
+      }
+    }
+    Unref(location.segment);
+    return found;
+  }
+
+  uint64_t TotalSize() override {
+    MutexLock l(&mu_);
+    return total_size_ + active_->records.size();
+  }
+
+ private:
+  struct Location {
+    Segment* segment;
+    uint64_t offset;  // Of the record in the segment
+    size_t size;      // Of the data
+  };
+
+  std::string SegmentFileName(uint64_t number) const {
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "/%06llu.pcache",
+                  static_cast<unsigned long long>(number));
+    return path_ + buf;
+  }
+
+  void Unref(Segment* segment) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    assert(segment->refs > 0);
+    segment->refs--;
+    if (segment->refs == 0) {
+      delete segment->file;
+      if (segment->evicted) {
+        env_->RemoveFile(SegmentFileName(segment->number));
+      }
+      delete segment;
+    }
+  }
+
+  // Drops the index entries of "segment" that still point to it.
+  void RemoveFromIndex(Segment* segment) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    for (const std::string& key : segment->keys) {
+      auto it = index_.find(key);
+      if (it != index_.end() && it->second.segment == segment) {
+        index_.erase(it);
+      }
+    }
+  }
+
+  void EvictOldestSegment() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    Segment* segment = segments_.front();
+    segments_.pop_front();
+    total_size_ -= segment->size;
+    RemoveFromIndex(segment);
+    segment->evicted = true;
+    Unref(segment);
+  }
+
+  // Indexes the records of segment "number" up to the first one that is
+  // incomplete or fails its checksum.
+  void Recover(uint64_t number) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const std::string fname = SegmentFileName(number);
+    std::string contents;
+    Segment* segment = new Segment(number);
+    if (!ReadFileToString(env_, fname, &contents).ok() ||
+        !env_->NewRandomAccessFile(fname, &segment->file).ok()) {
+      segment->evicted = true;
+      Unref(segment);
+      return;
+    }
+    segment->size = contents.size();
+    Slice input(contents);
+    Slice key, data;
+    while (size_t record_size = ParseRecord(input, &key, &data)) {
+      // Entries of later segments win.
+      Location& location = index_[key.ToString()];
+      location.segment = segment;
+      location.offset = input.data() - contents.data();
+      location.size = data.size();
+      segment->keys.push_back(key.ToString());
+      input.remove_prefix(record_size);
+    }
+    segments_.push_back(segment);
+    total_size_ += segment->size;
+  }
+
+  // Writes the records of "segment", which is full and counted in
+  // total_size_, out as a segment file, and then evicts the oldest segments
+  // if the cache is full.  If the write fails, the records are dropped.
+  // Lookups of the records are served from memory in the meantime.
+  void WriteSegment(Segment* segment) LOCKS_EXCLUDED(mu_) {
+    const std::string fname = SegmentFileName(segment->number);
+    WritableFile* file;
+    Status s = env_->NewWritableFile(fname, &file);
+    if (s.ok()) {
+      s = file->Append(segment->records);
+      if (s.ok()) {
+        s = file->Close();
+      }
+      delete file;
+    }
+    RandomAccessFile* reader = nullptr;
+    if (s.ok()) {
+      s = env_->NewRandomAccessFile(fname, &reader);
+    }
+
+    MutexLock l(&mu_);
+    if (s.ok()) {
+      segment->file = reader;
+      std::string().swap(segment->records);
+      // Segments filled by concurrent inserts may be written out of order.
+      auto pos = segments_.end();
+      while (pos != segments_.begin() &&
+             (*(pos - 1))->number > segment->number) {
+        --pos;
+      }
+      segments_.insert(pos, segment);
+      while (total_size_ > capacity_ && !segments_.empty()) {
+        EvictOldestSegment();
+      }
+    } else {
+      total_size_ -= segment->size;
+      RemoveFromIndex(segment);
+      segment->evicted = true;
+      Unref(segment);
+    }
+  }
+
+  Env* const env_;
+  const std::string path_;
+  const uint64_t capacity_;
+  const uint64_t segment_size_;
+  FileLock* lock_;
+
+  port::Mutex mu_;
+  std::deque<Segment*> segments_ GUARDED_BY(mu_);  // Written out, oldest first
+  // Of segments_ and of the full segments being written out
+  uint64_t total_size_ GUARDED_BY(mu_);
+  Segment* active_ GUARDED_BY(mu_);  // Being filled
+  std::unordered_map<std::string, Location> index_ GUARDED_BY(mu_);
+};
+
+}  // namespace
+
+Status NewPersistentCache(Env* env, const std::string& path,
+                          uint64_t capacity, PersistentCache** result) {
+  *result = nullptr;
+  SegmentedPersistentCache* cache =
+      new SegmentedPersistentCache(env, path, capacity);
+  Status s = cache->Open();
+  if (s.ok()) {
+    *result = cache;
+  } else {
+    delete cache;
+  }
+  return s;
+}
+
+}  // namespace leveldb
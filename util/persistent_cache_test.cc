@@ -0,0 +1,324 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/persistent_cache.h"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+static std::string Key(int i) {
+  char buf[8];
+  EncodeFixed64(buf, i);
+  return std::string(buf, sizeof(buf));
+}
+
+// A value of 1000 bytes that depends on i.
+static std::string Value(int i) {
+  Random rnd(i + 1);
+  std::string value;
+  test::RandomString(&rnd, 1000, &value);
+  return value;
+}
+
+// Size of the record of an entry in a segment file: header, key and value.
+static const int kRecordSize = 12 + 8 + 1000;
+
+class PersistentCacheTest : public testing::Test {
+ public:
+  PersistentCacheTest() : env_(Env::Default()), cache_(nullptr) {
+    EXPECT_LEVELDB_OK(env_->GetTestDirectory(&path_));
+    path_ += "/persistent_cache_test";
+    Destroy();
+  }
+
+  ~PersistentCacheTest() override {
+    delete cache_;
+    Destroy();
+  }
+
+  void Destroy() {
+    std::vector<std::string> filenames;
+    env_->GetChildren(path_, &filenames);
+    for (const std::string& filename : filenames) {
+      env_->RemoveFile(path_ + "/" + filename);
+    }
+    env_->RemoveDir(path_);
+  }
+
+  // Closes the current cache, if any, and opens a new one on its files.
+  void Reopen(uint64_t capacity) {
+    delete cache_;
+    cache_ = nullptr;
+    ASSERT_LEVELDB_OK(NewPersistentCache(env_, path_, capacity, &cache_));
+  }
+
+  void Insert(int i) { cache_->Insert(Key(i), Value(i)); }
+
+  // Returns "miss" or "ok", or "bad" if the cache returned the wrong data.
+  std::string Lookup(int i) {
+    std::string value = Value(i);
+    std::string scratch(value.size(), '\0');
+    if (!cache_->Lookup(Key(i), scratch.size(), &scratch[0])) {
+      return "miss";
+    }
+    return scratch == value ? "ok" : "bad";
+  }
+
+  std::vector<std::string> SegmentFiles() {
+    std::vector<std::string> filenames, result;
+    env_->GetChildren(path_, &filenames);
+    for (const std::string& filename : filenames) {
+      if (filename.size() > 7 &&
+          filename.compare(filename.size() - 7, 7, ".pcache") == 0) {
+        result.push_back(path_ + "/" + filename);
+      }
+    }
+    std::sort(result.begin(), result.end());  // Oldest first
+    return result;
+  }
+
+  Env* env_;
+  std::string path_;
+  PersistentCache* cache_;
+};
+
+TEST_F(PersistentCacheTest, InsertAndLookup) {
+  Reopen(1 << 20);
+  ASSERT_EQ("miss", Lookup(1));
+  for (int i = 0; i < 100; i++) {
+    Insert(i);
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ("ok", Lookup(i)) << i;
+  }
+  ASSERT_EQ("miss", Lookup(100));
+  ASSERT_GT(cache_->TotalSize(), 100 * 1000);
+
+  // Entries are only returned at their size.
+  char scratch[2000];
+  ASSERT_TRUE(!cache_->Lookup(Key(1), 999, scratch));
+  ASSERT_TRUE(!cache_->Lookup(Key(1), 1001, scratch));
+
+  // Entries are not replaced.
+  cache_->Insert(Key(1), Value(2));
+  ASSERT_EQ("ok", Lookup(1));
+}
+
+TEST_F(PersistentCacheTest, SurvivesReopen) {
+  Reopen(1 << 20);
+  for (int i = 0; i < 500; i++) {
+    Insert(i);
+  }
+  // Both written out segments and the buffered entries are kept.
+  ASSERT_GT(SegmentFiles().size(), 1);
+  Reopen(1 << 20);
+  for (int i = 0; i < 500; i++) {
+    ASSERT_EQ("ok", Lookup(i)) << i;
+  }
+
+  // New entries do not overwrite the recovered ones.
+  for (int i = 500; i < 700; i++) {
+    Insert(i);
+  }
+  Reopen(1 << 20);
+  for (int i = 0; i < 700; i++) {
+    ASSERT_EQ("ok", Lookup(i)) << i;
+  }
+}
+
+TEST_F(PersistentCacheTest, EvictsOldestEntries) {
+  const uint64_t kCapacity = 1 << 20;
+  Reopen(kCapacity);
+  for (int i = 0; i < 5000; i++) {
+    Insert(i);
+  }
+  ASSERT_LE(cache_->TotalSize(), kCapacity * 9 / 8);
+  ASSERT_GE(cache_->TotalSize(), kCapacity * 3 / 4);
+  ASSERT_EQ("miss", Lookup(0));
+  ASSERT_EQ("ok", Lookup(4999));
+
+  // Evicted segments are removed from the directory.
+  uint64_t file_size, total_size = 0;
+  for (const std::string& fname : SegmentFiles()) {
+    ASSERT_LEVELDB_OK(env_->GetFileSize(fname, &file_size));
+    total_size += file_size;
+  }
+  ASSERT_LE(total_size, kCapacity);
+
+  // A smaller cache drops the oldest entries on open.
+  Reopen(kCapacity / 2);
+  ASSERT_LE(cache_->TotalSize(), kCapacity / 2);
+  ASSERT_EQ("ok", Lookup(4999));
+}
+
+TEST_F(PersistentCacheTest, CorruptedEntries) {
+  Reopen(1 << 20);
+  for (int i = 0; i < 500; i++) {
+    Insert(i);
+  }
+  std::vector<std::string> files = SegmentFiles();
+  ASSERT_GT(files.size(), 1);
+
+  // Corrupt the data of an entry in each of the segments while they are
+  // open, and then at rest.
+  std::string contents;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, files[0], &contents));
+  contents[kRecordSize - 500] ^= 1;  // Value of the first entry
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, contents, files[0]));
+  ASSERT_EQ("miss", Lookup(0));
+  ASSERT_EQ("ok", Lookup(1));
+
+  delete cache_;
+  cache_ = nullptr;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, files[1], &contents));
+  Slice key(contents.data() + 12, 8);
+  const int first = static_cast<int>(DecodeFixed64(key.data()));
+  contents[3 * kRecordSize - 500] ^= 1;  // Value of the third entry
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, contents, files[1]));
+
+  // Recovery stops at the corrupted entry of the second segment.
+  Reopen(1 << 20);
+  ASSERT_EQ("ok", Lookup(first));
+  ASSERT_EQ("ok", Lookup(first + 1));
+  ASSERT_EQ("miss", Lookup(first + 2));
+  ASSERT_EQ("miss", Lookup(first + 3));
+  ASSERT_EQ("ok", Lookup(499));
+}
+
+TEST_F(PersistentCacheTest, DirectoryIsLocked) {
+  Reopen(1 << 20);
+  PersistentCache* other;
+  ASSERT_TRUE(!NewPersistentCache(env_, path_, 1 << 20, &other).ok());
+}
+
+// Holds up the writes of segment files until Release() is called.
+class BlockingWritesEnv : public EnvWrapper {
+ public:
+  explicit BlockingWritesEnv(Env* target)
+      : EnvWrapper(target), cv_(&mu_), blocked_(true), writes_(0) {}
+
+  Status NewWritableFile(const std::string& fname,
+                         WritableFile** result) override {
+    class BlockingFile : public WritableFile {
+     public:
+      BlockingFile(WritableFile* target, BlockingWritesEnv* env)
+          : target_(target), env_(env) {}
+      ~BlockingFile() override { delete target_; }
+      Status Append(const Slice& data) override {
+        env_->WaitForRelease();
+        return target_->Append(data);
+      }
+      Status Close() override { return target_->Close(); }
+      Status Flush() override { return target_->Flush(); }
+      Status Sync() override { return target_->Sync(); }
+
+     private:
+      WritableFile* const target_;
+      BlockingWritesEnv* const env_;
+    };
+
+    Status s = target()->NewWritableFile(fname, result);
+    if (s.ok()) {
+      *result = new BlockingFile(*result, this);
+    }
+    return s;
+  }
+
+  // Waits until a write is held up.
+  void WaitForWrite() {
+    MutexLock l(&mu_);
+    while (writes_ == 0) {
+      cv_.Wait();
+    }
+  }
+
+  void Release() {
+    MutexLock l(&mu_);
+    blocked_ = false;
+    cv_.SignalAll();
+  }
+
+ private:
+  void WaitForRelease() {
+    MutexLock l(&mu_);
+    writes_++;
+    cv_.SignalAll();
+    while (blocked_) {
+      cv_.Wait();
+    }
+  }
+
+  port::Mutex mu_;
+  port::CondVar cv_;
+  bool blocked_;
+  int writes_;
+};
+
+TEST_F(PersistentCacheTest, WritesDoNotBlockOtherCalls) {
+  Env* const default_env = env_;
+  BlockingWritesEnv env(default_env);
+  env_ = &env;
+  Reopen(1 << 20);
+
+  // Fill more than a segment, so that the insert that fills it writes it
+  // out.
+  std::thread writer([this]() {
+    for (int i = 0; i < 200; i++) {
+      Insert(i);
+    }
+  });
+  env.WaitForWrite();
+
+  // Meanwhile, the entries of the full segment are served from memory, and
+  // other entries can be inserted.
+  ASSERT_EQ("ok", Lookup(0));
+  Insert(1000);
+  ASSERT_EQ("ok", Lookup(1000));
+
+  env.Release();
+  writer.join();
+  ASSERT_EQ(1, SegmentFiles().size());
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ("ok", Lookup(i)) << i;
+  }
+
+  delete cache_;
+  cache_ = nullptr;
+  env_ = default_env;
+}
+
+TEST_F(PersistentCacheTest, Concurrent) {
+  Reopen(1 << 20);
+  const int kThreads = 4;
+  const int kEntries = 2000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([this, t]() {
+      for (int i = t; i < kEntries; i += kThreads) {
+        Insert(i);
+        // Recent entries may be evicted by the other threads' inserts, but
+        // are never returned with the wrong data.
+        EXPECT_NE("bad", Lookup(i));
+        EXPECT_NE("bad", Lookup(i / 2));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ("ok", Lookup(kEntries - 1));
+}
+
+}  // namespace leveldb
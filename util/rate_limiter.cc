@@ -0,0 +1,231 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A token bucket that is refilled with the bytes allowed for one refill
+// period at the start of each period.  Requests that do not fit in the
+// bucket queue up by priority.  One of the waiting threads sleeps until
+// the next refill and then hands the new bytes out to the queued requests,
+// high priority first, possibly granting a large request over several
+// periods.
+
+#include "leveldb/rate_limiter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() = default;
+
+void RateLimiter::AddPendingCompactionBytes(int64_t delta) {}
+
+namespace {
+
+// Every kFairness-th refill serves low priority requests first, so that a
+// steady stream of high priority requests cannot starve them.
+static const int kFairness = 10;
+
+// An auto-tuned limiter adjusts its rate every kRefillsPerTune refills, by
+// a factor of kTuneStep, within [max / kTuneRange, max].
+static const int kRefillsPerTune = 10;
+static const double kTuneStep = 1.1;
+static const int64_t kTuneRange = 20;
+
+class GenericRateLimiter : public RateLimiter {
+ public:
+  GenericRateLimiter(int64_t bytes_per_second, int64_t refill_period_micros,
+                     bool auto_tuned, Env* env)
+      : env_(env),
+        refill_period_micros_(std::max<int64_t>(refill_period_micros, 1)),
+        auto_tuned_(auto_tuned),
+        max_bytes_per_second_(bytes_per_second),
+        bytes_per_second_(0),
+        refill_bytes_(0),
+        available_bytes_(0),
+        next_refill_micros_(0),
+        refills_(0),
+        timer_active_(false),
+        pending_compaction_bytes_(0),
+        tuned_pending_compaction_bytes_(0),
+        total_bytes_through_{0, 0},
+        cv_(&mu_) {
+    MutexLock l(&mu_);
+    SetRate(bytes_per_second);
+  }
+
+  ~GenericRateLimiter() override {
+    MutexLock l(&mu_);
+    assert(queues_[Env::LOW].empty() && queues_[Env::HIGH].empty());
+  }
+
+  void Request(int64_t bytes, Env::Priority pri) override {
+    if (bytes <= 0) {
+      return;
+    }
+    MutexLock l(&mu_);
+    total_bytes_through_[pri] += bytes;
+    RefillIfDue();
+    if (queues_[Env::LOW].empty() && queues_[Env::HIGH].empty() &&
+        available_bytes_ >= bytes) {
+      available_bytes_ -= bytes;
+      return;
+    }
+
+    Waiter w;
+    w.remaining = bytes;
+    w.granted = false;
+    queues_[pri].push_back(&w);
+    while (!w.granted) {
+      if (timer_active_) {
+        cv_.Wait();
+        continue;
+      }
+      // Sleep until the next refill on behalf of all the waiters.
+      timer_active_ = true;
+      const uint64_t now = env_->NowMicros();
+      if (now < next_refill_micros_) {
+        const uint64_t delay = std::min<uint64_t>(next_refill_micros_ - now,
+                                                  refill_period_micros_);
+        mu_.Unlock();
+        env_->SleepForMicroseconds(static_cast<int>(delay));
+        mu_.Lock();
+      }
+      timer_active_ = false;
+      RefillIfDue();
+    }
+  }
+
+  void SetBytesPerSecond(int64_t bytes_per_second) override {
+    assert(bytes_per_second > 0);
+    MutexLock l(&mu_);
+    max_bytes_per_second_ = bytes_per_second;
+    SetRate(bytes_per_second);
+  }
+
+  int64_t GetBytesPerSecond() const override {
+    MutexLock l(&mu_);
+    return bytes_per_second_;
+  }
+
+  int64_t GetTotalBytesThrough(Env::Priority pri) const override {
+    MutexLock l(&mu_);
+    return total_bytes_through_[pri];
+  }
+
+  void AddPendingCompactionBytes(int64_t delta) override {
+    MutexLock l(&mu_);
+    pending_compaction_bytes_ += delta;
+  }
+
+ private:
+  struct Waiter {
+    int64_t remaining;  // Bytes not granted yet
+    bool granted;
+  };
+
+  void SetRate(int64_t bytes_per_second) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    bytes_per_second_ = std::max<int64_t>(bytes_per_second, 1);
+    refill_bytes_ = std::max<int64_t>(
+        static_cast<int64_t>(static_cast<double>(bytes_per_second_) *
+                             refill_period_micros_ / 1e6),
+        1);
+    available_bytes_ = std::min(available_bytes_, refill_bytes_);
+  }
+
+  // Raises the rate while the pending compaction bytes grow, and lowers it
+  // while they shrink or stay at zero.
+  void Tune() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const int64_t min_rate =
+        std::max<int64_t>(max_bytes_per_second_ / kTuneRange, 1);
+    int64_t rate = bytes_per_second_;
+    if (pending_compaction_bytes_ > tuned_pending_compaction_bytes_) {
+      rate = std::max(static_cast<int64_t>(rate * kTuneStep), rate + 1);
+    } else if (pending_compaction_bytes_ < tuned_pending_compaction_bytes_ ||
+               pending_compaction_bytes_ <= 0) {
+      rate = static_cast<int64_t>(rate / kTuneStep);
+    }
+    tuned_pending_compaction_bytes_ = pending_compaction_bytes_;
+    rate = std::max(min_rate, std::min(rate, max_bytes_per_second_));
+    if (rate != bytes_per_second_) {
+      SetRate(rate);
+    }
+  }
+
+  // Grants as much of the bytes that are left as possible to the waiters
+  // queued at priority "pri", oldest first.
+  void Grant(Env::Priority pri) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    std::deque<Waiter*>* queue = &queues_[pri];
+    while (!queue->empty() && available_bytes_ > 0) {
+      Waiter* w = queue->front();
+      if (w->remaining > available_bytes_) {
+        w->remaining -= available_bytes_;
+        available_bytes_ = 0;
+        break;
+      }
+      available_bytes_ -= w->remaining;
+      w->remaining = 0;
+      w->granted = true;
+      queue->pop_front();
+    }
+  }
+
+  // If a refill period has started since the last refill, refills the
+  // bucket and grants its bytes to the queued waiters.  The waiters are
+  // woken up, and one of those that are still queued takes over the timer.
+  void RefillIfDue() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const uint64_t now = env_->NowMicros();
+    if (now < next_refill_micros_) {
+      return;
+    }
+    next_refill_micros_ = now + refill_period_micros_;
+    refills_++;
+    if (auto_tuned_ && refills_ % kRefillsPerTune == 0) {
+      Tune();
+    }
+    // Unused bytes do not carry over, so bursts stay within one period.
+    available_bytes_ = refill_bytes_;
+    if (refills_ % kFairness == 0) {
+      Grant(Env::LOW);
+      Grant(Env::HIGH);
+    } else {
+      Grant(Env::HIGH);
+      Grant(Env::LOW);
+    }
+    cv_.SignalAll();
+  }
+
+  Env* const env_;
+  const int64_t refill_period_micros_;
+  const bool auto_tuned_;
+
+  mutable port::Mutex mu_;
+  int64_t max_bytes_per_second_ GUARDED_BY(mu_);
+  int64_t bytes_per_second_ GUARDED_BY(mu_);
+  int64_t refill_bytes_ GUARDED_BY(mu_);  // Bytes allowed per period
+  int64_t available_bytes_ GUARDED_BY(mu_);
+  uint64_t next_refill_micros_ GUARDED_BY(mu_);
+  uint64_t refills_ GUARDED_BY(mu_);
+  bool timer_active_ GUARDED_BY(mu_);  // Is a waiter sleeping to refill?
+  int64_t pending_compaction_bytes_ GUARDED_BY(mu_);
+  int64_t tuned_pending_compaction_bytes_ GUARDED_BY(mu_);  // At last Tune()
+  int64_t total_bytes_through_[2] GUARDED_BY(mu_);  // By Env::Priority
+  std::deque<Waiter*> queues_[2] GUARDED_BY(mu_);   // By Env::Priority
+  port::CondVar cv_;  // Signalled after each refill
+};
+
+}  // namespace
+
+RateLimiter* NewGenericRateLimiter(int64_t bytes_per_second,
+                                   int64_t refill_period_micros,
+                                   bool auto_tuned) {
+  return new GenericRateLimiter(bytes_per_second, refill_period_micros,
+                                auto_tuned, Env::Default());
+}
+
+}  // namespace leveldb
@@ -0,0 +1,122 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+class RateLimiterTest : public testing::Test {
+ public:
+  RateLimiterTest() : env_(Env::Default()) {}
+
+  Env* env_;
+};
+
+TEST_F(RateLimiterTest, Rate) {
+  // 10KB per 10ms refill.
+  RateLimiter* limiter = NewGenericRateLimiter(1 << 20, 10 * 1000);
+  ASSERT_EQ(1 << 20, limiter->GetBytesPerSecond());
+  const uint64_t start = env_->NowMicros();
+  for (int i = 0; i < 40; i++) {
+    limiter->Request(10 << 10, Env::LOW);
+  }
+  // The first request fits in the initial refill.
+  ASSERT_GE(env_->NowMicros() - start, 300 * 1000);
+  ASSERT_EQ(40 * (10 << 10), limiter->GetTotalBytesThrough(Env::LOW));
+  ASSERT_EQ(0, limiter->GetTotalBytesThrough(Env::HIGH));
+  delete limiter;
+}
+
+TEST_F(RateLimiterTest, LargeRequest) {
+  RateLimiter* limiter = NewGenericRateLimiter(1 << 20, 10 * 1000);
+  // Requests larger than a refill are granted over several refills.
+  const uint64_t start = env_->NowMicros();
+  limiter->Request(55 << 10, Env::HIGH);
+  ASSERT_GE(env_->NowMicros() - start, 40 * 1000);
+
+  // A lower rate takes effect at the next refill.
+  limiter->SetBytesPerSecond(100 << 10);
+  ASSERT_EQ(100 << 10, limiter->GetBytesPerSecond());
+  const uint64_t restart = env_->NowMicros();
+  limiter->Request(10 << 10, Env::HIGH);
+  limiter->Request(10 << 10, Env::HIGH);
+  ASSERT_GE(env_->NowMicros() - restart, 100 * 1000);
+  delete limiter;
+}
+
+TEST_F(RateLimiterTest, HighPriorityFirst) {
+  // 20KB per 20ms refill.
+  RateLimiter* limiter = NewGenericRateLimiter(1 << 20, 20 * 1000);
+  const int kLowThreads = 3;
+  const int kLowRequests = 20;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kLowThreads; t++) {
+    threads.emplace_back([limiter]() {
+      for (int i = 0; i < kLowRequests; i++) {
+        limiter->Request(20 << 10, Env::LOW);
+      }
+    });
+  }
+  env_->SleepForMicroseconds(50 * 1000);
+
+  // Each high priority request is granted at the next refill rather than
+  // after the queued low priority requests, which would take about four
+  // refills each.
+  const uint64_t start = env_->NowMicros();
+  for (int i = 0; i < 5; i++) {
+    limiter->Request(20 << 10, Env::HIGH);
+  }
+  const uint64_t high_micros = env_->NowMicros() - start;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_LT(high_micros, 300 * 1000);
+  ASSERT_EQ(kLowThreads * kLowRequests * (20 << 10),
+            limiter->GetTotalBytesThrough(Env::LOW));
+  ASSERT_EQ(5 * (20 << 10), limiter->GetTotalBytesThrough(Env::HIGH));
+  delete limiter;
+}
+
+TEST_F(RateLimiterTest, AutoTuned) {
+  const int64_t kMaxRate = 10 << 20;
+  // Tuned every 10 refills of 1ms.
+  RateLimiter* limiter = NewGenericRateLimiter(kMaxRate, 1000, true);
+  ASSERT_EQ(kMaxRate, limiter->GetBytesPerSecond());
+
+  // Nothing pending: the rate goes down to its lower bound.
+  uint64_t end = env_->NowMicros() + 500 * 1000;
+  while (env_->NowMicros() < end) {
+    limiter->Request(100, Env::LOW);
+  }
+  const int64_t low_rate = limiter->GetBytesPerSecond();
+  ASSERT_LE(low_rate, kMaxRate / 10);
+  ASSERT_GE(low_rate, kMaxRate / 20);
+
+  // Growing pending compaction bytes raise the rate back up.
+  end = env_->NowMicros() + 500 * 1000;
+  while (env_->NowMicros() < end) {
+    limiter->AddPendingCompactionBytes(1000);
+    limiter->Request(100, Env::LOW);
+  }
+  const int64_t high_rate = limiter->GetBytesPerSecond();
+  ASSERT_GE(high_rate, kMaxRate / 4);
+  ASSERT_LE(high_rate, kMaxRate);
+
+  // And it goes down again once they shrink.
+  end = env_->NowMicros() + 200 * 1000;
+  while (env_->NowMicros() < end) {
+    limiter->AddPendingCompactionBytes(-1000);
+    limiter->Request(100, Env::LOW);
+  }
+  ASSERT_LT(limiter->GetBytesPerSecond(), high_rate);
+  delete limiter;
+}
+
+}  // namespace leveldb